@@ -2,6 +2,7 @@
 #include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <utility>
 #include <vector>
 
@@ -345,4 +346,99 @@ class AtomicStack {
   }
 };
 
+/*
+ * class AtomicLinkedStack - Thread-safe lock-free intrusive stack
+ *
+ * Unlike AtomicStack, any number of threads could push and pop at the same
+ * time and the stack is unbounded. Type T must have a member
+ * std::atomic<T *> next_p, which the stack uses to link items.
+ *
+ * The ABA problem is avoided with a version number in the upper 16 bits of
+ * the top pointer (user space pointers on x86-64 fit in the lower 48 bits),
+ * which is increased on every change of the top pointer. This way a single
+ * word CAS is enough, without CMPXCHG16B and libatomic as with
+ * VersionedPointer
+ *
+ * NOTE: A popped item could still be read by a concurrent Pop() which has
+ * loaded the old top pointer, so items must not be freed while the stack is
+ * in use (reusing them is fine)
+ */
+template <typename T>
+class AtomicLinkedStack {
+ private:
+  static_assert(sizeof(uintptr_t) == sizeof(uint64_t), "AtomicLinkedStack requires 64 bit pointers");
+
+  // The number of lower bits of the top word which holds the pointer
+  static constexpr int POINTER_BITS = 48;
+  static constexpr uint64_t POINTER_MASK = (1UL << POINTER_BITS) - 1;
+
+  // Pointer in the lower 48 bits and version number in the upper 16 bits
+  std::atomic<uint64_t> top;
+
+  static inline T *GetPointer(uint64_t word) { return reinterpret_cast<T *>(word & POINTER_MASK); }
+
+  /*
+   * MakeTop() - Returns the top word of a pointer with the version number
+   *             after the one of the previous top word
+   */
+  static inline uint64_t MakeTop(T *item_p, uint64_t prev_word) {
+    assert((reinterpret_cast<uintptr_t>(item_p) & ~POINTER_MASK) == 0);
+
+    return (((prev_word >> POINTER_BITS) + 1) << POINTER_BITS) | reinterpret_cast<uintptr_t>(item_p);
+  }
+
+ public:
+  AtomicLinkedStack() : top{0UL} {}
+
+  AtomicLinkedStack(const AtomicLinkedStack &) = delete;
+  AtomicLinkedStack &operator=(const AtomicLinkedStack &) = delete;
+
+  /*
+   * Push() - Pushes an item which is not in any stack
+   */
+  inline void Push(T *item_p) {
+    uint64_t snapshot_top = top.load(std::memory_order_relaxed);
+
+    while (true) {
+      item_p->next_p.store(GetPointer(snapshot_top), std::memory_order_relaxed);
+
+      // Release such that the item is complete for the thread that pops it
+      if (top.compare_exchange_weak(snapshot_top, MakeTop(item_p, snapshot_top), std::memory_order_release,
+                                    std::memory_order_relaxed)) {
+        return;
+      }
+    }
+  }
+
+  /*
+   * Pop() - Pops one item from the stack, or returns nullptr if the stack
+   *         is empty
+   */
+  inline T *Pop() {
+    uint64_t snapshot_top = top.load(std::memory_order_acquire);
+
+    while (true) {
+      T *item_p = GetPointer(snapshot_top);
+      if (item_p == nullptr) {
+        return nullptr;
+      }
+
+      // If the item has been popped (and maybe pushed again) after the top
+      // was loaded, then the next pointer could be stale but the CAS fails
+      // since the version number has changed
+      T *next_p = item_p->next_p.load(std::memory_order_relaxed);
+
+      if (top.compare_exchange_weak(snapshot_top, MakeTop(next_p, snapshot_top), std::memory_order_acquire,
+                                    std::memory_order_acquire)) {
+        return item_p;
+      }
+    }
+  }
+
+  /*
+   * IsEmpty() - Returns whether the stack was empty when this is called
+   */
+  inline bool IsEmpty() const { return GetPointer(top.load(std::memory_order_relaxed)) == nullptr; }
+};
+
 }  // namespace bwtree
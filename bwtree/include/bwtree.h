@@ -14,16 +14,27 @@
 #include <chrono>  // NOLINT
 #include <cinttypes>
 #include <cstddef>  // offsetof() is defined here
-#include <deque>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
+#include <iterator>
+#include <new>
+#include <optional>
+#include <string>
 #include <thread>  // NOLINT
+#include <type_traits>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 #include <mutex>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #include "atomic_stack.h"
 #include "bloom_filter.h"
+#include "byte_key.h"
 #include "sorted_small_set.h"
 #include "macros.h"
 #include "index_logger.h"
@@ -40,17 +51,56 @@
 
 /*
  * USE_OLD_EPOCH - This flag switches between old epoch and new epoch mechanism
+ *
+ * The old mechanism counts every thread in a shared epoch node. The new one
+ * protects threads with a GC slot in their own GCMetaData, and only threads
+ * without a slot use the shared epoch nodes
+ */
+// #define USE_OLD_EPOCH
+
+/*
+ * USE_KEY_TREE - This flag makes InnerNode keep a copy of its separator keys
+ *                in Eytzinger order (i.e. the BFS order of a binary search
+ *                tree) which is searched instead of the elements
+ */
+#define USE_KEY_TREE
+
+/*
+ * USE_HUGE_PAGE_MAPPING_TABLE - This flag backs mapping table chunks of at
+ *                               least MAPPING_TABLE_HUGE_PAGE_SIZE bytes with
+ *                               huge pages, using MAP_HUGETLB if there are
+ *                               reserved huge pages and madvise() for
+ *                               transparent huge pages otherwise
+ */
+#define USE_HUGE_PAGE_MAPPING_TABLE
+
+/*
+ * USE_NODE_ID_CLUSTER - This flag makes new NodeIDs be handed out in clusters
+ *                       of NODE_ID_CLUSTER_SIZE consecutive NodeIDs, and the
+ *                       NodeID of a split sibling be taken from the cluster of
+ *                       its parent (or of the node itself), such that mapping
+ *                       table entries read on a traversal share pages
  */
-#define USE_OLD_EPOCH
+#define USE_NODE_ID_CLUSTER
+
+/*
+ * USE_NODE_CACHE - This flag makes memory of nodes and delta chunks come from
+ *                  per-thread caches of size-classed blocks. Memory freed by
+ *                  GC is kept by the freeing thread up to a bounded size per
+ *                  thread and in total, and reused by its next allocation
+ *                  instead of going through the general purpose allocator
+ */
+#define USE_NODE_CACHE
 
 using NodeID = uint64_t;
 
 /*
  * BWTREE_TEMPLATE_ARGUMENTS - Save some key strokes
  */
-#define BWTREE_TEMPLATE_ARGUMENTS                                                                      \
-  template <typename KeyType, typename ValueType, typename KeyComparator, typename KeyEqualityChecker, \
-            typename KeyHashFunc, typename ValueEqualityChecker, typename ValueHashFunc>
+#define BWTREE_TEMPLATE_ARGUMENTS                                                                        \
+  template <typename KeyType, typename ValueType, typename KeyComparator, typename KeyEqualityChecker,   \
+            typename KeyHashFunc, typename ValueEqualityChecker, typename ValueHashFunc, bool UniqueKey, \
+            bool StripKeyPrefix>
 
 namespace bwtree {
 
@@ -65,8 +115,47 @@ namespace bwtree {
 // no thread sneaking in while GC decision is being made
 #define MAX_THREAD_COUNT ((int)0x7FFFFFFF)
 
-// The maximum number of nodes we could map in this index
-#define MAPPING_TABLE_SIZE ((size_t)(1 << 27))
+// The mapping table is a directory of chunks that are allocated on demand.
+// The first chunk has this many entries, and each following chunk has twice
+// as many entries as the previous one, such that the mapping table is never
+// more than twice as large as the number of NodeIDs handed out
+#define MAPPING_TABLE_FIRST_CHUNK_SIZE ((size_t)(1 << 10))
+
+// The number of chunks in the directory of the mapping table, which also
+// decides the maximum number of nodes we could map in this index
+#define MAPPING_TABLE_CHUNK_COUNT ((int)32)
+#define MAPPING_TABLE_SIZE (MAPPING_TABLE_FIRST_CHUNK_SIZE * (((size_t)1 << MAPPING_TABLE_CHUNK_COUNT) - 1))
+
+// Mapping table chunks at least this large are backed by huge pages
+#define MAPPING_TABLE_HUGE_PAGE_SIZE ((size_t)(2 * 1024 * 1024))
+
+// The number of consecutive NodeIDs in a cluster, which is the number of
+// bits of its free mask
+#define NODE_ID_CLUSTER_SIZE ((size_t)64)
+
+// The number of recycled NodeIDs in a batch, which is moved as a whole
+// between the shared pool and thread local slots
+#define NODE_ID_BATCH_SIZE ((size_t)64)
+
+// The number of garbage nodes allocated at once when there is no free one
+#define GARBAGE_NODE_SLAB_SIZE ((size_t)256)
+
+// Node memory blocks are rounded up to one of four size classes between two
+// powers of two from 2^NODE_CACHE_MIN_BLOCK_SHIFT bytes, and blocks larger
+// than 2^NODE_CACHE_MAX_BLOCK_SHIFT bytes are not cached
+#define NODE_CACHE_MIN_BLOCK_SHIFT ((size_t)6)
+#define NODE_CACHE_MAX_BLOCK_SHIFT ((size_t)16)
+#define NODE_CACHE_MIN_BLOCK_SIZE ((size_t)1 << NODE_CACHE_MIN_BLOCK_SHIFT)
+#define NODE_CACHE_MAX_BLOCK_SIZE ((size_t)1 << NODE_CACHE_MAX_BLOCK_SHIFT)
+
+// The number of bytes each thread keeps in free blocks, and the number of
+// bytes all threads keep together. Blocks freed beyond either of them are
+// returned to the general purpose allocator
+#define NODE_CACHE_THREAD_CAPACITY ((size_t)(4 * 1024 * 1024))
+#define NODE_CACHE_CAPACITY ((size_t)(64 * 1024 * 1024))
+
+// Threads reserve NODE_CACHE_CAPACITY in units of this many bytes
+#define NODE_CACHE_RESERVE_SIZE ((size_t)(256 * 1024))
 
 // If the length of delta chain exceeds ( >= ) this then we consolidate the node
 #define INNER_DELTA_CHAIN_LENGTH_THRESHOLD ((int)8)
@@ -79,7 +168,26 @@ namespace bwtree {
 #define LEAF_NODE_SIZE_UPPER_THRESHOLD ((int)128)
 #define LEAF_NODE_SIZE_LOWER_THRESHOLD ((int)32)
 
-#define PREALLOCATE_THREAD_NUM ((size_t)1024)
+// The GC metadata of a tree is a directory of chunks of slots, one slot per
+// GC ID. The first chunk is allocated with the tree and has this many slots,
+// and each following chunk has twice as many slots as the previous one
+#define PREALLOCATE_THREAD_NUM ((size_t)64)
+
+// The number of chunks in the directory of GC slots, which also decides the
+// maximum number of GC IDs that could be used at the same time
+#define GC_SLOT_CHUNK_COUNT ((int)10)
+#define MAX_GC_ID_COUNT (PREALLOCATE_THREAD_NUM * (((size_t)1 << GC_SLOT_CHUNK_COUNT) - 1))
+
+// Fraction of the upper size threshold that BulkLoad() fills each node to
+// Leaving head room avoids an immediate split on the first few inserts
+#define BULK_LOAD_FILL_FACTOR ((double)0.75)
+
+// Number of lookups GetValueBatch() advances in lock-step
+#define GET_VALUE_BATCH_GROUP_SIZE ((int)8)
+
+// Integer key search switches from binary search to a linear scan when
+// there are at most this many elements left
+#define KEY_SEARCH_LINEAR_SIZE ((int)16)
 
 /*
  * InnerInlineAllocateOfType() - allocates a chunk of memory from base node and
@@ -117,6 +225,9 @@ class BwTreeBase {
   // We invoke the GC procedure after this has been reached
   static constexpr size_t GC_NODE_COUNT_THREADHOLD = 1024;
 
+  // The last active epoch of a thread that is not inside the tree
+  static constexpr uint64_t QUIESCENT_EPOCH = static_cast<uint64_t>(-1);
+
   /** @return inner_delta_chain_length_threshold */
   NO_ASAN int GetInnerDeltaChainLengthThreshold() const { return inner_delta_chain_length_threshold_; }
   /** @return leaf_delta_chain_length_threshold */
@@ -136,39 +247,80 @@ class BwTreeBase {
    * Note that since we could not know the actual definition of BaseNode here,
    * all garbage pointer to BaseNode should be represented as void *, and are
    * casted to appropriate type manually
+   *
+   * Garbage nodes are never freed before the tree is destroyed. Freed ones
+   * are kept in free lists of GC slots or in a shared stack, and new ones
+   * are allocated in slabs (see AllocateGarbageNode())
    */
   class GarbageNode {
    public:
     // The epoch that this node is unlinked
     // This do not have to be exact - just make sure it is no earlier than the
     // actual epoch it is unlinked from the data structure
+    // Garbage nodes in shared epochs do not use it
     uint64_t delete_epoch;
     void *node_p;
-    GarbageNode *next_p;
 
-    /*
-     * Constructor
-     */
-    NO_ASAN GarbageNode(uint64_t p_delete_epoch, void *p_node_p)
-        : delete_epoch{p_delete_epoch}, node_p{p_node_p}, next_p{nullptr} {}
+    // Link in a garbage list or a free list, which is atomic since it is
+    // also used by AtomicLinkedStack. It is only accessed with relaxed
+    // operations otherwise
+    std::atomic<GarbageNode *> next_p;
 
     NO_ASAN GarbageNode() : delete_epoch{0UL}, node_p{nullptr}, next_p{nullptr} {}
   };
 
+  /*
+   * class GarbageNodeSlab - A chunk of garbage nodes allocated at once
+   */
+  class GarbageNodeSlab {
+   public:
+    // Link in the list of all slabs, which are only freed with the tree
+    GarbageNodeSlab *next_p;
+
+    GarbageNode node_list[GARBAGE_NODE_SLAB_SIZE];
+
+    NO_ASAN GarbageNodeSlab() : next_p{nullptr}, node_list{} {}
+  };
+
+  /*
+   * class NodeIDBatch - A batch of recycled NodeIDs
+   *
+   * Full batches are shared through a lock-free stack, and each thread fills
+   * and drains a batch of its own in its GCMetaData, such that recycling
+   * and reusing a NodeID does not touch shared cache lines in most cases
+   */
+  class NodeIDBatch {
+   public:
+    // Link in the stack of full or empty batches (see AtomicLinkedStack)
+    std::atomic<NodeIDBatch *> next_p;
+
+    // Link in the list of all batches, which are only freed with the tree
+    NodeIDBatch *list_next_p;
+
+    size_t size;
+    NodeID node_id_list[NODE_ID_BATCH_SIZE];
+
+    NO_ASAN NodeIDBatch() : next_p{nullptr}, list_next_p{nullptr}, size{0UL} {}
+  };
+
   /*
    * class GCMetaData - Metadata for performing GC on per-thread basis
    */
   class GCMetaData {
    public:
-    // This is the last active epoch counter; all garbages before this counter
-    // are guaranteed to be not being used by this thread
+    // This is the epoch in which the thread entered its current operation,
+    // or QUIESCENT_EPOCH if it is not inside the tree; all garbages unlinked
+    // before this counter are guaranteed to be not being used by this thread
     // So if we take a global minimum of this value, that minimum could be
     // be used as the global epoch value to decide whether a garbage node could
     // be recycled
-    uint64_t last_active_epoch;
+    //
+    // Only the owning thread writes it, such that entering and leaving an
+    // epoch never writes a shared cache line
+    std::atomic<uint64_t> last_active_epoch;
 
-    // We only need a pointer
-    GarbageNode header;
+    // The first node in the garbage node linked list, or nullptr if empty
+    GarbageNode *head_p;
 
     // This points to the last node in the garbage node linked list
     // We always append new nodes to this pointer, and thus inside one
@@ -178,14 +330,38 @@ class BwTreeBase {
     // until we see an epoch >= GC epoch
     GarbageNode *last_p;
 
+    // Garbage nodes freed by this thread, which are reused before any other
+    // garbage node such that retiring a node does not allocate memory
+    GarbageNode *free_garbage_p;
+
+    // The global epoch of the last GC attempt that could not free enough
+    // nodes. Nothing more could be freed before the global epoch advances,
+    // so we do not scan the other threads again until then
+    uint64_t last_gc_epoch;
+
+    // NodeIDs recycled and reused by this thread (see GetNextNodeID())
+    NodeIDBatch *node_id_batch_p;
+
     // The number of nodes inside this GC context
     // We use this as a threshold to trigger GC
-    uint64_t node_count;
+    uint32_t node_count;
+
+    // The number of nested operations of the thread, such that operations
+    // started inside a visitor do not end the epoch of the outer one
+    uint32_t epoch_depth;
 
     /*
      * Default constructor
      */
-    NO_ASAN GCMetaData() : last_active_epoch{0UL}, header{}, last_p{&header}, node_count{0UL} {}
+    NO_ASAN GCMetaData()
+        : last_active_epoch{QUIESCENT_EPOCH},
+          head_p{nullptr},
+          last_p{nullptr},
+          free_garbage_p{nullptr},
+          last_gc_epoch{QUIESCENT_EPOCH},
+          node_id_batch_p{nullptr},
+          node_count{0U},
+          epoch_depth{0U} {}
   };
 
   // Make sure class Data does not exceed one cache line
@@ -220,6 +396,313 @@ class BwTreeBase {
                 "class PaddedGCMetadata size does"
                 " not conform to the alignment!");
 
+  /*
+   * class GCEpochGroup - Cached lower bound of the last active epochs of the
+   *                      slots of a group of 64 GC IDs (i.e. one word of the
+   *                      GC ID bitmap)
+   *
+   * The bound is computed as the minimum of the slots and the global epoch
+   * read before the slots, and stays valid after threads in the group enter
+   * new epochs: a thread entering after the computation could not see any
+   * node deleted before the global epoch that has been read. Therefore it
+   * only grows, and the group is only scanned again if its bound keeps
+   * garbage from being freed (see SummarizeGCEpoch())
+   */
+  class GCEpochGroup {
+   public:
+    // No thread in this group could see a node deleted before this epoch
+    std::atomic<uint64_t> min_epoch;
+
+    NO_ASAN GCEpochGroup() : min_epoch{0UL} {}
+  };
+
+  using PaddedGCEpochGroup = PaddedData<GCEpochGroup, CACHE_LINE_SIZE>;
+
+  // The number of GC IDs in a GCEpochGroup
+  static constexpr size_t GC_EPOCH_GROUP_SIZE = 64;
+
+ public:
+  /*
+   * class NodeCacheStats - Counters of node memory allocation
+   *
+   * allocate_count and free_count are the number of blocks requested and
+   * freed by the tree, and malloc_count and release_count are the number of
+   * those that went through the general purpose allocator
+   */
+  class NodeCacheStats {
+   public:
+    uint64_t allocate_count;
+    uint64_t free_count;
+    uint64_t malloc_count;
+    uint64_t release_count;
+
+    // The number of bytes in free blocks held by the cache
+    uint64_t cached_size;
+
+    NO_ASAN NodeCacheStats()
+        : allocate_count{0UL}, free_count{0UL}, malloc_count{0UL}, release_count{0UL}, cached_size{0UL} {}
+  };
+
+  /*
+   * GetNodeSizeClass() - Returns the size class of a node memory block
+   *
+   * Class 0 is NODE_CACHE_MIN_BLOCK_SIZE, and each following power of two is
+   * divided into four classes, such that at most a quarter is wasted
+   */
+  NO_ASAN static constexpr size_t GetNodeSizeClass(size_t size) {
+    if (size <= NODE_CACHE_MIN_BLOCK_SIZE) {
+      return 0;
+    }
+
+    // 2^shift < size <= 2^(shift + 1)
+    size_t shift = 63 - __builtin_clzll(size - 1);
+    size_t quarter = ((size - 1) >> (shift - 2)) & 3;
+
+    return (shift - NODE_CACHE_MIN_BLOCK_SHIFT) * 4 + quarter + 1;
+  }
+
+  /*
+   * GetNodeSizeClassSize() - Returns the block size of a size class
+   */
+  NO_ASAN static constexpr size_t GetNodeSizeClassSize(size_t size_class) {
+    if (size_class == 0) {
+      return NODE_CACHE_MIN_BLOCK_SIZE;
+    }
+
+    size_t shift = (size_class - 1) / 4 + NODE_CACHE_MIN_BLOCK_SHIFT;
+
+    return ((size_t)1 << shift) + (((size_class - 1) % 4 + 1) << (shift - 2));
+  }
+
+  // The number of size classes of cached blocks
+  static constexpr size_t NODE_CACHE_CLASS_COUNT = (NODE_CACHE_MAX_BLOCK_SHIFT - NODE_CACHE_MIN_BLOCK_SHIFT) * 4 + 1;
+
+  /*
+   * class NodeCacheCounters - Counters of node memory that are read by other
+   *                           threads
+   *
+   * The counters of a live thread are only written by the thread itself, so
+   * they are updated with a relaxed load and store instead of an atomic add
+   */
+  class NodeCacheCounters {
+   public:
+    std::atomic<uint64_t> allocate_count;
+    std::atomic<uint64_t> free_count;
+    std::atomic<uint64_t> malloc_count;
+    std::atomic<uint64_t> release_count;
+    std::atomic<uint64_t> cached_size;
+
+    NO_ASAN constexpr NodeCacheCounters()
+        : allocate_count{0UL}, free_count{0UL}, malloc_count{0UL}, release_count{0UL}, cached_size{0UL} {}
+
+    /*
+     * Add() - Adds to a counter written only by the current thread
+     */
+    NO_ASAN static void Add(std::atomic<uint64_t> *counter_p, uint64_t value) {
+      counter_p->store(counter_p->load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    /*
+     * Subtract() - Subtracts from a counter written only by the current thread
+     */
+    NO_ASAN static void Subtract(std::atomic<uint64_t> *counter_p, uint64_t value) {
+      counter_p->store(counter_p->load(std::memory_order_relaxed) - value, std::memory_order_relaxed);
+    }
+
+    /*
+     * AddTo() - Adds all counters to a snapshot
+     */
+    NO_ASAN void AddTo(NodeCacheStats *stats_p) const {
+      stats_p->allocate_count += allocate_count.load(std::memory_order_relaxed);
+      stats_p->free_count += free_count.load(std::memory_order_relaxed);
+      stats_p->malloc_count += malloc_count.load(std::memory_order_relaxed);
+      stats_p->release_count += release_count.load(std::memory_order_relaxed);
+      stats_p->cached_size += cached_size.load(std::memory_order_relaxed);
+    }
+  };
+
+  /*
+   * class NodeCache - Per-thread free blocks of node memory
+   *
+   * Free blocks are linked through their first bytes. A thread keeps at most
+   * NODE_CACHE_THREAD_CAPACITY bytes of free blocks, and all threads together
+   * keep at most NODE_CACHE_CAPACITY bytes. The global budget is reserved
+   * NODE_CACHE_RESERVE_SIZE bytes at a time, such that it is not updated on
+   * every allocation. When either of them is reached, blocks of other size
+   * classes are released to make room for the freed one
+   *
+   * The cache is emptied when the thread exits, after which memory freed by
+   * the thread goes to the general purpose allocator directly. Live caches
+   * are linked such that GetNodeCacheStats() sums them up
+   */
+  class NodeCache {
+   public:
+    void *free_list[NODE_CACHE_CLASS_COUNT];
+
+    // The number of bytes in free blocks of each size class
+    size_t class_size[NODE_CACHE_CLASS_COUNT];
+
+    // The number of bytes of the global budget reserved by this thread,
+    // which is at least the number of bytes in free blocks
+    size_t reserved_size;
+
+    bool enabled;
+
+    NodeCacheCounters stats;
+
+    // The list of live caches, protected by node_cache_list_lock
+    NodeCache *prev_p;
+    NodeCache *next_p;
+
+    NO_ASAN NodeCache()
+        : free_list{}, class_size{}, reserved_size{0UL}, enabled{true}, stats{}, prev_p{nullptr}, next_p{nullptr} {
+      std::lock_guard<std::mutex> guard{node_cache_list_lock};
+
+      next_p = node_cache_list_head_p;
+      if (next_p != nullptr) {
+        next_p->prev_p = this;
+      }
+      node_cache_list_head_p = this;
+    }
+
+    NO_ASAN ~NodeCache() {
+      enabled = false;
+      Release();
+
+      std::lock_guard<std::mutex> guard{node_cache_list_lock};
+
+      if (prev_p != nullptr) {
+        prev_p->next_p = next_p;
+      } else {
+        node_cache_list_head_p = next_p;
+      }
+      if (next_p != nullptr) {
+        next_p->prev_p = prev_p;
+      }
+
+      exited_node_cache_stats.allocate_count.fetch_add(stats.allocate_count.load());
+      exited_node_cache_stats.free_count.fetch_add(stats.free_count.load());
+      exited_node_cache_stats.malloc_count.fetch_add(stats.malloc_count.load());
+      exited_node_cache_stats.release_count.fetch_add(stats.release_count.load());
+    }
+
+    /*
+     * Reserve() - Makes room for a free block of a size class, and returns
+     *             false if there is none
+     *
+     * If this thread or all threads already keep as many bytes as they
+     * could, blocks of the other size class holding the most bytes are
+     * released first. Otherwise a thread whose workload moves to other node
+     * sizes would keep blocks it never reuses, and cache nothing else
+     */
+    NO_ASAN bool Reserve(size_t size_class) {
+      size_t block_size = GetNodeSizeClassSize(size_class);
+      size_t cached_size = stats.cached_size.load(std::memory_order_relaxed);
+      if (cached_size + block_size <= NODE_CACHE_THREAD_CAPACITY) {
+        if (cached_size + block_size <= reserved_size) {
+          return true;
+        }
+
+        if (node_cache_reserved_size.fetch_add(NODE_CACHE_RESERVE_SIZE) + NODE_CACHE_RESERVE_SIZE <=
+            NODE_CACHE_CAPACITY) {
+          reserved_size += NODE_CACHE_RESERVE_SIZE;
+          return true;
+        }
+
+        node_cache_reserved_size.fetch_sub(NODE_CACHE_RESERVE_SIZE);
+      }
+
+      // Blocks released here leave their budget reserved for the new block
+      size_t limit_size = std::min(reserved_size, NODE_CACHE_THREAD_CAPACITY);
+      if (block_size > limit_size) {
+        return false;
+      }
+
+      while (cached_size + block_size > limit_size) {
+        size_t victim_class = size_class;
+        for (size_t i = 0; i < NODE_CACHE_CLASS_COUNT; i++) {
+          if (i != size_class && class_size[i] > 0 &&
+              (victim_class == size_class || class_size[i] > class_size[victim_class])) {
+            victim_class = i;
+          }
+        }
+
+        if (victim_class == size_class) {
+          return false;
+        }
+
+        size_t victim_block_size = GetNodeSizeClassSize(victim_class);
+        while (free_list[victim_class] != nullptr && cached_size + block_size > limit_size) {
+          void *block_p = free_list[victim_class];
+          free_list[victim_class] = *reinterpret_cast<void **>(block_p);
+          class_size[victim_class] -= victim_block_size;
+          cached_size -= victim_block_size;
+
+          delete[] reinterpret_cast<char *>(block_p);
+          NodeCacheCounters::Add(&stats.release_count, 1);
+        }
+
+        stats.cached_size.store(cached_size, std::memory_order_relaxed);
+      }
+
+      return true;
+    }
+
+    /*
+     * Unreserve() - Returns the global budget that is not needed by the free
+     *               blocks
+     *
+     * One unit of NODE_CACHE_RESERVE_SIZE is kept unless all blocks are
+     * released, such that a thread that allocates and frees one block after
+     * another does not update the budget every time
+     */
+    NO_ASAN void Unreserve(bool release_all) {
+      size_t cached_size = stats.cached_size.load(std::memory_order_relaxed);
+      size_t keep_size = release_all ? 0UL : NODE_CACHE_RESERVE_SIZE;
+
+      while (reserved_size >= cached_size + keep_size + NODE_CACHE_RESERVE_SIZE) {
+        node_cache_reserved_size.fetch_sub(NODE_CACHE_RESERVE_SIZE);
+        reserved_size -= NODE_CACHE_RESERVE_SIZE;
+      }
+    }
+
+    /*
+     * Release() - Returns all free blocks to the general purpose allocator
+     */
+    NO_ASAN void Release() {
+      for (size_t i = 0; i < NODE_CACHE_CLASS_COUNT; i++) {
+        while (free_list[i] != nullptr) {
+          void *block_p = free_list[i];
+          free_list[i] = *reinterpret_cast<void **>(block_p);
+
+          delete[] reinterpret_cast<char *>(block_p);
+          NodeCacheCounters::Add(&stats.release_count, 1);
+        }
+
+        class_size[i] = 0UL;
+      }
+
+      stats.cached_size.store(0UL, std::memory_order_relaxed);
+      Unreserve(true);
+    }
+  };
+
+ private:
+  // Free node memory of the current thread
+  static thread_local NodeCache node_cache;
+
+  // Protects the list of live node caches
+  static std::mutex node_cache_list_lock;
+
+  // The most recently created live node cache
+  static NodeCache *node_cache_list_head_p;
+
+  // Counters of node caches that have been destroyed
+  static NodeCacheCounters exited_node_cache_stats;
+
+  // The number of bytes of the global budget reserved by all node caches
+  static std::atomic<size_t> node_cache_reserved_size;
+
  public:
   // This is used as the garbage collection ID, and is maintained in a per
   // thread level
@@ -227,25 +710,61 @@ class BwTreeBase {
   // threads and unregistered threads
   static thread_local int gc_id;
 
+  /*
+   * class GCIDOwner - Owns the GC ID claimed by RegisterThread(), and
+   *                   releases it when the thread exits such that the ID
+   *                   and its slots could be reused by another thread
+   */
+  class GCIDOwner {
+   public:
+    // The GC ID claimed by this thread, or -1 if there is none
+    int owned_gc_id;
+
+    NO_ASAN GCIDOwner() : owned_gc_id{-1} {}
+
+    NO_ASAN ~GCIDOwner() {
+      if (owned_gc_id >= 0) {
+        ReleaseGCID(owned_gc_id);
+      }
+    }
+  };
+
+  // The number of 64 bit words of the GC ID bitmap
+  static constexpr size_t GC_ID_BITMAP_SIZE = MAX_GC_ID_COUNT / 64;
+
  private:
-  // This is used to count the number of threads participating GC process
-  // We use this number to initialize GC data structure
-  static std::atomic<size_t> total_thread_num;
+  // The GC ID of the current thread that is released on thread exit
+  static thread_local GCIDOwner gc_id_owner;
+
+  // One bit per GC ID, which is set while the ID is used by a thread
+  // Only the GC slots of IDs in use are considered by SummarizeGCEpoch()
+  static std::atomic<uint64_t> gc_id_bitmap[GC_ID_BITMAP_SIZE];
 
-  // This is the array being allocated for performing GC
-  // The allocation aligns its address to cache line boundary
-  PaddedGCMetadata *gc_metadata_p;
+  // One more than the largest GC ID that has ever been used, which bounds the
+  // part of the bitmap being scanned
+  static std::atomic<size_t> gc_id_high_water;
 
-  // We use this to compute aligned memory address to be
-  // used as the gc metadata array
-  unsigned char *original_p;
+  // One bit per GC ID, which is set while the slots of the released ID are
+  // swept by the epoch manager of a tree (see BeginGCSlotSweep())
+  static std::atomic<uint64_t> gc_id_sweep_bitmap[GC_ID_BITMAP_SIZE];
 
-  // This is the number of thread that this instance could support
-  size_t thread_num;
+  // This is the directory of chunks of GC slots. Chunks are allocated on
+  // demand, aligned to cache line boundary, and are never moved or freed
+  // before the tree is destroyed
+  std::atomic<PaddedGCMetadata *> gc_metadata_chunk[GC_SLOT_CHUNK_COUNT];
+
+  // This is the number of thread that this instance could support, i.e.
+  // the number of slots in the chunks allocated so far
+  std::atomic<size_t> thread_num;
+
+  // The minimum of the bounds of all GCEpochGroup, such that reclamation
+  // usually does not read any group. It is on its own cache line since it
+  // is written by reclaiming threads, unlike the global epoch below
+  alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> min_epoch_cache;
 
   // This is current epoch
   // We need to make it atomic since multiple threads might try to modify it
-  uint64_t epoch;
+  std::atomic<uint64_t> epoch;
 
  protected:
   /** @param inner_delta_chain_length_threshold depth threshold for inner node chain to be assigned to this tree */
@@ -307,141 +826,495 @@ class BwTreeBase {
    * This function must be called when the garbage pool is empty
    */
   NO_ASAN void DestroyThreadLocal() {
-    INDEX_LOG_TRACE("Destroy %lu thread local slots", thread_num);
+    INDEX_LOG_TRACE("Destroy %lu thread local slots", thread_num.load());
 
-    NOISEPAGE_ASSERT(original_p != nullptr, "There must already be metadata allocated");
+    for (int i = 0; i < GC_SLOT_CHUNK_COUNT; i++) {
+      PaddedGCMetadata *chunk_p = gc_metadata_chunk[i].load();
+      if (chunk_p == nullptr) {
+        continue;
+      }
 
-    // Manually call destructor
-    for (size_t i = 0; i < thread_num; i++) {
-      NOISEPAGE_ASSERT((gc_metadata_p + i)->data.header.next_p == nullptr, "Next should be nullptr.");
+      for (size_t j = 0; j < GetGCSlotChunkSize(i); j++) {
+        NOISEPAGE_ASSERT((chunk_p + j)->data.head_p == nullptr, "Next should be nullptr.");
+      }
 
-      (gc_metadata_p + i)->~PaddedGCMetadata();
+      DestroyGCSlotChunk(i, chunk_p);
+      gc_metadata_chunk[i].store(nullptr);
     }
 
-    // Free memory using original pointer rather than adjusted pointer
-    free(original_p);
+    thread_num.store(0UL);
   }
 
   /*
    * PrepareThreadLocal() - Initialize thread local variables
    *
-   * This function uses thread_num to initialize number of threads
+   * This function allocates the chunks for the first thread_num slots
    */
   NO_ASAN void PrepareThreadLocal() {
-    INDEX_LOG_TRACE("Preparing %lu thread local slots", thread_num);
+    INDEX_LOG_TRACE("Preparing %lu thread local slots", thread_num.load());
+
+    const size_t p_thread_num = std::max(thread_num.load(), static_cast<size_t>(1));
+    NOISEPAGE_ASSERT(p_thread_num <= MAX_GC_ID_COUNT, "Too many thread local slots.");
 
-    // This is the unaligned base address
-    // We allocate one more element than requested as the buffer
-    // for doing alignment
-    original_p = static_cast<unsigned char *>(malloc(CACHE_LINE_SIZE * (thread_num + 1)));
-    NOISEPAGE_ASSERT(original_p != nullptr, "Malloc failed.");
+    for (int i = 0; i < GC_SLOT_CHUNK_COUNT; i++) {
+      gc_metadata_chunk[i].store(nullptr, std::memory_order_relaxed);
+    }
 
-    // Align the address to cache line boundary
-    gc_metadata_p = reinterpret_cast<PaddedGCMetadata *>((reinterpret_cast<size_t>(original_p) + CACHE_LINE_SIZE - 1) &
-                                                         CACHE_LINE_MASK);
+    thread_num.store(0UL);
+    GrowThreadLocal(p_thread_num - 1);
+  }
 
-    // Make sure it is aligned
-    NOISEPAGE_ASSERT(((size_t)gc_metadata_p % CACHE_LINE_SIZE) == 0, "Unaligned malloc.");
+  /*
+   * GrowThreadLocal() - Allocates the chunks of slots up to the given
+   *                     thread ID
+   *
+   * Chunks are installed with CAS, so threads could grow the directory
+   * concurrently with each other and with threads using existing slots.
+   * thread_num is only raised after all chunks below it are installed
+   */
+  NO_ASAN void GrowThreadLocal(size_t thread_id) {
+    size_t offset;
+    const int last_chunk_index = GetGCSlotChunkIndex(thread_id, &offset);
+    NOISEPAGE_ASSERT(last_chunk_index < GC_SLOT_CHUNK_COUNT, "thread_id out of range.");
+
+    for (int i = 0; i <= last_chunk_index; i++) {
+      if (gc_metadata_chunk[i].load(std::memory_order_acquire) != nullptr) {
+        continue;
+      }
 
-    // Make sure we do not overflow the chunk of memory
-    NOISEPAGE_ASSERT(((size_t)gc_metadata_p + thread_num * CACHE_LINE_SIZE) <=
-                       ((size_t)original_p + (thread_num + 1) * CACHE_LINE_SIZE),
-                   "Overflowed chunk memory.");
+      PaddedGCMetadata *chunk_p = AllocateGCSlotChunk(i);
 
-    // At last call constructor of the class; we use placement new
-    for (size_t i = 0; i < thread_num; i++) {
-      new (gc_metadata_p + i) PaddedGCMetadata{};
+      // If another thread has installed the chunk then we free ours
+      PaddedGCMetadata *expected_p = nullptr;
+      if (!gc_metadata_chunk[i].compare_exchange_strong(expected_p, chunk_p)) {
+        DestroyGCSlotChunk(i, chunk_p);
+      }
     }
+
+    FetchMax(&thread_num, PREALLOCATE_THREAD_NUM * ((static_cast<size_t>(1) << (last_chunk_index + 1)) - 1));
   }
 
   /*
-   * SetThreadNum() - Sets number of threads manually
+   * AllocateGCSlotChunk() - Allocates and initializes a chunk of slots
+   *
+   * The slots are followed by the GCEpochGroup of every 64 slots
    */
-  NO_ASAN void SetThreadNum(size_t p_thread_num) { thread_num = p_thread_num; }
+  NO_ASAN PaddedGCMetadata *AllocateGCSlotChunk(int chunk_index) {
+    const size_t chunk_size = GetGCSlotChunkSize(chunk_index);
+    const size_t group_num = chunk_size / GC_EPOCH_GROUP_SIZE;
 
- public:
-  /*
-   * Constructor - Initialize GC data structure
-   */
-  NO_ASAN BwTreeBase() : gc_metadata_p{nullptr}, original_p{nullptr}, thread_num{total_thread_num.load()}, epoch{0UL} {
-    // Allocate memory for thread local data structure
-    PrepareThreadLocal();
+    auto *chunk_p = static_cast<PaddedGCMetadata *>(
+        std::aligned_alloc(CACHE_LINE_SIZE, (chunk_size + group_num) * CACHE_LINE_SIZE));
+    NOISEPAGE_ASSERT(chunk_p != nullptr, "Malloc failed.");
+
+    // At last call constructor of the class; we use placement new
+    for (size_t j = 0; j < chunk_size; j++) {
+      new (chunk_p + j) PaddedGCMetadata{};
+    }
+
+    auto *group_p = reinterpret_cast<PaddedGCEpochGroup *>(chunk_p + chunk_size);
+    for (size_t j = 0; j < group_num; j++) {
+      new (group_p + j) PaddedGCEpochGroup{};
+    }
+
+    return chunk_p;
   }
 
   /*
-   * Destructor - Manually call destructor and then frees the memory
+   * DestroyGCSlotChunk() - Calls destructors of a chunk of slots and frees it
    */
-  NO_ASAN ~BwTreeBase() {
-    // Frees all metadata
-    DestroyThreadLocal();
+  NO_ASAN void DestroyGCSlotChunk(int chunk_index, PaddedGCMetadata *chunk_p) {
+    const size_t chunk_size = GetGCSlotChunkSize(chunk_index);
 
-    INDEX_LOG_TRACE("Finished destroying class BwTreeBase");
+    // Manually call destructor
+    for (size_t j = 0; j < chunk_size; j++) {
+      (chunk_p + j)->~PaddedGCMetadata();
+    }
+
+    auto *group_p = reinterpret_cast<PaddedGCEpochGroup *>(chunk_p + chunk_size);
+    for (size_t j = 0; j < chunk_size / GC_EPOCH_GROUP_SIZE; j++) {
+      (group_p + j)->~PaddedGCEpochGroup();
+    }
+
+    free(chunk_p);
   }
 
   /*
-   * GetThreadNum() - Returns the number of thread currently this instance of
-   *                  BwTree is serving
+   * FetchMax() - Atomically raises a value to at least the given one, and
+   *              returns the resulting value
    */
-  NO_ASAN inline size_t GetThreadNum() { return thread_num; }
+  template <typename T>
+  NO_ASAN static inline T FetchMax(std::atomic<T> *value_p, T new_value) {
+    T value = value_p->load();
+    while (value < new_value && !value_p->compare_exchange_weak(value, new_value)) {
+    }
+
+    return std::max(value, new_value);
+  }
 
   /*
-   * AssignGCID() - Assigns a gc_id manually
+   * GetGCSlotChunkIndex() - Returns the index of the chunk that holds the
+   *                         slot of a thread ID, and the offset of the slot
    *
-   * This is mainly used for debugging
+   * Chunks are laid out in the same way as mapping table chunks (see
+   * GetMappingTableChunkIndex())
    */
-  NO_ASAN inline void AssignGCID(int p_gc_id) { gc_id = p_gc_id; }
+  static inline int GetGCSlotChunkIndex(size_t thread_id, size_t *offset_p) {
+    static_assert((PREALLOCATE_THREAD_NUM & (PREALLOCATE_THREAD_NUM - 1)) == 0,
+                  "The first chunk size must be a power of two.");
+    constexpr int first_chunk_bit = __builtin_ctzll(PREALLOCATE_THREAD_NUM);
+
+    const uint64_t biased_id = static_cast<uint64_t>(thread_id) + PREALLOCATE_THREAD_NUM;
+    const int chunk_index = 63 - __builtin_clzll(biased_id) - first_chunk_bit;
+
+    *offset_p = biased_id - (PREALLOCATE_THREAD_NUM << chunk_index);
+    return chunk_index;
+  }
 
   /*
-   * RegisterThread() - Registers a thread for GC for all instances of BwTree
-   *                    in the current process's address space
-   *
-   * This function assigns an ID to a thread starting from 0, which could be
-   * used as thread ID for the garbage collection process.
-   *
-   * Also note that only threads registered before an instance is created will
-   * be considered as being eligible for GC for that thread
-   *
-   * This function does not return any value, and instead it uses an atomic
-   * counter to counter the number of threads currently in this system, and
-   * assigns the thread ID to a thread local variable called gc_id decleared
-   * inside this class
-   *
-   * Each thread being allocated a GC ID has a context for garbage collection
-   * that is aligned to cache lines. The context will be allocated for every
-   * thread being registered, even if it has already exited. Therefore, this
-   * approach is only suitable for thread pools where the number of threads
-   * is fixed at startup time.
+   * GetGCSlotChunkSize() - Returns the number of slots in a chunk
    */
-  NO_ASAN static void RegisterThread() { gc_id = total_thread_num.fetch_add(1); }
+  static constexpr size_t GetGCSlotChunkSize(int chunk_index) { return PREALLOCATE_THREAD_NUM << chunk_index; }
 
   /*
-   * IncreaseEpoch() - Go to the next epoch by increasing the counter
-   *
-   * Note that this should not be called by worker threads since
-   * it will cause contention
+   * GetGCEpochGroup() - Returns the GCEpochGroup of a word of the GC ID
+   *                     bitmap, whose slots must have been allocated
    */
-  NO_ASAN inline void IncreaseEpoch() { epoch++; }
+  NO_ASAN inline GCEpochGroup *GetGCEpochGroup(size_t group_index) {
+    size_t offset;
+    const int chunk_index = GetGCSlotChunkIndex(group_index * GC_EPOCH_GROUP_SIZE, &offset);
+
+    PaddedGCMetadata *chunk_p = gc_metadata_chunk[chunk_index].load(std::memory_order_acquire);
+    auto *group_p = reinterpret_cast<PaddedGCEpochGroup *>(chunk_p + GetGCSlotChunkSize(chunk_index));
+
+    return &(group_p + offset / GC_EPOCH_GROUP_SIZE)->data;
+  }
 
   /*
-   * UpdateLastActiveEpoch() - Updates the last active epoch field of thread
-   *                           local storage
-   *
-   * This is the core of GC algorithm. Its implication is that all garbage nodes
-   * unlinked before this epoch could be safely collected since at the time
-   * the thread local counter is updated, we know all references to shared
-   * resources have been released
+   * SetThreadNum() - Sets number of threads manually
    */
-  NO_ASAN inline void UpdateLastActiveEpoch() { GetCurrentGCMetaData()->last_active_epoch = GetGlobalEpoch(); }
+  NO_ASAN void SetThreadNum(size_t p_thread_num) { thread_num.store(p_thread_num); }
 
+ public:
   /*
-   * UnregisterThread() - Unregisters a thread by setting its epoch to
-   *                      0xFFFFFFFFFFFFFFFF such that it will not be considered
-   *                      for GC
+   * Constructor - Initialize GC data structure
    */
-  NO_ASAN inline void UnregisterThread(int thread_id) {
-    GetGCMetaData(thread_id)->last_active_epoch = static_cast<uint64_t>(-1);
+  NO_ASAN BwTreeBase() : gc_metadata_chunk{}, thread_num{PREALLOCATE_THREAD_NUM}, min_epoch_cache{0UL}, epoch{0UL} {
+    // Allocate memory for thread local data structure
+    PrepareThreadLocal();
   }
 
+  /*
+   * Destructor - Manually call destructor and then frees the memory
+   */
+  NO_ASAN ~BwTreeBase() {
+    // Frees all metadata
+    DestroyThreadLocal();
+
+    INDEX_LOG_TRACE("Finished destroying class BwTreeBase");
+  }
+
+  /*
+   * AllocateNodeMemory() - Allocates a block for a node or a delta chunk
+   *
+   * The block is taken from the free blocks of the current thread of the
+   * same size class if there is one. It must be freed by FreeNodeMemory()
+   * with the same size, possibly in another thread
+   */
+  NO_ASAN static void *AllocateNodeMemory(size_t size) {
+    NodeCache *cache_p = &node_cache;
+    NodeCacheCounters::Add(&cache_p->stats.allocate_count, 1);
+
+#ifdef USE_NODE_CACHE
+    if (size <= NODE_CACHE_MAX_BLOCK_SIZE) {
+      size_t size_class = GetNodeSizeClass(size);
+      size_t block_size = GetNodeSizeClassSize(size_class);
+
+      void *block_p = cache_p->free_list[size_class];
+      if (block_p != nullptr) {
+        cache_p->free_list[size_class] = *reinterpret_cast<void **>(block_p);
+        cache_p->class_size[size_class] -= block_size;
+        NodeCacheCounters::Subtract(&cache_p->stats.cached_size, block_size);
+        cache_p->Unreserve(false);
+
+        return block_p;
+      }
+
+      // Allocate the whole class such that the block could be reused by any
+      // size of the same class
+      size = block_size;
+    }
+#endif
+
+    NodeCacheCounters::Add(&cache_p->stats.malloc_count, 1);
+
+    return new char[size];
+  }
+
+  /*
+   * FreeNodeMemory() - Frees a block allocated by AllocateNodeMemory()
+   *
+   * The block is kept by the current thread, possibly in place of blocks of
+   * other size classes when the thread or all threads already keep as many
+   * free blocks as they could (see NodeCache)
+   */
+  NO_ASAN static void FreeNodeMemory(void *block_p, size_t size) {
+    NodeCache *cache_p = &node_cache;
+    NodeCacheCounters::Add(&cache_p->stats.free_count, 1);
+
+#ifdef USE_NODE_CACHE
+    if (size <= NODE_CACHE_MAX_BLOCK_SIZE && cache_p->enabled) {
+      size_t size_class = GetNodeSizeClass(size);
+      size_t block_size = GetNodeSizeClassSize(size_class);
+
+      if (cache_p->Reserve(size_class)) {
+        *reinterpret_cast<void **>(block_p) = cache_p->free_list[size_class];
+        cache_p->free_list[size_class] = block_p;
+        cache_p->class_size[size_class] += block_size;
+        NodeCacheCounters::Add(&cache_p->stats.cached_size, block_size);
+
+        return;
+      }
+    }
+#endif
+
+    NodeCacheCounters::Add(&cache_p->stats.release_count, 1);
+
+    delete[] reinterpret_cast<char *>(block_p);
+  }
+
+  /*
+   * ReleaseNodeCache() - Returns the free node memory of the current thread
+   *                      to the general purpose allocator
+   */
+  NO_ASAN static void ReleaseNodeCache() { node_cache.Release(); }
+
+  /*
+   * GetNodeCacheStats() - Returns the node memory counters of all threads,
+   *                       including those that have exited
+   *
+   * cached_size is the number of bytes in free blocks kept by all threads.
+   * Counters of other live threads are read while they are being updated,
+   * so they could be slightly behind
+   */
+  NO_ASAN static NodeCacheStats GetNodeCacheStats() {
+    NodeCacheStats stats{};
+
+    std::lock_guard<std::mutex> guard{node_cache_list_lock};
+
+    exited_node_cache_stats.AddTo(&stats);
+    for (const NodeCache *cache_p = node_cache_list_head_p; cache_p != nullptr; cache_p = cache_p->next_p) {
+      cache_p->stats.AddTo(&stats);
+    }
+
+    return stats;
+  }
+
+  /*
+   * GetThreadNodeCacheStats() - Returns the node memory counters of the
+   *                             current thread
+   */
+  NO_ASAN static NodeCacheStats GetThreadNodeCacheStats() {
+    NodeCacheStats stats{};
+    node_cache.stats.AddTo(&stats);
+
+    return stats;
+  }
+
+  /*
+   * GetNodeCacheReservedSize() - Returns the number of bytes of
+   *                              NODE_CACHE_CAPACITY reserved by all threads
+   */
+  NO_ASAN static size_t GetNodeCacheReservedSize() { return node_cache_reserved_size.load(); }
+
+  /*
+   * GetThreadNum() - Returns the number of thread currently this instance of
+   *                  BwTree is serving
+   */
+  NO_ASAN inline size_t GetThreadNum() { return thread_num.load(); }
+
+  /*
+   * AssignGCID() - Assigns a gc_id manually
+   *
+   * This is mainly used for debugging. The ID is marked as being used and
+   * is never released, so RegisterThread() will not hand it out. It is the
+   * caller's responsibility not to assign an ID used by another thread
+   */
+  NO_ASAN inline void AssignGCID(int p_gc_id) {
+    gc_id = p_gc_id;
+
+    if (p_gc_id >= 0 && static_cast<size_t>(p_gc_id) < MAX_GC_ID_COUNT) {
+      gc_id_bitmap[p_gc_id / 64].fetch_or(static_cast<uint64_t>(1) << (p_gc_id % 64));
+      UpdateGCIDHighWater(p_gc_id);
+    }
+  }
+
+  /*
+   * RegisterThread() - Registers a thread for GC for all instances of BwTree
+   *                    in the current process's address space
+   *
+   * This function assigns the smallest unused ID to a thread starting from 0,
+   * which could be used as thread ID for the garbage collection process. The
+   * ID is claimed from a bitmap with CAS, and is released when the thread
+   * exits (see class GCIDOwner), such that the number of IDs in use is the
+   * number of live threads even with short-lived threads. Calling this again
+   * in a registered thread restores its ID
+   *
+   * This function does not return any value, and instead assigns the thread
+   * ID to a thread local variable called gc_id decleared inside this class
+   *
+   * Each thread being allocated a GC ID has a context for garbage collection
+   * that is aligned to cache lines in every instance it uses. The context of
+   * a released ID is inherited by the next thread claiming it, and garbage
+   * nodes not yet freed are moved out by the epoch manager in the meantime
+   * (see SweepReleasedGCSlots()). If all IDs are in use, the thread is given
+   * an ID without slots and uses shared epochs
+   *
+   * Threads that have not been registered are registered the first time
+   * they enter an epoch (see GetEpochGCMetaData())
+   */
+  NO_ASAN static void RegisterThread() {
+    if (gc_id_owner.owned_gc_id < 0) {
+      gc_id_owner.owned_gc_id = ClaimGCID();
+    }
+
+    gc_id = (gc_id_owner.owned_gc_id >= 0) ? gc_id_owner.owned_gc_id : static_cast<int>(MAX_GC_ID_COUNT);
+  }
+
+  /*
+   * ClaimGCID() - Claims the smallest unused GC ID, or returns -1 if all IDs
+   *               are in use
+   */
+  NO_ASAN static int ClaimGCID() {
+    for (size_t i = 0; i < GC_ID_BITMAP_SIZE; i++) {
+      uint64_t word = gc_id_bitmap[i].load();
+
+      // If CAS fails then word is reloaded and we retry on the same word
+      while (word != ~static_cast<uint64_t>(0)) {
+        const int bit = __builtin_ctzll(~word);
+
+        if (gc_id_bitmap[i].compare_exchange_weak(word, word | (static_cast<uint64_t>(1) << bit))) {
+          const int claimed_gc_id = static_cast<int>(i * 64 + bit);
+          UpdateGCIDHighWater(claimed_gc_id);
+
+          // The slots might be being swept since the ID was released
+          while ((gc_id_sweep_bitmap[i].load() & (static_cast<uint64_t>(1) << bit)) != 0) {
+            std::this_thread::yield();
+          }
+
+          return claimed_gc_id;
+        }
+      }
+    }
+
+    return -1;
+  }
+
+  /*
+   * ReleaseGCID() - Marks a GC ID as unused
+   *
+   * The thread owning the ID must not be inside any instance, so its slots
+   * are all quiescent when another thread claims the ID
+   */
+  NO_ASAN static void ReleaseGCID(int p_gc_id) {
+    gc_id_bitmap[p_gc_id / 64].fetch_and(~(static_cast<uint64_t>(1) << (p_gc_id % 64)));
+  }
+
+  /*
+   * BeginGCSlotSweep() - Takes the slots of a released GC ID, such that they
+   *                      could be accessed as if by the owner of the ID
+   *
+   * Returns false if the ID is in use, or is being swept for another
+   * instance. A thread claiming the ID meanwhile waits in ClaimGCID() until
+   * EndGCSlotSweep(), so IDs are handed out as if there were no sweep
+   */
+  NO_ASAN static bool BeginGCSlotSweep(int p_gc_id) {
+    const uint64_t mask = static_cast<uint64_t>(1) << (p_gc_id % 64);
+
+    if ((gc_id_bitmap[p_gc_id / 64].load() & mask) != 0) {
+      return false;
+    }
+
+    if ((gc_id_sweep_bitmap[p_gc_id / 64].fetch_or(mask) & mask) != 0) {
+      return false;
+    }
+
+    // Either this sees the ID claimed, or the claiming thread sees the sweep
+    if ((gc_id_bitmap[p_gc_id / 64].load() & mask) != 0) {
+      EndGCSlotSweep(p_gc_id);
+      return false;
+    }
+
+    return true;
+  }
+
+  /*
+   * EndGCSlotSweep() - Returns the slots taken by BeginGCSlotSweep()
+   */
+  NO_ASAN static void EndGCSlotSweep(int p_gc_id) {
+    gc_id_sweep_bitmap[p_gc_id / 64].fetch_and(~(static_cast<uint64_t>(1) << (p_gc_id % 64)));
+  }
+
+  /*
+   * GetGCIDHighWater() - Returns one more than the largest GC ID that has
+   *                      ever been used
+   */
+  NO_ASAN static size_t GetGCIDHighWater() { return gc_id_high_water.load(); }
+
+  /*
+   * UpdateGCIDHighWater() - Makes sure that the high water of GC IDs covers
+   *                         the given ID
+   */
+  NO_ASAN static void UpdateGCIDHighWater(int p_gc_id) {
+    FetchMax(&gc_id_high_water, static_cast<size_t>(p_gc_id) + 1);
+  }
+
+  /*
+   * IncreaseEpoch() - Go to the next epoch by increasing the counter
+   *
+   * Note that this should not be called by worker threads since
+   * it will cause contention
+   */
+  NO_ASAN inline void IncreaseEpoch() { epoch++; }
+
+  /*
+   * EnterEpoch() - Publishes the current global epoch as the last active
+   *                epoch of the thread owning the metadata
+   *
+   * This is the core of GC algorithm. Garbage nodes are only freed if they
+   * are unlinked before the minimum last active epoch of all threads, and
+   * the sequentially consistent store makes sure that the epoch is visible
+   * before this thread reads any node (see AddGarbageNode())
+   *
+   * Nested calls only count the depth, and keep the epoch of the outermost
+   * operation
+   */
+  NO_ASAN inline void EnterEpoch(GCMetaData *metadata_p) {
+    if (metadata_p->epoch_depth++ == 0) {
+      metadata_p->last_active_epoch.store(GetGlobalEpoch());
+    }
+  }
+
+  /*
+   * ExitEpoch() - Marks the thread owning the metadata as quiescent after
+   *               its outermost operation, such that an idle thread never
+   *               holds back GC
+   */
+  NO_ASAN inline void ExitEpoch(GCMetaData *metadata_p) {
+    NOISEPAGE_ASSERT(metadata_p->epoch_depth > 0, "Thread is not inside an epoch.");
+
+    if (--metadata_p->epoch_depth == 0) {
+      metadata_p->last_active_epoch.store(QUIESCENT_EPOCH, std::memory_order_release);
+    }
+  }
+
+  /*
+   * UnregisterThread() - Unregisters a thread by setting its epoch to
+   *                      0xFFFFFFFFFFFFFFFF such that it will not be considered
+   *                      for GC
+   */
+  NO_ASAN inline void UnregisterThread(int thread_id) { GetGCMetaData(thread_id)->last_active_epoch = QUIESCENT_EPOCH; }
+
   /*
    * GetGlobalEpoch() - Returns the current global epoch counter
    *
@@ -450,7 +1323,7 @@ class BwTreeBase {
    * since all refreshing operations will read the same or smaller value
    * when it reads the counter
    */
-  NO_ASAN inline uint64_t GetGlobalEpoch() { return epoch; }
+  NO_ASAN inline uint64_t GetGlobalEpoch() { return epoch.load(); }
 
   /*
    * GetGCMetaData() - Returns the thread-local metadata for GC for a specified
@@ -458,9 +1331,12 @@ class BwTreeBase {
    */
   NO_ASAN inline GCMetaData *GetGCMetaData(int thread_id) {
     // The thread ID must be within the range
-    NOISEPAGE_ASSERT(thread_id >= 0 && thread_id < static_cast<int>(thread_num), "thread_id out of range.");
+    NOISEPAGE_ASSERT(thread_id >= 0 && thread_id < static_cast<int>(thread_num.load()), "thread_id out of range.");
 
-    return &(gc_metadata_p + thread_id)->data;
+    size_t offset;
+    const int chunk_index = GetGCSlotChunkIndex(thread_id, &offset);
+
+    return &(gc_metadata_chunk[chunk_index].load(std::memory_order_acquire) + offset)->data;
   }
 
   /*
@@ -469,26 +1345,104 @@ class BwTreeBase {
   NO_ASAN inline GCMetaData *GetCurrentGCMetaData() { return GetGCMetaData(gc_id); }
 
   /*
-   * SummarizeGCEpoch() - Returns the minimum epochs among the current epoch
-   *                      counters of all threads
+   * GetRegisteredGCMetaData() - Returns the metadata for the current thread,
+   *                             or nullptr if it has no slot in this instance
+   */
+  NO_ASAN inline GCMetaData *GetRegisteredGCMetaData() {
+    if (gc_id < 0 || static_cast<size_t>(gc_id) >= thread_num.load()) {
+      return nullptr;
+    }
+
+    return GetGCMetaData(gc_id);
+  }
+
+  /*
+   * GetEpochGCMetaData() - Returns the metadata the current thread uses to
+   *                        enter epochs, or nullptr if it has no slot in this
+   *                        instance
    *
-   * Note that if this is called then it must be true that there are at least
-   * one thread participating into the GC process
+   * Threads that have never been registered are registered here, so worker
+   * threads do not need to call RegisterThread() or AssignGCID(). If the
+   * slot of the thread has not been allocated, the slots are grown here
    */
-  NO_ASAN uint64_t SummarizeGCEpoch() {
-    NOISEPAGE_ASSERT(thread_num >= 1, "thread_num out of range.");
+  NO_ASAN inline GCMetaData *GetEpochGCMetaData() {
+    if (gc_id < 0) {
+      RegisterThread();
+    }
+
+    if (static_cast<size_t>(gc_id) >= thread_num.load()) {
+      if (static_cast<size_t>(gc_id) >= MAX_GC_ID_COUNT) {
+        return nullptr;
+      }
+
+      GrowThreadLocal(gc_id);
+    }
+
+    return GetGCMetaData(gc_id);
+  }
+
+  /*
+   * SummarizeGCEpoch() - Returns a lower bound of the last active epochs of
+   *                      all threads, which is above the target epoch if
+   *                      possible
+   *
+   * The bounds form a two level tree: a cached minimum of the tree and a
+   * GCEpochGroup for every 64 GC IDs. If the cached minimum is above the
+   * target epoch, i.e. all garbage of the caller up to that epoch could be
+   * freed, then no slot is read at all. Otherwise only the groups whose
+   * bounds are not above the target epoch are scanned again, and only the
+   * slots of GC IDs in use are read in each of them. Slots of released IDs
+   * are quiescent
+   *
+   * The result is capped by the global epoch read before reading the
+   * groups, since threads registering or growing the slots afterwards are
+   * not covered by any group read here (see class GCEpochGroup)
+   */
+  NO_ASAN uint64_t SummarizeGCEpoch(uint64_t target_epoch) {
+    uint64_t min_epoch = min_epoch_cache.load();
+    if (min_epoch > target_epoch) {
+      return min_epoch;
+    }
+
+    min_epoch = GetGlobalEpoch();
+
+    const size_t slot_num = thread_num.load();
+    const size_t group_num = (std::min(gc_id_high_water.load(), slot_num) + GC_EPOCH_GROUP_SIZE - 1) / GC_EPOCH_GROUP_SIZE;
+
+    for (size_t i = 0; i < group_num; i++) {
+      uint64_t group_min_epoch = GetGCEpochGroup(i)->min_epoch.load();
+      if (group_min_epoch <= target_epoch) {
+        group_min_epoch = SummarizeGCEpochGroup(i, slot_num);
+      }
 
-    // Use the first metadata's epoch as min and update it on the fly
-    uint64_t min_epoch = GetGCMetaData(0)->last_active_epoch;
+      min_epoch = std::min(group_min_epoch, min_epoch);
+    }
+
+    return FetchMax(&min_epoch_cache, min_epoch);
+  }
+
+  /*
+   * SummarizeGCEpochGroup() - Scans the slots of a GCEpochGroup, and returns
+   *                           its new bound
+   */
+  NO_ASAN uint64_t SummarizeGCEpochGroup(size_t group_index, size_t slot_num) {
+    uint64_t min_epoch = GetGlobalEpoch();
+    uint64_t word = gc_id_bitmap[group_index].load();
+
+    while (word != 0) {
+      const size_t thread_id = group_index * GC_EPOCH_GROUP_SIZE + __builtin_ctzll(word);
+      word &= word - 1;
+
+      if (thread_id >= slot_num) {
+        break;
+      }
 
-    // This might not be executed if there is only one thread
-    for (int i = 1; i < static_cast<int>(thread_num); i++) {
       // This will be compiled into using CMOV which is more efficient
       // than CMP and JMP
-      min_epoch = std::min(GetGCMetaData(i)->last_active_epoch, min_epoch);
+      min_epoch = std::min(GetGCMetaData(thread_id)->last_active_epoch.load(), min_epoch);
     }
 
-    return min_epoch;
+    return FetchMax(&GetGCEpochGroup(group_index)->min_epoch, min_epoch);
   }
 };
 
@@ -503,7 +1457,9 @@ class BwTreeBase {
  *           typename KeyEqualityChecker = std::equal_to<KeyType>,
  *           typename KeyHashFunc = std::hash<KeyType>,
  *           typename ValueEqualityChecker = std::equal_to<ValueType>,
- *           typename ValueHashFunc = std::hash<ValueType>>
+ *           typename ValueHashFunc = std::hash<ValueType>,
+ *           bool UniqueKey = false,
+ *           bool StripKeyPrefix = false>
  *
  * Explanation:
  *
@@ -530,13 +1486,24 @@ class BwTreeBase {
  *  - ValueHashFunc: Hashes ValueType into a size_t
  *                   This is used in unordered_set
  *
+ *  - UniqueKey: If true then every key has at most one value. Insert()
+ *               always rejects existing keys, and lookups stop at the first
+ *               record of the key instead of tracking value sets
+ *
+ *  - StripKeyPrefix: If true then each node stores the common prefix of its
+ *                    keys once, which is bounded by its low key and high
+ *                    key. This is only for ByteKey compared as bytes, and
+ *                    keys read from the tree could be stripped (see class
+ *                    ByteKey)
+ *
  * If not specified, then by default all arguments except the first two will
  * be set as the standard operator in C++ (i.e. the operator for primitive types
  * AND/OR overloaded operators for derived types)
  */
 template <typename KeyType, typename ValueType, typename KeyComparator = std::less<KeyType>,
           typename KeyEqualityChecker = std::equal_to<KeyType>, typename KeyHashFunc = std::hash<KeyType>,
-          typename ValueEqualityChecker = std::equal_to<ValueType>, typename ValueHashFunc = std::hash<ValueType>>
+          typename ValueEqualityChecker = std::equal_to<ValueType>, typename ValueHashFunc = std::hash<ValueType>,
+          bool UniqueKey = false, bool StripKeyPrefix = false>
 class BwTree : public BwTreeBase {
  public:
   class EpochManager;
@@ -563,6 +1530,39 @@ class BwTree : public BwTreeBase {
 
   using EpochNode = typename EpochManager::EpochNode;
 
+  // Whether key search could compare integer keys directly instead of calling
+  // the comparator. See IntegerKeySearch()
+  static constexpr bool INTEGER_KEY_SEARCH = std::is_integral<KeyType>::value &&
+                                             ((sizeof(KeyType) == 4) || (sizeof(KeyType) == 8)) &&
+                                             std::is_same<KeyComparator, std::less<KeyType>>::value;
+
+  // Whether InnerNode keeps a key tree. See class ElasticNode
+#ifdef USE_KEY_TREE
+  static constexpr bool KEY_TREE_LAYOUT =
+      std::is_trivially_copyable<KeyType>::value && std::is_trivially_destructible<KeyType>::value;
+#else
+  static constexpr bool KEY_TREE_LAYOUT = false;
+#endif
+
+  // Key tree search prefetches the slot this many times the current slot,
+  // whose descendants on the same level fit in one cache line
+  static constexpr uint64_t KEY_TREE_PREFETCH_STRIDE = std::max<uint64_t>(1, 64 / sizeof(KeyType));
+
+  // Whether keys are variable length keys whose bytes are stored in the
+  // memory of the node that holds them. See AllocationMeta::StoreKey()
+  static constexpr bool BYTE_KEY = std::is_same<KeyType, ByteKey>::value;
+
+  // Whether nodes strip the common prefix of their keys. See class ElasticNode
+  static constexpr bool STRIP_KEY_PREFIX = StripKeyPrefix;
+
+  static_assert(!STRIP_KEY_PREFIX || (BYTE_KEY && std::is_same<KeyComparator, std::less<KeyType>>::value &&
+                                      std::is_same<KeyEqualityChecker, std::equal_to<KeyType>>::value),
+                "Key prefixes could only be stripped from ByteKey compared as bytes.");
+
+  // A node strips the common prefix only if it has at least this many bytes,
+  // since the pointer to it is stored with the rest of each key
+  static constexpr uint32_t MIN_STRIPPED_PREFIX_SIZE = 2 * sizeof(const char *);
+
   /*
    * enum class NodeType - Bw-Tree node type
    */
@@ -591,6 +1591,7 @@ class BwTree : public BwTreeBase {
     LeafDeleteType = 10,
     LeafRemoveType = 11,
     LeafMergeType = 12,
+    LeafUpdateType = 13,
   };
 
   ///////////////////////////////////////////////////////////////////
@@ -1152,7 +2153,8 @@ class BwTree : public BwTreeBase {
   };
 
   /*
-   * class LeafDataNode - Holds LeafInsertNode and LeafDeleteNode's data
+   * class LeafDataNode - Holds LeafInsertNode, LeafDeleteNode and
+   *                      LeafUpdateNode's data
    *
    * This class is used in node consolidation to provide a uniform
    * interface for the log-structured merge process
@@ -1170,7 +2172,7 @@ class BwTree : public BwTreeBase {
                          std::pair<int, bool> p_index_pair, const KeyNodeIDPair *p_low_key_p,
                          const KeyNodeIDPair *p_high_key_p, int p_depth, int p_item_count)
         : DeltaNode{p_type, p_child_node_p, p_low_key_p, p_high_key_p, p_depth, p_item_count},
-          item{p_item},
+          item{ElasticNode<KeyValuePair>::StoreKey(p_low_key_p, p_item.first), p_item.second},
           index_pair{p_index_pair} {}
 
     /*
@@ -1222,6 +2224,35 @@ class BwTree : public BwTreeBase {
                        p_child_node_p->GetItemCount() - 1} {}
   };
 
+  /*
+   * class LeafUpdateNode - Replace the value of a record in a leaf node
+   *
+   * The item holds the key and the new value, and old_item holds the record
+   * being replaced. The index pair is inherited from the replaced record,
+   * such that on consolidation the new value takes the position of the old
+   * one. Item count does not change
+   */
+  class LeafUpdateNode : public LeafDataNode {
+   public:
+    // This is the item being replaced
+    KeyValuePair old_item;
+
+    /*
+     * Constructor
+     */
+    NO_ASAN LeafUpdateNode(const KeyType &p_update_key, const ValueType &p_old_value, const ValueType &p_new_value,
+                           const BaseNode *p_child_node_p, std::pair<int, bool> p_index_pair)
+        : LeafDataNode{std::make_pair(p_update_key, p_new_value),
+                       NodeType::LeafUpdateType,
+                       p_child_node_p,
+                       p_index_pair,
+                       &p_child_node_p->GetLowKeyPair(),
+                       &p_child_node_p->GetHighKeyPair(),
+                       p_child_node_p->GetDepth() + 1,
+                       p_child_node_p->GetItemCount()},
+          old_item{this->item.first, p_old_value} {}
+  };
+
   /*
    * class LeafSplitNode - Split node for leaf
    *
@@ -1257,7 +2288,8 @@ class BwTree : public BwTreeBase {
                     // know the item count of its sibling to decide how many
                     // items were removed by the split delta
                     p_child_node_p->GetItemCount() - p_split_node_p->GetItemCount()},
-          insert_item{p_insert_item} {}
+          insert_item{ElasticNode<KeyValuePair>::StoreKey(&p_child_node_p->GetLowKeyPair(), p_insert_item.first),
+                      p_insert_item.second} {}
   };
 
   /*
@@ -1319,7 +2351,8 @@ class BwTree : public BwTreeBase {
                     // For merge node the item count should be the
                     // sum of items inside both branches
                     p_child_node_p->GetItemCount() + p_right_merge_p->GetItemCount()},
-          delete_item{p_merge_key, p_deleted_node_id},
+          delete_item{ElasticNode<KeyValuePair>::StoreKey(&p_child_node_p->GetLowKeyPair(), p_merge_key),
+                      p_deleted_node_id},
           right_merge_p{p_right_merge_p} {}
   };
 
@@ -1352,7 +2385,7 @@ class BwTree : public BwTreeBase {
                           const KeyNodeIDPair *p_location, const KeyNodeIDPair *p_low_key_p,
                           const KeyNodeIDPair *p_high_key_p, int p_depth, int p_item_count)
         : DeltaNode{p_type, p_child_node_p, p_low_key_p, p_high_key_p, p_depth, p_item_count},
-          item{p_item},
+          item{ElasticNode<KeyNodeIDPair>::StoreKey(p_low_key_p, p_item.first), p_item.second},
           location{p_location} {}
   };
 
@@ -1384,7 +2417,8 @@ class BwTree : public BwTreeBase {
                         &p_child_node_p->GetHighKeyPair(),
                         p_child_node_p->GetDepth() + 1,
                         p_child_node_p->GetItemCount() + 1},
-          next_item{p_next_item} {}
+          next_item{ElasticNode<KeyNodeIDPair>::StoreKey(&p_child_node_p->GetLowKeyPair(), p_next_item.first),
+                    p_next_item.second} {}
   };
 
   /*
@@ -1434,8 +2468,10 @@ class BwTree : public BwTreeBase {
                         &p_child_node_p->GetHighKeyPair(),
                         p_child_node_p->GetDepth() + 1,
                         p_child_node_p->GetItemCount() - 1},
-          prev_item{p_prev_item},
-          next_item{p_next_item} {}
+          prev_item{ElasticNode<KeyNodeIDPair>::StoreKey(&p_child_node_p->GetLowKeyPair(), p_prev_item.first),
+                    p_prev_item.second},
+          next_item{ElasticNode<KeyNodeIDPair>::StoreKey(&p_child_node_p->GetLowKeyPair(), p_next_item.first),
+                    p_next_item.second} {}
   };
 
   /*
@@ -1463,7 +2499,8 @@ class BwTree : public BwTreeBase {
                     // For split node we need the physical pointer to the
                     // split sibling to compute item count
                     p_child_node_p->GetItemCount() - p_split_node_p->GetItemCount()},
-          insert_item{p_insert_item} {}
+          insert_item{ElasticNode<KeyNodeIDPair>::StoreKey(&p_child_node_p->GetLowKeyPair(), p_insert_item.first),
+                      p_insert_item.second} {}
   };
 
   /*
@@ -1510,7 +2547,8 @@ class BwTree : public BwTreeBase {
                     // For merge node the item count is the sum of its two
                     // branches
                     p_child_node_p->GetItemCount() + p_right_merge_p->GetItemCount()},
-          delete_item{p_merge_key, p_deleted_node_id},
+          delete_item{ElasticNode<KeyNodeIDPair>::StoreKey(&p_child_node_p->GetLowKeyPair(), p_merge_key),
+                      p_deleted_node_id},
           right_merge_p{p_right_merge_p} {}
   };
 
@@ -1576,6 +2614,7 @@ class BwTree : public BwTreeBase {
 
     LeafInsertNode leaf_insert_node;
     LeafDeleteNode leaf_delete_node;
+    LeafUpdateNode leaf_update_node;
     LeafSplitNode leaf_split_node;
     LeafMergeNode leaf_merge_node;
     LeafRemoveNode leaf_remove_node;
@@ -1599,12 +2638,16 @@ class BwTree : public BwTreeBase {
     // This forms a linked list which needs to be traversed in order to
     // free chunks of memory
     std::atomic<AllocationMeta *> next;
+    // The number of bytes of the memory block starting at this object, which
+    // is passed to FreeNodeMemory()
+    const size_t size;
 
    public:
     /*
      * Constructor
      */
-    NO_ASAN AllocationMeta(char *p_tail, char *p_limit) : tail{p_tail}, limit{p_limit}, next{nullptr} {}
+    NO_ASAN AllocationMeta(char *p_tail, char *p_limit, size_t p_size)
+        : tail{p_tail}, limit{p_limit}, next{nullptr}, size{p_size} {}
 
     /*
      * TryAllocate() - Try to allocate from this chunk
@@ -1617,8 +2660,10 @@ class BwTree : public BwTreeBase {
      */
     NO_ASAN void *TryAllocate(size_t size) {
       // This acts as a guard to prevent allocating from a chunk which has
-      // already underflown to avoid integer (64 bit pointer) underflow
-      if (tail.load() < limit) {
+      // already underflown to avoid integer (64 bit pointer) underflow. It
+      // also keeps a large key from using up the rest of the chunk when it
+      // does not fit
+      if (tail.load() < limit + size) {
         return nullptr;
       }
 
@@ -1643,10 +2688,11 @@ class BwTree : public BwTreeBase {
      * with expected value nullptr, such that it should never succeed twice
      * even under contention
      *
-     * Whether or not this has succeded, always return the pointer to the next
-     * chunk such that the caller could retry on next chunk
+     * The new chunk has CHUNK_SIZE() bytes, or more if size does not fit in
+     * that. Whether or not this has succeded, always return the pointer to
+     * the next chunk such that the caller could retry on next chunk
      */
-    NO_ASAN AllocationMeta *GrowChunk() {
+    NO_ASAN AllocationMeta *GrowChunk(size_t size) {
       // If we know there is a next chunk just return it to avoid
       // having too many failed CAS instruction
       AllocationMeta *meta_p = next.load();
@@ -1654,7 +2700,8 @@ class BwTree : public BwTreeBase {
         return meta_p;
       }
 
-      auto *new_chunk = new char[CHUNK_SIZE()];
+      size_t chunk_size = std::max(CHUNK_SIZE(), sizeof(AllocationMeta) + size);
+      auto *new_chunk = reinterpret_cast<char *>(AllocateNodeMemory(chunk_size));
       AllocationMeta *expected = nullptr;
 
       // Prepare the new chunk's metadata field
@@ -1663,8 +2710,9 @@ class BwTree : public BwTreeBase {
       // We initialize the allocation meta at lower end of the address
       // and let tail points to the first byte after this chunk, and the limit
       // is the first byte after AllocationMeta
-      new (new_meta_base) AllocationMeta{new_chunk + CHUNK_SIZE(),             // tail
-                                         new_chunk + sizeof(AllocationMeta)};  // limit
+      new (new_meta_base) AllocationMeta{new_chunk + chunk_size,              // tail
+                                         new_chunk + sizeof(AllocationMeta),  // limit
+                                         chunk_size};
 
       // Always CAS with nullptr such that we will never install/replace
       // a chunk that has already been installed here
@@ -1673,10 +2721,10 @@ class BwTree : public BwTreeBase {
         return new_meta_base;
       }
 
-      // Note that here we call destructor manually and then delete the char[]
+      // Note that here we call destructor manually and then free the memory
       // to complete the entire sequence which should be done by the compiler
       new_meta_base->~AllocationMeta();
-      delete[] new_chunk;
+      FreeNodeMemory(new_chunk, chunk_size);
 
       // If CAS fails this will be loaded with the real value such that we have
       // free access to the next chunk
@@ -1705,7 +2753,7 @@ class BwTree : public BwTreeBase {
           // This will surely traverse the entire linked list
           // but since the linked list itself is supposed to be relatively short
           // even under contention, we do not worry about it right now
-          meta_p = meta_p->GrowChunk();
+          meta_p = meta_p->GrowChunk(size);
           NOISEPAGE_ASSERT(meta_p != nullptr, "meta_p is nullptr.");
         } else {
           return p;
@@ -1716,12 +2764,110 @@ class BwTree : public BwTreeBase {
       return nullptr;
     }
 
+    /*
+     * Contains() - Returns whether the address is inside one of the chunks
+     *
+     * Note that this must be called at the header node of the chain
+     */
+    NO_ASAN bool Contains(const char *address) const {
+      for (const AllocationMeta *meta_p = this; meta_p != nullptr; meta_p = meta_p->next.load()) {
+        const auto *base = reinterpret_cast<const char *>(meta_p);
+        if ((address >= base) && (address < base + meta_p->size)) {
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    /*
+     * GetAllocatedSize() - Returns the number of bytes allocated from the
+     *                      chunks
+     *
+     * Note that this must be called at the header node of the chain, whose
+     * chunk starts with the node
+     */
+    NO_ASAN size_t GetAllocatedSize() const {
+      size_t allocated_size = 0UL;
+      for (const AllocationMeta *meta_p = this; meta_p != nullptr; meta_p = meta_p->next.load()) {
+        const char *start = reinterpret_cast<const char *>(meta_p) + ((meta_p == this) ? CHUNK_SIZE() : meta_p->size);
+        allocated_size += start - std::max<const char *>(meta_p->tail.load(), meta_p->limit);
+      }
+
+      return allocated_size;
+    }
+
+    /*
+     * CopyKey() - Returns the key with its bytes copied into the chunks
+     *
+     * ByteKey only refers to bytes owned by someone else, so a key stored in
+     * a node or a delta node has its bytes copied into the chunks of the node,
+     * and they are freed together with the node by Destroy(). Other keys are
+     * returned as they are
+     *
+     * The allocation is rounded up such that delta nodes allocated after it
+     * are still aligned. A stripped key is copied as a key that is not
+     * stripped
+     */
+    NO_ASAN decltype(auto) CopyKey(const KeyType &key) {
+      if constexpr (BYTE_KEY) {
+        if (key.GetSize() == 0) {
+          return KeyType{key};
+        }
+
+        size_t size = (key.GetSize() + alignof(DeltaNodeUnion) - 1) & ~(alignof(DeltaNodeUnion) - 1);
+        auto *data_p = reinterpret_cast<char *>(Allocate(size));
+        key.CopyTo(data_p);
+
+        return KeyType{data_p, key.GetSize()};
+      } else {
+        return (key);
+      }
+    }
+
+    /*
+     * StripKey() - Returns the key stripped of its first head_size bytes,
+     *              whose other bytes are copied into the chunks
+     *
+     * The first head_size bytes of the key must be the same as the bytes at
+     * head_p, which are stored in the chunks. The pointer to them is stored
+     * right before the copied bytes (see class ByteKey)
+     */
+    NO_ASAN KeyType StripKey(const KeyType &key, const char *head_p, uint32_t head_size) {
+      size_t size = (sizeof(head_p) + key.GetSize() - head_size + alignof(DeltaNodeUnion) - 1) &
+                    ~(alignof(DeltaNodeUnion) - 1);
+      auto *data_p = reinterpret_cast<char *>(Allocate(size));
+      std::memcpy(data_p, &head_p, sizeof(head_p));
+      key.CopyTo(data_p + sizeof(head_p), head_size);
+
+      return KeyType{head_p, head_size, data_p + sizeof(head_p), key.GetSize()};
+    }
+
+    /*
+     * StoreKey() - Same as CopyKey(), except that bytes already in the
+     *              chunks are not copied again
+     *
+     * This is used for delta nodes, whose key usually comes from the delta
+     * chain they are appended to (e.g. the item being deleted). The head of a
+     * stripped key is the low key of the node that stripped it, so it is in
+     * the chunks as well
+     */
+    NO_ASAN decltype(auto) StoreKey(const KeyType &key) {
+      if constexpr (BYTE_KEY) {
+        if (Contains(key.GetData())) {
+          return KeyType{key};
+        }
+      }
+
+      return CopyKey(key);
+    }
+
     /*
      * Destroy() - Frees all chunks in the linked list
      *
      * Note that this function must be called for every metadata object
-     * in the linked list, and we could should use operator delete since it
-     * is allocated through operator new
+     * in the linked list, and we should use FreeNodeMemory() since it is
+     * allocated through AllocateNodeMemory()
      *
      * This function is not thread-safe and should only be called in a single
      * thread environment such as GC
@@ -1734,11 +2880,12 @@ class BwTree : public BwTreeBase {
         AllocationMeta *next_p = meta_p->next.load();
 
         // 1. Manually call destructor
-        // 2. Delete it as a char[]
+        // 2. Free it as a block of its size
         // Note that we know the base of meta_p is always the address
-        // returned by operator new[]
+        // returned by AllocateNodeMemory()
+        size_t size = meta_p->size;
         meta_p->~AllocationMeta();
-        delete[] reinterpret_cast<char *>(meta_p);
+        FreeNodeMemory(meta_p, size);
 
         meta_p = next_p;
       }
@@ -1752,9 +2899,33 @@ class BwTree : public BwTreeBase {
    * Since for InnerNode and LeafNode, the number of elements is not a compile
    * time known constant. However, for efficient tree traversal we must inline
    * all elements to reduce cache misses with workload that's less predictable
+   *
+   * With KEY_TREE_LAYOUT, nodes of KeyNodeIDPair also keep a copy of the
+   * keys except the first one after the elements in Eytzinger order (the key
+   * tree) with the element index of each tree slot. It is built when
+   * PushBack() fills the last element, and is only valid for a full node.
+   * Elements of such nodes should not be modified in any other way
+   *
+   * With STRIP_KEY_PREFIX, every key in [low key, high key) starts with the
+   * common prefix of the low key and the high key. If it has at least
+   * MIN_STRIPPED_PREFIX_SIZE bytes then PushBack() strips it from the keys
+   * of elements, such that it is only stored once as the head of the low
+   * key (see class ByteKey)
+   *
+   * Nodes of KeyNodeIDPair also keep the number of items under each element
+   * at the end (the subtree counts). They are filled by the tree after the
+   * elements are pushed (see SetSubtreeItemCounts()), and unlike elements
+   * they are refreshed on the installed node later, so they are atomic
    */
   template <typename ElementType>
   class ElasticNode : public BaseNode {
+   public:
+    // Whether this node type has a key tree
+    static constexpr bool KEY_TREE = KEY_TREE_LAYOUT && std::is_same<ElementType, KeyNodeIDPair>::value;
+
+    // Whether this node type has subtree counts
+    static constexpr bool SUBTREE_COUNT = std::is_same<ElementType, KeyNodeIDPair>::value;
+
    private:
     // These two are the low key and high key of the node respectively
     // since we could not add it in the inherited class (will clash with
@@ -1767,6 +2938,18 @@ class BwTree : public BwTreeBase {
     // everytime
     ElementType *end;
 
+    // This is the key tree after the elastic array, which has the same
+    // capacity. It is nullptr if the node type has no key tree
+    KeyType *key_start;
+
+    // This is the element indices of key tree slots after the key tree. It
+    // is nullptr if the node type has no key tree
+    int *key_index_start;
+
+    // This is the number of leading bytes stripped from keys of elements,
+    // which is 0 if they are not stripped
+    uint32_t key_head_size;
+
     // This is the starting point
     ElementType start[0];
 
@@ -1776,23 +2959,74 @@ class BwTree : public BwTreeBase {
      *
      * Note that this constructor uses the low key and high key stored as
      * members to initialize the NodeMetadata object in class BaseNode
+     *
+     * The node must be allocated by Get(), since key bytes of the low key,
+     * the high key and the elements are copied into its chunks (see
+     * AllocationMeta::CopyKey())
      */
-    NO_ASAN ElasticNode(NodeType p_type, int p_depth, int p_item_count, const KeyNodeIDPair &p_low_key,
+    NO_ASAN ElasticNode(int p_size, NodeType p_type, int p_depth, int p_item_count, const KeyNodeIDPair &p_low_key,
                         const KeyNodeIDPair &p_high_key)
         : BaseNode{p_type, &low_key, &high_key, p_depth, p_item_count},
-          low_key{p_low_key},
-          high_key{p_high_key},
-          end{start} {}
+          low_key{GetAllocationHeader(this)->CopyKey(p_low_key.first), p_low_key.second},
+          high_key{GetAllocationHeader(this)->CopyKey(p_high_key.first), p_high_key.second},
+          end{start},
+          key_start{KEY_TREE ? reinterpret_cast<KeyType *>(start + p_size) : nullptr},
+          key_index_start{KEY_TREE ? GetKeyIndexStart(reinterpret_cast<KeyType *>(start + p_size) + p_size)
+                                   : nullptr},
+          key_head_size{GetStrippedSize(p_low_key, p_high_key)} {
+      if constexpr (SUBTREE_COUNT) {
+        for (int i = 0; i < p_size; i++) {
+          new (SubtreeCountBegin() + i) std::atomic<uint64_t>{0};
+        }
+      }
+    }
 
     /*
-     * Copy() - Copy constructs another instance
+     * GetStrippedSize() - Returns the number of leading bytes stripped from
+     *                     keys of a node with the low key and the high key
      */
-    NO_ASAN static ElasticNode *Copy(const ElasticNode &other) {
-      ElasticNode *node_p = ElasticNode::Get(other.GetItemCount(), other.GetType(), other.GetDepth(),
+    NO_ASAN static uint32_t GetStrippedSize(const KeyNodeIDPair &p_low_key, const KeyNodeIDPair &p_high_key) {
+      if constexpr (STRIP_KEY_PREFIX) {
+        // Keys below a +Inf high key may start with any bytes
+        if (p_high_key.second != INVALID_NODE_ID) {
+          uint32_t common_size = KeyType::CommonPrefixSize(p_low_key.first, p_high_key.first);
+          if (common_size >= MIN_STRIPPED_PREFIX_SIZE) {
+            return common_size;
+          }
+        }
+      } else {
+        (void)p_low_key;
+        (void)p_high_key;
+      }
+
+      return 0U;
+    }
+
+    /*
+     * GetKeyIndexStart() - Returns the first int aligned address at or after
+     *                      the end of the key tree
+     */
+    NO_ASAN static int *GetKeyIndexStart(KeyType *key_tree_end_p) {
+      auto address = reinterpret_cast<uintptr_t>(key_tree_end_p);
+
+      return reinterpret_cast<int *>((address + alignof(int) - 1) & ~(alignof(int) - 1));
+    }
+
+    /*
+     * Copy() - Copy constructs another instance
+     */
+    NO_ASAN static ElasticNode *Copy(const ElasticNode &other) {
+      ElasticNode *node_p = ElasticNode::Get(other.GetItemCount(), other.GetType(), other.GetDepth(),
                                              other.GetItemCount(), other.GetLowKeyPair(), other.GetHighKeyPair());
 
       node_p->PushBack(other.Begin(), other.End());
 
+      if constexpr (SUBTREE_COUNT) {
+        for (int i = 0; i < other.GetItemCount(); i++) {
+          node_p->SubtreeCountBegin()[i].store(other.SubtreeCountBegin()[i].load());
+        }
+      }
+
       return node_p;
     }
 
@@ -1857,6 +3091,57 @@ class BwTree : public BwTreeBase {
 
     NO_ASAN inline const ElementType *REnd() const { return start - 1; }
 
+    /*
+     * KeyTreeBegin() - Returns the begin of the key tree
+     *
+     * Slot 0 is not used, and the root of the tree is slot 1. The children
+     * of slot k are slot 2k and 2k + 1
+     */
+    NO_ASAN inline const KeyType *KeyTreeBegin() const { return key_start; }
+
+    /*
+     * KeyTreeIndexBegin() - Returns the element indices of key tree slots
+     *
+     * The element of slot k is Begin() + KeyTreeIndexBegin()[k]. Slot 0 maps
+     * to End(), which is the result if every key is <= the search key
+     */
+    NO_ASAN inline const int *KeyTreeIndexBegin() const { return key_index_start; }
+
+    /*
+     * SubtreeCountBegin() - Returns the subtree counts of elements
+     *
+     * Slot i is the number of items under element i, which covers keys from
+     * its separator up to the next separator on this node. It is nullptr if
+     * the node type has no subtree counts
+     *
+     * Since counts could be refreshed on an installed node, this is
+     * non-const even for a const node
+     */
+    NO_ASAN inline std::atomic<uint64_t> *SubtreeCountBegin() const {
+      if constexpr (SUBTREE_COUNT) {
+        // The capacity of a node is its item count (see Get())
+        const void *array_end_p = start + this->GetItemCount();
+        if constexpr (KEY_TREE) {
+          array_end_p = key_index_start + this->GetItemCount();
+        }
+
+        auto address = reinterpret_cast<uintptr_t>(array_end_p);
+
+        return reinterpret_cast<std::atomic<uint64_t> *>((address + alignof(uint64_t) - 1) &
+                                                         ~(alignof(uint64_t) - 1));
+      } else {
+        return nullptr;
+      }
+    }
+
+    /*
+     * GetKeyHeadSize() - Returns the number of leading bytes stripped from
+     *                    keys of elements
+     *
+     * The stripped bytes are the head of the low key (see class ByteKey)
+     */
+    NO_ASAN inline uint32_t GetKeyHeadSize() const { return key_head_size; }
+
     /*
      * GetSize() - Returns the size of the embedded list
      *
@@ -1874,12 +3159,66 @@ class BwTree : public BwTreeBase {
      */
     NO_ASAN inline void PushBack(const ElementType &element) {
       // Placement new + copy constructor using end pointer
-      new (end) ElementType{element};
+      if constexpr (BYTE_KEY) {
+        AllocationMeta *meta_p = GetAllocationHeader(this);
+
+        if (STRIP_KEY_PREFIX && (key_head_size > 0)) {
+          NOISEPAGE_ASSERT(KeyType::CommonPrefixSize(element.first, low_key.first) >= key_head_size,
+                           "Key is not within the low key and the high key.");
+          new (end) ElementType{meta_p->StripKey(element.first, low_key.first.GetData(), key_head_size),
+                                element.second};
+        } else {
+          new (end) ElementType{meta_p->CopyKey(element.first), element.second};
+        }
+      } else {
+        new (end) ElementType{element};
+      }
 
       // Move it pointing to the enxt available slot, if not reached the end
       end++;
+
+      if constexpr (KEY_TREE) {
+        if (GetSize() == this->GetItemCount()) {
+          BuildKeyTree();
+        }
+      }
+    }
+
+   private:
+    /*
+     * BuildKeyTree() - Copies keys from the elements to the key tree
+     *
+     * The first key is not in the tree since it is the low key of the inner
+     * node, which is not used for search
+     */
+    NO_ASAN void BuildKeyTree() {
+      auto *key_tree_p = const_cast<KeyType *>(KeyTreeBegin());
+      auto *index_p = const_cast<int *>(KeyTreeIndexBegin());
+
+      index_p[0] = GetSize();
+      FillKeyTree(key_tree_p, index_p, 1, 1);
+    }
+
+    /*
+     * FillKeyTree() - Fills the subtree of a slot with keys from an element
+     *                 index in order, and returns the next element index
+     */
+    NO_ASAN int FillKeyTree(KeyType *key_tree_p, int *index_p, int slot, int index) {
+      if (slot < GetSize()) {
+        index = FillKeyTree(key_tree_p, index_p, 2 * slot, index);
+
+        new (key_tree_p + slot) KeyType{start[index].first};
+        index_p[slot] = index;
+        index++;
+
+        index = FillKeyTree(key_tree_p, index_p, 2 * slot + 1, index);
+      }
+
+      return index;
     }
 
+   public:
+
     /*
      * PushBack() - Push back a series of elements
      *
@@ -1896,15 +3235,39 @@ class BwTree : public BwTreeBase {
     }
 
    public:
+    /*
+     * GetArraySize() - Returns the number of bytes after the node header for
+     *                  a node of a certain size
+     *
+     * This includes the elastic array, the key tree and the subtree counts
+     */
+    NO_ASAN static constexpr size_t GetArraySize(int size) {
+      size_t array_size = size * sizeof(ElementType);
+
+      // The key tree has the same number of slots, plus padding before
+      // element indices
+      if constexpr (KEY_TREE) {
+        array_size += size * sizeof(KeyType) + alignof(int) + size * sizeof(int);
+      }
+
+      // Subtree counts have the same number of slots, plus padding before
+      // them
+      if constexpr (SUBTREE_COUNT) {
+        array_size += alignof(uint64_t) + size * sizeof(std::atomic<uint64_t>);
+      }
+
+      return array_size;
+    }
+
     /*
      * Get() - Static helper function that constructs a elastic node of
      *         a certain size
      *
      * Note that since operator new is only capable of allocating a fixed
-     * sized structure, we need to call malloc() directly to deal with variable
-     * lengthed node. However, after malloc() returns we use placement operator
-     * new to initialize it, such that the node could be freed using operator
-     * delete later on
+     * sized structure, we need to allocate raw memory directly to deal with
+     * variable lengthed node (see AllocateNodeMemory()). After that we use
+     * placement operator new to initialize it, and the memory is freed by
+     * Destroy() later on
      */
     NO_ASAN inline static ElasticNode *Get(int size,  // Number of elements
                                            NodeType p_type, int p_depth,
@@ -1917,25 +3280,26 @@ class BwTree : public BwTreeBase {
       // Allocte memory for
       //   1. AllocationMeta (chunk)
       //   2. node meta
-      //   3. ElementType array
-      // basic template + ElementType element size * (node size) + CHUNK_SIZE()
+      //   3. ElementType array (and key tree)
+      // basic template + GetArraySize(node size) + CHUNK_SIZE()
       // Note: do not make it constant since it is going to be modified
       // after being returned
-      auto *alloc_base = new char[sizeof(ElasticNode) + size * sizeof(ElementType) + AllocationMeta::CHUNK_SIZE()];
+      size_t alloc_size = sizeof(ElasticNode) + GetArraySize(size) + AllocationMeta::CHUNK_SIZE();
+      auto *alloc_base = reinterpret_cast<char *>(AllocateNodeMemory(alloc_size));
       NOISEPAGE_ASSERT(alloc_base != nullptr, "Allocation failed.");
 
       // Initialize the AllocationMeta - tail points to the first byte inside
       // class ElasticNode; limit points to the first byte after class
       // AllocationMeta
       new (reinterpret_cast<AllocationMeta *>(alloc_base))
-          AllocationMeta{alloc_base + AllocationMeta::CHUNK_SIZE(), alloc_base + sizeof(AllocationMeta)};
+          AllocationMeta{alloc_base + AllocationMeta::CHUNK_SIZE(), alloc_base + sizeof(AllocationMeta), alloc_size};
 
       // The first CHUNK_SIZE() byte is used by class AllocationMeta
       // and chunk data
       auto *node_p = reinterpret_cast<ElasticNode *>(alloc_base + AllocationMeta::CHUNK_SIZE());
 
       // Call placement new to initialize all that could be initialized
-      new (node_p) ElasticNode{p_type, p_depth, p_item_count, p_low_key, p_high_key};
+      new (node_p) ElasticNode{size, p_type, p_depth, p_item_count, p_low_key, p_high_key};
 
       return node_p;
     }
@@ -1987,6 +3351,17 @@ class BwTree : public BwTreeBase {
       return p;
     }
 
+    /*
+     * StoreKey() - Returns the key to be stored in a delta node on the chain
+     *              of the base node with the low key
+     *
+     * This is the same as InlineAllocate() for key bytes. See
+     * AllocationMeta::StoreKey()
+     */
+    NO_ASAN static decltype(auto) StoreKey(const KeyNodeIDPair *low_key_p, const KeyType &key) {
+      return GetAllocationHeader(GetNodeHeader(low_key_p))->StoreKey(key);
+    }
+
     /*
      * At() - Access element with bounds checking under debug mode
      */
@@ -2066,6 +3441,11 @@ class BwTree : public BwTreeBase {
       NOISEPAGE_ASSERT(inner_node_p->GetSize() == sibling_size, "Copied number of elements must match.");
       NOISEPAGE_ASSERT(inner_node_p->GetSize() == inner_node_p->GetItemCount(), "Copied number of elements must match.");
 
+      const std::atomic<uint64_t> *count_p = this->SubtreeCountBegin() + split_item_index;
+      for (int i = 0; i < sibling_size; i++) {
+        inner_node_p->SubtreeCountBegin()[i].store(count_p[i].load());
+      }
+
       return inner_node_p;
     }
   };
@@ -2075,6 +3455,10 @@ class BwTree : public BwTreeBase {
    *
    * There are 5 types of delta nodes that could be appended
    * to a leaf node. 3 of them are SMOs, and 2 of them are data operation
+   *
+   * Each value is stored as a KeyValuePair even if its key is repeated, so
+   * a key with n values takes n copies of the key. The values of a key form
+   * a run of elements that is found by binary search (see KeyRunEnd())
    */
   class LeafNode : public ElasticNode<KeyValuePair> {
    public:
@@ -2098,9 +3482,10 @@ class BwTree : public BwTreeBase {
      * make the size difference as small as possible)
      *
      * This function works by first finding the key on the exact central
-     * position, after which it scans forward to find a KeyValuePair
-     * with a different key. If this fails then it scans backwards to find
-     * a KeyValuePair with a different key.
+     * position, after which it finds the start of the run of that key. If
+     * this fails then it finds the end of the run. Both are binary searches
+     * since a hot key in a secondary index could have a very long run, and
+     * a node that could not be split is tried again on every traversal
      *
      * NOTE: If both split points would make an uneven division with one of
      * the node size below the merge threshold, then we do not split,
@@ -2112,40 +3497,23 @@ class BwTree : public BwTreeBase {
       NOISEPAGE_ASSERT(central_index > 1, "Index out of range.");
 
       // This will used as upper_bound and lower_bound key
-      const KeyValuePair &central_kvp = this->At(central_index);
-
-      // Move it to the element before data_list
-      auto it = this->Begin() + central_index - 1;
-
-      // If iterator has reached the begin then we know there could not
-      // be any split points
-      while ((it != this->Begin()) && t->KeyCmpEqual(it->first, central_kvp.first)) {
-        it--;
-      }
+      const KeyType &central_key = this->At(central_index).first;
 
-      // This is the real split point
-      it++;
-
-      // This size is exactly the index of the split point
-      int left_sibling_size = std::distance(this->Begin(), it);
+      // This is the first element of the central key, which is the real
+      // split point and its index is the size of the left sibling
+      const KeyValuePair *run_start_p = t->KeyLowerBound(this->Begin(), this->Begin() + central_index, central_key);
+      int left_sibling_size = std::distance(this->Begin(), run_start_p);
 
       if (left_sibling_size > static_cast<int>(t->GetLeafNodeSizeLowerThreshold())) {
         return left_sibling_size;
       }
 
-      // Move it to the element after data_list
-      it = this->Begin() + central_index + 1;
-
-      // If iterator has reached the end then we know there could not
-      // be any split points
-      while ((it != this->End()) && t->KeyCmpEqual(it->first, central_kvp.first)) {
-        it++;
-      }
-
-      int right_sibling_size = std::distance(it, this->End());
+      // This is the first element after the central key
+      const KeyValuePair *run_end_p = t->KeyUpperBound(this->Begin() + central_index + 1, this->End(), central_key);
+      int right_sibling_size = std::distance(run_end_p, this->End());
 
       if (right_sibling_size > static_cast<int>(t->GetLeafNodeSizeLowerThreshold())) {
-        return std::distance(this->Begin(), it);
+        return std::distance(this->Begin(), run_end_p);
       }
 
       return -1;
@@ -2228,6 +3596,32 @@ class BwTree : public BwTreeBase {
     }
   };
 
+  /*
+   * class KeyValuePairBuffer - Growable array of key-value pairs that has the
+   *                            same PushBack() interface as LeafNode
+   *
+   * This is used to replay a leaf delta chain without allocating a LeafNode
+   * of the exact size. The capacity is kept after Clear() so that the buffer
+   * could be reused
+   */
+  class KeyValuePairBuffer {
+   public:
+    NO_ASAN inline void PushBack(const KeyValuePair &element) { data.push_back(element); }
+
+    NO_ASAN inline void PushBack(const KeyValuePair *copy_start_p, const KeyValuePair *copy_end_p) {
+      data.insert(data.end(), copy_start_p, copy_end_p);
+    }
+
+    NO_ASAN inline const KeyValuePair *Begin() const { return data.data(); }
+
+    NO_ASAN inline const KeyValuePair *End() const { return data.data() + data.size(); }
+
+    NO_ASAN inline void Clear() { data.clear(); }
+
+   private:
+    std::vector<KeyValuePair> data;
+  };
+
   ////////////////////////////////////////////////////////////////////
   // Interface Method Implementation
   ////////////////////////////////////////////////////////////////////
@@ -2270,11 +3664,22 @@ class BwTree : public BwTreeBase {
         key_value_pair_hash_obj{this},
 
         // NodeID counter
+#ifdef USE_NODE_ID_CLUSTER
+        next_unused_node_id{INVALID_NODE_ID},
+#else
         next_unused_node_id{1},
+#endif
+        latest_cluster_node_id{INVALID_NODE_ID, INVALID_NODE_ID},
 
-        // Initialize free NodeID stack
-        node_id_list_lock{},
-        node_id_list{},
+        // Initialize free NodeID stacks
+        free_node_id_batch_stack{},
+        empty_node_id_batch_stack{},
+        node_id_batch_list_p{nullptr},
+        unregistered_node_id_batch_p{nullptr},
+
+        // Initialize garbage node pools
+        free_garbage_node_stack{},
+        garbage_node_slab_list_p{nullptr},
 
         // Statistical information
         insert_op_count{0},
@@ -2316,6 +3721,9 @@ class BwTree : public BwTreeBase {
     INDEX_LOG_TRACE("Next node ID at exit: %" PRIu64 "", next_unused_node_id.load());
     INDEX_LOG_TRACE("Destructor: Free tree nodes");
 
+    // The cleaner thread must not sweep GC slots while they are cleared
+    epoch_manager.StopThread();
+
     // Clear all garbage nodes awaiting cleaning
     // First of all it should set all last active epoch counter to -1
     ClearThreadLocalGarbage();
@@ -2341,8 +3749,9 @@ class BwTree : public BwTreeBase {
 
     for (size_t i = 0; i < GetThreadNum(); i++) {
       // Here all epoch counters have been set to 0xFFFFFFFFFFFFFFFF
-      // so GC should always succeed
-      PerformGC(i);
+      // and there is no thread in a shared epoch, so we free all garbage
+      // without computing the minimum epoch
+      FreeThreadLocalGarbage(i, QUIESCENT_EPOCH);
 
       // This will collect all nodes since we have adjusted the current thread
       // GC ID
@@ -2356,7 +3765,10 @@ class BwTree : public BwTreeBase {
    *                       thread local variables
    *
    * This function is majorly used for debugging pruposes. The argument is
-   * the new number of threads we want to support here for doing experiments
+   * the new number of threads we want to support here for doing experiments.
+   * Slots are grown on demand anyway, so this is not needed for new threads
+   *
+   * NOTE: This function only works in a single-threaded environment
    */
   NO_ASAN void UpdateThreadLocal(size_t p_thread_num) {
     INDEX_LOG_TRACE("Updating thread-local array to length %lu......", p_thread_num);
@@ -2364,6 +3776,7 @@ class BwTree : public BwTreeBase {
     // 1. Frees all pending memory chunks
     // 2. Frees the thread local array
     ClearThreadLocalGarbage();
+    ReturnThreadLocalNodeIDBatches();
     DestroyThreadLocal();
 
     SetThreadNum(p_thread_num);
@@ -2388,7 +3801,7 @@ class BwTree : public BwTreeBase {
       return 0UL;
     }
 
-    mapping_table[node_id] = nullptr;
+    GetMappingTableEntry(node_id) = nullptr;
 
     return FreeNodeByPointer(node_p);
   }
@@ -2404,17 +3817,134 @@ class BwTree : public BwTreeBase {
    * this is necessary for destroying the tree since we want to avoid deleting
    * a removed node in InnerNode
    *
-   * NOTE: This function only works in a single-threaded environment such
+   * The NodeID goes to the batch of the current thread, which is shared
+   * once it is full (see GetNextNodeID())
+   *
+   * NOTE: Threads without a GC slot in this instance share one batch, so
+   * this function only works for them in a single-threaded environment such
    * as epoch manager and destructor
    *
-   * DO NOT call this in worker thread!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+   * DO NOT call this in unregistered worker thread!!!!!!!!!!!!!!!!!!!!!!!!!!
    */
   NO_ASAN inline void InvalidateNodeID(NodeID node_id) {
-    node_id_list_lock.lock();
-    mapping_table[node_id] = nullptr;
-    node_id_list.push_back(node_id);
-    // free_node_id_list.SingleThreadPush(node_id);
-    node_id_list_lock.unlock();
+    GetMappingTableEntry(node_id) = nullptr;
+
+    GCMetaData *metadata_p = GetRegisteredGCMetaData();
+    NodeIDBatch **batch_pp = (metadata_p != nullptr) ? &metadata_p->node_id_batch_p : &unregistered_node_id_batch_p;
+
+    if (*batch_pp == nullptr) {
+      *batch_pp = AllocateNodeIDBatch();
+    }
+
+    NodeIDBatch *batch_p = *batch_pp;
+    batch_p->node_id_list[batch_p->size++] = node_id;
+
+    if (batch_p->size == NODE_ID_BATCH_SIZE) {
+      free_node_id_batch_stack.Push(batch_p);
+      *batch_pp = nullptr;
+    }
+  }
+
+  /*
+   * AllocateNodeIDBatch() - Returns an empty batch, reusing one if possible
+   *
+   * Batches are never freed before the tree is destroyed since a concurrent
+   * AtomicLinkedStack::Pop() could still read them (see FreeNodeIDBatches())
+   */
+  NO_ASAN NodeIDBatch *AllocateNodeIDBatch() {
+    NodeIDBatch *batch_p = empty_node_id_batch_stack.Pop();
+    if (batch_p != nullptr) {
+      return batch_p;
+    }
+
+    batch_p = new NodeIDBatch{};
+
+    NodeIDBatch *list_head_p = node_id_batch_list_p.load();
+    do {
+      batch_p->list_next_p = list_head_p;
+    } while (!node_id_batch_list_p.compare_exchange_weak(list_head_p, batch_p));
+
+    return batch_p;
+  }
+
+  /*
+   * ReturnThreadLocalNodeIDBatches() - Moves batches of all threads to the
+   *                                    shared stacks
+   *
+   * NOTE: This function only works in a single-threaded environment
+   */
+  NO_ASAN void ReturnThreadLocalNodeIDBatches() {
+    for (size_t i = 0; i < GetThreadNum(); i++) {
+      ReturnNodeIDBatch(GetGCMetaData(i));
+    }
+  }
+
+  /*
+   * ReturnNodeIDBatch() - Moves the batch of a GC slot to the shared stacks
+   *
+   * This must be called by the owner of the slot, or while no thread owns it
+   */
+  NO_ASAN void ReturnNodeIDBatch(GCMetaData *metadata_p) {
+    NodeIDBatch *batch_p = metadata_p->node_id_batch_p;
+    if (batch_p == nullptr) {
+      return;
+    }
+
+    if (batch_p->size > 0) {
+      free_node_id_batch_stack.Push(batch_p);
+    } else {
+      empty_node_id_batch_stack.Push(batch_p);
+    }
+
+    metadata_p->node_id_batch_p = nullptr;
+  }
+
+  /*
+   * SweepReleasedGCSlots() - Hands off the garbage and NodeIDs left in the
+   *                          slots of GC IDs released by exited threads
+   *
+   * Garbage nodes go to the current shared epoch node, which is freed after
+   * all threads that could see them have left (see ClearEpoch()), and the
+   * NodeID batch goes to the shared stacks. Otherwise they would stay in
+   * the slot until another thread claims the ID and uses this instance
+   */
+  NO_ASAN void SweepReleasedGCSlots() {
+    const size_t slot_num = std::min(GetGCIDHighWater(), GetThreadNum());
+
+    for (size_t i = 0; i < slot_num; i++) {
+      if (!BeginGCSlotSweep(static_cast<int>(i))) {
+        continue;
+      }
+
+      GCMetaData *metadata_p = GetGCMetaData(i);
+      if (metadata_p->head_p != nullptr) {
+        epoch_manager.AddSharedGarbageChain(metadata_p->head_p, metadata_p->last_p);
+
+        metadata_p->head_p = nullptr;
+        metadata_p->last_p = nullptr;
+        metadata_p->node_count = 0U;
+        metadata_p->last_gc_epoch = QUIESCENT_EPOCH;
+      }
+
+      ReturnNodeIDBatch(metadata_p);
+
+      EndGCSlotSweep(static_cast<int>(i));
+    }
+  }
+
+  /*
+   * FreeNodeIDBatches() - Frees all batches of NodeIDs
+   *
+   * NOTE: This function only works in a single-threaded environment
+   */
+  void FreeNodeIDBatches() {
+    NodeIDBatch *batch_p = node_id_batch_list_p.exchange(nullptr);
+
+    while (batch_p != nullptr) {
+      NodeIDBatch *next_p = batch_p->list_next_p;
+      delete batch_p;
+      batch_p = next_p;
+    }
   }
 
   /*
@@ -2467,6 +3997,13 @@ class BwTree : public BwTreeBase {
 
           ((LeafDeleteNode *)node_p)->~LeafDeleteNode();
 
+          break;
+        case NodeType::LeafUpdateType:
+          next_node_p = ((LeafUpdateNode *)node_p)->child_node_p;
+
+          ((LeafUpdateNode *)node_p)->~LeafUpdateNode();
+          freed_count++;
+
           break;
         case NodeType::LeafSplitType:
           next_node_p = ((LeafSplitNode *)node_p)->child_node_p;
@@ -2515,7 +4052,7 @@ class BwTree : public BwTreeBase {
           // or will be freed) epoch manager
           // NOTE: No need to call InvalidateNodeID since this function is
           // only called on destruction of the tree
-          mapping_table[((InnerDeleteNode *)node_p)->item.second] = nullptr;
+          GetMappingTableEntry(((InnerDeleteNode *)node_p)->item.second) = nullptr;
 
           ((InnerDeleteNode *)node_p)->~InnerDeleteNode();
           freed_count++;
@@ -2587,7 +4124,7 @@ class BwTree : public BwTreeBase {
 
     // This is important since in the iterator we will use NodeID = 2
     // as the starting point of the traversal
-    first_leaf_id = GetNextNodeID();
+    first_leaf_id = GetNextNodeID(true, root_id);
     NOISEPAGE_ASSERT(first_leaf_id == FIRST_LEAF_NODE_ID, "First leaf has incorrect leaf node id.");
 
     // For the first inner node, it needs an empty low key
@@ -2621,153 +4158,523 @@ class BwTree : public BwTreeBase {
   /*
    * InitMappingTable() - Initialize the mapping table
    *
-   * It initialize all elements to NULL in order to make
-   * first CAS on the mapping table would succeed
+   * Only the directory is initialized and the first chunk is allocated here,
+   * such that creating a tree costs the same whatever the maximum number of
+   * nodes is. Other chunks are allocated by GetNextNodeID() when the first
+   * NodeID in them is handed out
    *
-   * NOTE: As an optimization we do not set the mapping table to zero
-   * since installing new node could be done as directly writing into
-   * the mapping table rather than CAS with nullptr
+   * NOTE: Chunks are allocated with calloc() rather than mmap() to avoid
+   * one mapping per tree, but large chunks are still mapped with zero pages
+   * by the allocator, so entries that are never written cost no memory
    */
   NO_ASAN void InitMappingTable() {
-    mapping_table = (std::atomic<const BaseNode *> *)mmap(nullptr, sizeof(BaseNode *) * MAPPING_TABLE_SIZE,
-                                                          PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-    // If allocation fails, we throw an error because this is uncoverable
-    // The upper level functions should either catch this exception
-    // and then use another index instead, or simply kill the system
-    if (mapping_table == (void *)-1) {
-      INDEX_LOG_ERROR("Failed to initialize mapping table");
-      //      throw IndexException("mmap() failed to initialize mapping table for Bw-Tree");
-      // TODO(Matt): fix this
+    for (int i = 0; i < MAPPING_TABLE_CHUNK_COUNT; i++) {
+      mapping_table[i].store(nullptr, std::memory_order_relaxed);
+      node_id_cluster_mask_table[i].store(nullptr, std::memory_order_relaxed);
     }
 
-    INDEX_LOG_TRACE("Mapping table allocated via mmap()");
+    // The tree could not be built without the first chunk, which maps the
+    // root and the first leaf. No thread is in the epoch of the tree yet
+    if (!AllocateMappingTableChunk(0)) {
+      throw std::bad_alloc{};
+    }
 
-    INDEX_LOG_TRACE("Initializing mapping table.... size = %lu", MAPPING_TABLE_SIZE);
-    INDEX_LOG_TRACE("Fast initialization: Do not set to zero");
+    INDEX_LOG_TRACE("Initializing mapping table.... size = %lu", MAPPING_TABLE_FIRST_CHUNK_SIZE);
   }
 
   /*
-   * GetNextNodeID() - Thread-safe lock free method to get next node ID
+   * GetMappingTableChunkIndex() - Returns the index of the chunk that maps a
+   *                               NodeID, and the offset of its entry in it
    *
-   * This function basically compiles to LOCK XADD instruction on x86
-   * which is guaranteed to execute atomically
+   * Chunk i maps NodeIDs from FIRST_CHUNK_SIZE * (2^i - 1) (inclusive) to
+   * FIRST_CHUNK_SIZE * (2^(i + 1) - 1) (exclusive), so the chunk is the
+   * highest set bit of (node_id + FIRST_CHUNK_SIZE) above FIRST_CHUNK_SIZE
    */
-  NO_ASAN inline NodeID GetNextNodeID() {
-    // This is a std::pair<bool, NodeID>
-    // If the first element is true then the NodeID is a valid one
-    // If the first element is false then NodeID is invalid and the
-    // stack is either empty or being used (we cannot lock and wait)
-    NodeID ret;
-    node_id_list_lock.lock();
-    if (node_id_list.size() == 0) {
-      ret = next_unused_node_id.fetch_add(1);
-    } else {
-      ret = node_id_list.front();
-      node_id_list.pop_front();
-    }
-    node_id_list_lock.unlock();
-    return ret;
+  static inline int GetMappingTableChunkIndex(NodeID node_id, size_t *offset_p) {
+    static_assert((MAPPING_TABLE_FIRST_CHUNK_SIZE & (MAPPING_TABLE_FIRST_CHUNK_SIZE - 1)) == 0,
+                  "The first chunk size must be a power of two.");
+    constexpr int first_chunk_bit = __builtin_ctzll(MAPPING_TABLE_FIRST_CHUNK_SIZE);
+
+    const uint64_t biased_id = static_cast<uint64_t>(node_id) + MAPPING_TABLE_FIRST_CHUNK_SIZE;
+    const int chunk_index = 63 - __builtin_clzll(biased_id) - first_chunk_bit;
+
+    *offset_p = biased_id - (MAPPING_TABLE_FIRST_CHUNK_SIZE << chunk_index);
+    return chunk_index;
   }
 
   /*
-   * InstallNodeToReplace() - Install a node to replace a previous one
+   * GetMappingTableEntry() - Returns the mapping table entry of a NodeID
    *
-   * If installation fails because CAS returned false, then return false
-   * This function does not retry
+   * The chunk of the NodeID must have been allocated, which is always the
+   * case for NodeIDs returned by GetNextNodeID(). This is lock-free and only
+   * adds a load of the chunk pointer (which is almost always cached) to the
+   * access of the entry
    */
-  NO_ASAN inline bool InstallNodeToReplace(NodeID node_id, const BaseNode *node_p, const BaseNode *prev_p) {
-    // Make sure node id is valid and does not exceed maximum
-    NOISEPAGE_ASSERT(node_id != INVALID_NODE_ID, "Node count exceeded maximum.");
-    NOISEPAGE_ASSERT(node_id < MAPPING_TABLE_SIZE, "Node count exceeded maximum.");
+  NO_ASAN inline std::atomic<const BaseNode *> &GetMappingTableEntry(NodeID node_id) {
+    size_t offset;
+    const int chunk_index = GetMappingTableChunkIndex(node_id, &offset);
 
-// If idb is activated, then all operation will be blocked before
-// they could call CAS and change the key
-#ifdef INTERACTIVE_DEBUG
-    debug_stop_mutex.lock();
-    debug_stop_mutex.unlock();
-#endif
+    NOISEPAGE_ASSERT(chunk_index < MAPPING_TABLE_CHUNK_COUNT, "Node id out of range.");
+    std::atomic<const BaseNode *> *chunk_p = mapping_table[chunk_index].load(std::memory_order_acquire);
+    NOISEPAGE_ASSERT(chunk_p != nullptr, "Mapping table chunk is not allocated.");
 
-    return mapping_table[node_id].compare_exchange_strong(prev_p, node_p);
+    return chunk_p[offset];
   }
 
   /*
-   * InstallRootNode() - Replace the old root with a new one
+   * GetMappingTableChunkMemorySize() - Returns the number of bytes of a chunk
    *
-   * There is change that this function would fail. In that case it returns
-   * false, which implies there are some other threads changing the root ID
+   * Chunks backed by huge pages are rounded up to a multiple of the huge
+   * page size, which they already are since both are powers of two
    */
-  NO_ASAN inline bool InstallRootNode(NodeID old_root_node_id, NodeID new_root_node_id) {
-    return root_id.compare_exchange_strong(old_root_node_id, new_root_node_id);
+  static constexpr size_t GetMappingTableChunkMemorySize(int chunk_index) {
+    const size_t size = (MAPPING_TABLE_FIRST_CHUNK_SIZE << chunk_index) * sizeof(BaseNode *);
+
+    if (!IsHugePageMappingTableChunk(size)) {
+      return size;
+    }
+
+    return (size + MAPPING_TABLE_HUGE_PAGE_SIZE - 1) / MAPPING_TABLE_HUGE_PAGE_SIZE * MAPPING_TABLE_HUGE_PAGE_SIZE;
   }
 
   /*
-   * InstallNewNode() - Install a new node into the mapping table
+   * GetNodeIDClusterMaskChunkMemorySize() - Returns the number of bytes of
+   *                                         the cluster free masks of a chunk
    *
-   * This function does not return any value since we assume new node
-   * installation would always succeed
+   * The masks are allocated separately from the entries, such that chunks
+   * backed by huge pages are not rounded up by a whole huge page for them
    */
-  NO_ASAN inline void InstallNewNode(NodeID node_id, const BaseNode *node_p) { mapping_table[node_id] = node_p; }
+  static constexpr size_t GetNodeIDClusterMaskChunkMemorySize(int chunk_index) {
+    return ((MAPPING_TABLE_FIRST_CHUNK_SIZE << chunk_index) / NODE_ID_CLUSTER_SIZE) * sizeof(uint64_t);
+  }
 
   /*
-   * GetNode() - Return the pointer mapped by a node ID
-   *
-   * This function checks the validity of the node ID
-   *
-   * NOTE: This function fixes a snapshot; its counterpart using
-   * CAS instruction to install a new node creates new snapshot
-   * and the serialization order of these two atomic operations
-   * determines actual serialization order
-   *
-   * If we want to keep the same snapshot then we should only
-   * call GetNode() once and stick to that physical pointer
+   * IsHugePageMappingTableChunk() - Returns whether a chunk of the given size
+   *                                 is mapped with huge pages
    */
-  NO_ASAN inline const BaseNode *GetNode(const NodeID node_id) {
-    NOISEPAGE_ASSERT(node_id != INVALID_NODE_ID, "Node id out of range.");
-    NOISEPAGE_ASSERT(node_id < MAPPING_TABLE_SIZE, "Node id out of range.");
-
-    return mapping_table[node_id].load();
+  static constexpr bool IsHugePageMappingTableChunk(size_t size) {
+#ifdef USE_HUGE_PAGE_MAPPING_TABLE
+    return size >= MAPPING_TABLE_HUGE_PAGE_SIZE;
+#else
+    (void)size;
+    return false;
+#endif
   }
 
   /*
-   * Traverse() - Traverse down the tree structure, handles abort
-   *
-   * This function is implemented as a state machine that allows a thread
-   * to jump back to Init state when necessary (probably a CAS failed and
-   * it does not want to resolve it from bottom up)
-   *
-   * It stops at page level, and then the top on the context stack is a
-   * leaf level snapshot, with all SMOs, consolidation, and possibly
-   * split/remove finished
-   *
-   * NOTE: If value_p is given then this function calls NavigateLeafNode()
-   * to detect whether the desired key value pair exists or not. If value_p
-   * is nullptr then this function calls the overloaded version of
-   *  NavigateLeafNode() to collect all values associated with the key
-   * and put them into value_list_p.
-   *
-   * If value_p is not nullptr, then the return value of this function denotes
-   * whether the key-value pair exists or not. Otherwise it always return true
+   * AllocateMappingTableChunk() - Allocates the chunk of the mapping table
+   *                               that maps a NodeID if it does not exist
    *
-   * In both cases, when this function returns, the top of the NodeSnapshot
-   * list is always a leaf node snapshot in which current key is included
-   * in its range.
+   * Threads that find the chunk missing at the same time all allocate one,
+   * and all but the one that installs its chunk with CAS free theirs
    *
-   * For value_p and value_list_p, at most one of them could be non-nullptr
-   * If both are nullptr then we just traverse and do not do anything
+   * Returns false if the NodeID is out of the range of the mapping table or
+   * the chunk could not be allocated, since the NodeID could not be used in
+   * either case. This is not thrown since it happens inside SMOs, after the
+   * thread has joined the epoch
    */
-  NO_ASAN const KeyValuePair *Traverse(Context *context_p, const ValueType *value_p, std::pair<int, bool> *index_pair_p,
-                                       bool unique_key = false) {
-    // For value collection it always returns nullptr
-    const KeyValuePair *found_pair_p = nullptr;
+  NO_ASAN bool AllocateMappingTableChunk(NodeID node_id) {
+    size_t offset;
+    const int chunk_index = GetMappingTableChunkIndex(node_id, &offset);
 
-  retry_traverse:
-    NOISEPAGE_ASSERT(!context_p->abort_flag, "Must retry traverse.");
-#ifdef BWTREE_DEBUG
-    NOISEPAGE_ASSERT(context_p->current_level == -1, "Should still be default value.");
-#endif
+    if (chunk_index >= MAPPING_TABLE_CHUNK_COUNT) {
+      INDEX_LOG_ERROR("Node count exceeded maximum");
+      return false;
+    }
 
-    // This is the serialization point for reading/writing root node
-    NodeID start_node_id = root_id.load();
+    if (mapping_table[chunk_index].load(std::memory_order_relaxed) != nullptr) {
+      return true;
+    }
+
+    // The masks are installed before the entries, such that they exist
+    // whenever the chunk does
+    if (!AllocateNodeIDClusterMaskChunk(chunk_index)) {
+      return false;
+    }
+
+    const size_t size = GetMappingTableChunkMemorySize(chunk_index);
+    void *chunk_p;
+    if (IsHugePageMappingTableChunk(size)) {
+      // MAP_HUGETLB fails unless huge pages have been reserved, in which case
+      // we ask for transparent huge pages instead. Both are zero filled
+      chunk_p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+      if (chunk_p == MAP_FAILED) {
+        chunk_p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (chunk_p != MAP_FAILED) {
+          madvise(chunk_p, size, MADV_HUGEPAGE);
+        }
+      }
+
+      if (chunk_p == MAP_FAILED) {
+        chunk_p = nullptr;
+      }
+    } else {
+      chunk_p = calloc(1, size);
+    }
+
+    if (chunk_p == nullptr) {
+      INDEX_LOG_ERROR("Failed to allocate mapping table chunk");
+      return false;
+    }
+
+    // Release such that threads that see NodeIDs of the chunk also see the
+    // zeroed entries
+    std::atomic<const BaseNode *> *expected_p = nullptr;
+    if (!mapping_table[chunk_index].compare_exchange_strong(
+            expected_p, static_cast<std::atomic<const BaseNode *> *>(chunk_p), std::memory_order_release,
+            std::memory_order_relaxed)) {
+      FreeMappingTableChunk(chunk_index, chunk_p);
+    }
+
+    return true;
+  }
+
+  /*
+   * AllocateNodeIDClusterMaskChunk() - Allocates the cluster free masks of a
+   *                                    chunk if they do not exist
+   *
+   * This works like AllocateMappingTableChunk(), and returns false if the
+   * masks could not be allocated
+   */
+  NO_ASAN bool AllocateNodeIDClusterMaskChunk(int chunk_index) {
+    if (node_id_cluster_mask_table[chunk_index].load(std::memory_order_relaxed) != nullptr) {
+      return true;
+    }
+
+    void *mask_chunk_p = calloc(1, GetNodeIDClusterMaskChunkMemorySize(chunk_index));
+    if (mask_chunk_p == nullptr) {
+      INDEX_LOG_ERROR("Failed to allocate NodeID cluster masks");
+      return false;
+    }
+
+    std::atomic<uint64_t> *expected_p = nullptr;
+    if (!node_id_cluster_mask_table[chunk_index].compare_exchange_strong(
+            expected_p, static_cast<std::atomic<uint64_t> *>(mask_chunk_p), std::memory_order_release,
+            std::memory_order_relaxed)) {
+      free(mask_chunk_p);
+    }
+
+    return true;
+  }
+
+  /*
+   * FreeMappingTableChunk() - Frees a chunk allocated by
+   *                           AllocateMappingTableChunk()
+   */
+  static void FreeMappingTableChunk(int chunk_index, void *chunk_p) {
+    const size_t size = GetMappingTableChunkMemorySize(chunk_index);
+    if (IsHugePageMappingTableChunk(size)) {
+      munmap(chunk_p, size);
+    } else {
+      free(chunk_p);
+    }
+  }
+
+  /*
+   * FreeMappingTable() - Frees all chunks of the mapping table
+   *
+   * NOTE: This function only works in a single-threaded environment
+   */
+  void FreeMappingTable() {
+    for (int i = 0; i < MAPPING_TABLE_CHUNK_COUNT; i++) {
+      std::atomic<const BaseNode *> *chunk_p = mapping_table[i].exchange(nullptr);
+      if (chunk_p != nullptr) {
+        FreeMappingTableChunk(i, chunk_p);
+      }
+
+      free(node_id_cluster_mask_table[i].exchange(nullptr));
+    }
+  }
+
+  /*
+   * GetMappingTableMemorySize() - Returns the number of bytes allocated for
+   *                               chunks of the mapping table and their
+   *                               cluster free masks
+   */
+  size_t GetMappingTableMemorySize() const {
+    size_t size = 0UL;
+    for (int i = 0; i < MAPPING_TABLE_CHUNK_COUNT; i++) {
+      if (mapping_table[i].load() != nullptr) {
+        size += GetMappingTableChunkMemorySize(i);
+      }
+
+      if (node_id_cluster_mask_table[i].load() != nullptr) {
+        size += GetNodeIDClusterMaskChunkMemorySize(i);
+      }
+    }
+
+    return size;
+  }
+
+  /*
+   * GetNodeIDClusterMask() - Returns the free mask of the cluster of a NodeID
+   *
+   * Bit i of the mask is set if the i-th NodeID of the cluster has not been
+   * handed out. Masks are zero until the cluster is taken by
+   * AllocateNodeIDCluster(), and bits are only cleared after that
+   */
+  NO_ASAN inline std::atomic<uint64_t> &GetNodeIDClusterMask(NodeID node_id) {
+    static_assert(MAPPING_TABLE_FIRST_CHUNK_SIZE % NODE_ID_CLUSTER_SIZE == 0,
+                  "A NodeID cluster must not span two mapping table chunks.");
+    static_assert(NODE_ID_CLUSTER_SIZE == sizeof(uint64_t) * 8, "A NodeID cluster must have one bit per NodeID.");
+
+    size_t offset;
+    const int chunk_index = GetMappingTableChunkIndex(node_id, &offset);
+    std::atomic<uint64_t> *mask_chunk_p = node_id_cluster_mask_table[chunk_index].load(std::memory_order_acquire);
+    NOISEPAGE_ASSERT(mask_chunk_p != nullptr, "NodeID cluster masks are not allocated.");
+
+    return mask_chunk_p[offset / NODE_ID_CLUSTER_SIZE];
+  }
+
+  /*
+   * ClaimClusteredNodeID() - Takes a NodeID that has not been handed out
+   *                          from the cluster of the given NodeID
+   *
+   * Returns false if the NodeID is invalid or the cluster is full. This
+   * is lock-free
+   */
+  NO_ASAN inline bool ClaimClusteredNodeID(NodeID near_id, NodeID *node_id_p) {
+    if (near_id == INVALID_NODE_ID) {
+      return false;
+    }
+
+    std::atomic<uint64_t> &mask = GetNodeIDClusterMask(near_id);
+    uint64_t free_mask = mask.load(std::memory_order_relaxed);
+
+    while (free_mask != 0UL) {
+      // Claim the lowest free NodeID
+      if (mask.compare_exchange_weak(free_mask, free_mask & (free_mask - 1))) {
+        *node_id_p = (near_id & ~(NODE_ID_CLUSTER_SIZE - 1)) + __builtin_ctzll(free_mask);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  /*
+   * AllocateNodeIDCluster() - Takes a new cluster and returns its first
+   *                           NodeID, leaving the others free in the cluster
+   *
+   * INVALID_NODE_ID is never handed out and is not free in the first cluster,
+   * and is returned if the cluster could not be mapped
+   */
+  NO_ASAN NodeID AllocateNodeIDCluster(bool is_leaf) {
+    const NodeID first_id = next_unused_node_id.fetch_add(NODE_ID_CLUSTER_SIZE);
+    if (!AllocateMappingTableChunk(first_id)) {
+      return INVALID_NODE_ID;
+    }
+
+    uint64_t free_mask = ~0UL;
+    if (first_id == INVALID_NODE_ID) {
+      free_mask &= ~1UL;
+    }
+
+    const int ret_bit = __builtin_ctzll(free_mask);
+    GetNodeIDClusterMask(first_id).store(free_mask & ~(1UL << ret_bit), std::memory_order_release);
+    latest_cluster_node_id[is_leaf].store(first_id + ret_bit, std::memory_order_relaxed);
+
+    return first_id + ret_bit;
+  }
+
+  /*
+   * GetNextNodeID() - Thread-safe lock free method to get next node ID
+   *
+   * The NodeID is taken from the cluster of parent_id, then from the cluster
+   * of node_id if either has a free NodeID, such that the new node is mapped
+   * next to its parent or sibling (see USE_NODE_ID_CLUSTER). Either could be
+   * INVALID_NODE_ID if unknown. Otherwise it is taken from the latest
+   * cluster of leaf or inner nodes, such that clusters are filled before new
+   * ones are taken, and the few inner nodes are mapped on a few pages that
+   * stay cached instead of being spread among leaf nodes
+   *
+   * Recycled NodeIDs are reused before a new cluster is taken. A thread
+   * with a GC slot takes them from its own batch, which is swapped for a
+   * full one from the shared stack when empty, and other threads take one
+   * NodeID from a shared batch at a time
+   *
+   * INVALID_NODE_ID is returned if the mapping table could not map a new
+   * NodeID (see AllocateMappingTableChunk()). SMOs then leave the node as it
+   * is, such that a later traversal tries again
+   */
+  NO_ASAN inline NodeID GetNextNodeID(bool is_leaf = false, NodeID parent_id = INVALID_NODE_ID,
+                                      NodeID node_id = INVALID_NODE_ID) {
+    NodeID ret;
+#ifdef USE_NODE_ID_CLUSTER
+    if (ClaimClusteredNodeID(parent_id, &ret) || ClaimClusteredNodeID(node_id, &ret) ||
+        ClaimClusteredNodeID(latest_cluster_node_id[is_leaf].load(std::memory_order_relaxed), &ret)) {
+      return ret;
+    }
+#else
+    (void)is_leaf;
+    (void)parent_id;
+    (void)node_id;
+#endif
+
+    if (TakeRecycledNodeID(&ret)) {
+      return ret;
+    }
+
+#ifdef USE_NODE_ID_CLUSTER
+    return AllocateNodeIDCluster(is_leaf);
+#else
+    ret = next_unused_node_id.fetch_add(1);
+
+    // The NodeID might be the first one of a chunk that does not exist yet
+    if (!AllocateMappingTableChunk(ret)) {
+      return INVALID_NODE_ID;
+    }
+
+    return ret;
+#endif
+  }
+
+  /*
+   * TakeRecycledNodeID() - Takes a NodeID recycled by InvalidateNodeID()
+   *
+   * Returns false if there is no recycled NodeID
+   */
+  NO_ASAN inline bool TakeRecycledNodeID(NodeID *node_id_p) {
+    GCMetaData *metadata_p = GetRegisteredGCMetaData();
+
+    if (metadata_p != nullptr) {
+      NodeIDBatch *batch_p = metadata_p->node_id_batch_p;
+
+      if (batch_p == nullptr || batch_p->size == 0) {
+        NodeIDBatch *full_batch_p = free_node_id_batch_stack.Pop();
+        if (full_batch_p == nullptr) {
+          return false;
+        }
+
+        if (batch_p != nullptr) {
+          empty_node_id_batch_stack.Push(batch_p);
+        }
+
+        batch_p = full_batch_p;
+        metadata_p->node_id_batch_p = batch_p;
+      }
+
+      *node_id_p = batch_p->node_id_list[--batch_p->size];
+      return true;
+    }
+
+    NodeIDBatch *batch_p = free_node_id_batch_stack.Pop();
+    if (batch_p == nullptr) {
+      return false;
+    }
+
+    *node_id_p = batch_p->node_id_list[--batch_p->size];
+
+    if (batch_p->size > 0) {
+      free_node_id_batch_stack.Push(batch_p);
+    } else {
+      empty_node_id_batch_stack.Push(batch_p);
+    }
+
+    return true;
+  }
+
+  /*
+   * InstallNodeToReplace() - Install a node to replace a previous one
+   *
+   * If installation fails because CAS returned false, then return false
+   * This function does not retry
+   */
+  NO_ASAN inline bool InstallNodeToReplace(NodeID node_id, const BaseNode *node_p, const BaseNode *prev_p) {
+    // Make sure node id is valid and does not exceed maximum
+    NOISEPAGE_ASSERT(node_id != INVALID_NODE_ID, "Node count exceeded maximum.");
+    NOISEPAGE_ASSERT(node_id < MAPPING_TABLE_SIZE, "Node count exceeded maximum.");
+
+// If idb is activated, then all operation will be blocked before
+// they could call CAS and change the key
+#ifdef INTERACTIVE_DEBUG
+    debug_stop_mutex.lock();
+    debug_stop_mutex.unlock();
+#endif
+
+    return GetMappingTableEntry(node_id).compare_exchange_strong(prev_p, node_p);
+  }
+
+  /*
+   * InstallRootNode() - Replace the old root with a new one
+   *
+   * There is change that this function would fail. In that case it returns
+   * false, which implies there are some other threads changing the root ID
+   */
+  NO_ASAN inline bool InstallRootNode(NodeID old_root_node_id, NodeID new_root_node_id) {
+    return root_id.compare_exchange_strong(old_root_node_id, new_root_node_id);
+  }
+
+  /*
+   * InstallNewNode() - Install a new node into the mapping table
+   *
+   * This function does not return any value since we assume new node
+   * installation would always succeed
+   */
+  NO_ASAN inline void InstallNewNode(NodeID node_id, const BaseNode *node_p) {
+    GetMappingTableEntry(node_id) = node_p;
+  }
+
+  /*
+   * GetNode() - Return the pointer mapped by a node ID
+   *
+   * This function checks the validity of the node ID
+   *
+   * NOTE: This function fixes a snapshot; its counterpart using
+   * CAS instruction to install a new node creates new snapshot
+   * and the serialization order of these two atomic operations
+   * determines actual serialization order
+   *
+   * If we want to keep the same snapshot then we should only
+   * call GetNode() once and stick to that physical pointer
+   */
+  NO_ASAN inline const BaseNode *GetNode(const NodeID node_id) {
+    NOISEPAGE_ASSERT(node_id != INVALID_NODE_ID, "Node id out of range.");
+    NOISEPAGE_ASSERT(node_id < MAPPING_TABLE_SIZE, "Node id out of range.");
+
+    return GetMappingTableEntry(node_id).load();
+  }
+
+  /*
+   * Traverse() - Traverse down the tree structure, handles abort
+   *
+   * This function is implemented as a state machine that allows a thread
+   * to jump back to Init state when necessary (probably a CAS failed and
+   * it does not want to resolve it from bottom up)
+   *
+   * It stops at page level, and then the top on the context stack is a
+   * leaf level snapshot, with all SMOs, consolidation, and possibly
+   * split/remove finished
+   *
+   * NOTE: If value_p is given then this function calls NavigateLeafNode()
+   * to detect whether the desired key value pair exists or not. If value_p
+   * is nullptr then this function calls the overloaded version of
+   *  NavigateLeafNode() to collect all values associated with the key
+   * and put them into value_list_p.
+   *
+   * If value_p is not nullptr, then the return value of this function denotes
+   * whether the key-value pair exists or not. Otherwise it always return true
+   *
+   * In both cases, when this function returns, the top of the NodeSnapshot
+   * list is always a leaf node snapshot in which current key is included
+   * in its range.
+   *
+   * For value_p and value_list_p, at most one of them could be non-nullptr
+   * If both are nullptr then we just traverse and do not do anything
+   */
+  NO_ASAN const KeyValuePair *Traverse(Context *context_p, const ValueType *value_p, std::pair<int, bool> *index_pair_p,
+                                       bool unique_key = false) {
+    // For value collection it always returns nullptr
+    const KeyValuePair *found_pair_p = nullptr;
+
+  retry_traverse:
+    NOISEPAGE_ASSERT(!context_p->abort_flag, "Must retry traverse.");
+#ifdef BWTREE_DEBUG
+    NOISEPAGE_ASSERT(context_p->current_level == -1, "Should still be default value.");
+#endif
+
+    // This is the serialization point for reading/writing root node
+    NodeID start_node_id = root_id.load();
 
     // This is used to identify root nodes
     // NOTE: We set current snapshot since in LoadNodeID() or read opt.
@@ -2975,36 +4882,274 @@ class BwTree : public BwTreeBase {
   }
 
   /*
-   * LocateSeparatorByKey() - Locate the child node for a key
-   *
-   * This functions works with any non-empty inner nodes. However
-   * it fails assertion with empty inner node
+   * KeyLowerBound() - Returns the first element whose key >= search key
+   * KeyUpperBound() - Returns the first element whose key > search key
    *
-   * NOTE: This function ignores the first element in the sep list
-   * since even if we know the low key of the first element
+   * Elements are key-value pairs or key-NodeID pairs sorted by key. For
+   * 32 and 64 bit integer keys compared with std::less we use
+   * IntegerKeySearch(), for stripped keys StrippedKeySearch(), and
+   * std::lower_bound()/std::upper_bound() otherwise
    */
-  NO_ASAN inline NodeID LocateSeparatorByKey(const KeyType &search_key, const InnerNode *inner_node_p,
-                                             const KeyNodeIDPair *start_p, const KeyNodeIDPair *end_p) {
-    // Inner node could not be empty
-    NOISEPAGE_ASSERT(inner_node_p->GetSize() != 0UL, "Inner node is empty.");
-    (void)inner_node_p;
-
-    // Hopefully std::upper_bound would use binary search here
-    auto it =
-        std::upper_bound(start_p, end_p, std::make_pair(search_key, INVALID_NODE_ID), key_node_id_pair_cmp_obj) - 1;
-#ifdef BWTREE_DEBUG
-    // auto it2 = std::upper_bound(inner_node_p->Begin() + 1,
-//                           inner_node_p->End(),
-//                           std::make_pair(search_key, INVALID_NODE_ID),
-//                           key_node_id_pair_cmp_obj) - 1;
-
-// NOISEPAGE_ASSERT(it == it2);
-#endif
-
-    // Since upper_bound returns the first element > given key
-    // so we need to decrease it to find the last element <= given key
-    // which is out separator key
-    return it->second;
+  template <typename ElementType>
+  NO_ASAN inline const ElementType *KeyLowerBound(const ElementType *start_p, const ElementType *end_p,
+                                                  const KeyType &search_key) const {
+    if constexpr (INTEGER_KEY_SEARCH) {
+      return IntegerKeySearch<false>(start_p, end_p, search_key);
+    } else if constexpr (STRIP_KEY_PREFIX) {
+      return StrippedKeySearch<false>(start_p, end_p, search_key);
+    } else {
+      return std::lower_bound(start_p, end_p, search_key, [this](const ElementType &element, const KeyType &key) {
+        return KeyCmpLess(ElementKey(element), key);
+      });
+    }
+  }
+
+  template <typename ElementType>
+  NO_ASAN inline const ElementType *KeyUpperBound(const ElementType *start_p, const ElementType *end_p,
+                                                  const KeyType &search_key) const {
+    if constexpr (INTEGER_KEY_SEARCH) {
+      return IntegerKeySearch<true>(start_p, end_p, search_key);
+    } else if constexpr (STRIP_KEY_PREFIX) {
+      return StrippedKeySearch<true>(start_p, end_p, search_key);
+    } else {
+      return std::upper_bound(start_p, end_p, search_key, [this](const KeyType &key, const ElementType &element) {
+        return KeyCmpLess(key, ElementKey(element));
+      });
+    }
+  }
+
+  /*
+   * ElementKey() - Returns the key of an element
+   */
+  template <typename T>
+  NO_ASAN static inline const KeyType &ElementKey(const std::pair<KeyType, T> &element) {
+    return element.first;
+  }
+
+  /*
+   * NodeKeyUpperBound() - KeyUpperBound() on elements of a node
+   *
+   * If the node has a key tree then the search is done on it and the result
+   * is mapped back to the element array
+   */
+  template <typename ElementType>
+  NO_ASAN inline const ElementType *NodeKeyUpperBound(const ElasticNode<ElementType> *node_p,
+                                                      const ElementType *start_p, const ElementType *end_p,
+                                                      const KeyType &search_key) const {
+    if constexpr (ElasticNode<ElementType>::KEY_TREE) {
+      NOISEPAGE_ASSERT(start_p > node_p->Begin(), "The first key is not in the key tree.");
+
+      // The range is sorted, so its upper bound is the upper bound in the
+      // whole node clamped to the range
+      const ElementType *it = KeyTreeUpperBound(node_p, search_key);
+
+      return std::min(std::max(it, start_p), end_p);
+    } else {
+      (void)node_p;
+      return KeyUpperBound(start_p, end_p, search_key);
+    }
+  }
+
+  /*
+   * KeyRunEnd() - Returns the end of the run of elements with the search key
+   *               that starts at start_p
+   *
+   * start_p must be the first element >= search key. The run is found by
+   * galloping, i.e. doubling the distance until an element with another
+   * key, and a binary search in the last step. This takes O(log(run length))
+   * comparisons, such that the many values of a hot key are not compared
+   * by key one by one, and a run of one element takes one comparison
+   */
+  template <typename ElementType>
+  NO_ASAN inline const ElementType *KeyRunEnd(const ElementType *start_p, const ElementType *end_p,
+                                              const KeyType &search_key) const {
+    if ((start_p == end_p) || !KeyCmpEqual(ElementKey(*start_p), search_key)) {
+      return start_p;
+    }
+
+    // All elements before run_p are in the run
+    const ElementType *run_p = start_p + 1;
+    size_t step = 1;
+    while ((static_cast<size_t>(end_p - run_p) > step) && KeyCmpEqual(ElementKey(run_p[step - 1]), search_key)) {
+      run_p += step;
+      step *= 2;
+    }
+
+    return KeyUpperBound(run_p, std::min(run_p + step, end_p), search_key);
+  }
+
+  /*
+   * KeyTreeUpperBound() - Returns the first element after the first one
+   *                       whose key > search key using the key tree
+   *
+   * Each step goes to the right child if the key <= search key, which only
+   * selects the next slot without branches. The descendants a few levels
+   * below are contiguous, so they are prefetched in advance. In the end,
+   * the result is the last slot where we went left, which is found by
+   * removing the trailing right turns (1 bits) and then the left turn
+   */
+  NO_ASAN inline const KeyNodeIDPair *KeyTreeUpperBound(const ElasticNode<KeyNodeIDPair> *node_p,
+                                                        const KeyType &search_key) const {
+    NOISEPAGE_ASSERT(node_p->GetSize() == node_p->GetItemCount(), "The key tree is only valid for a full node.");
+
+    const KeyType *key_tree_p = node_p->KeyTreeBegin();
+    const auto tree_size = static_cast<uint64_t>(node_p->GetSize());
+
+    // Keys in the tree are stripped of the same head, which is then skipped
+    // if the search key starts with it as well
+    uint32_t offset = 0U;
+    if constexpr (STRIP_KEY_PREFIX) {
+      uint32_t head_size = node_p->GetKeyHeadSize();
+      if ((head_size > 0) &&
+          (KeyType::CommonPrefixSize(search_key, KeyType{node_p->GetLowKey().GetData(), head_size}) == head_size)) {
+        offset = head_size;
+      }
+    }
+
+    uint64_t slot = 1;
+    while (slot < tree_size) {
+      __builtin_prefetch(key_tree_p + slot * KEY_TREE_PREFETCH_STRIDE);
+
+      if constexpr (STRIP_KEY_PREFIX) {
+        slot = 2 * slot + static_cast<uint64_t>(KeyType::Compare(search_key, key_tree_p[slot], offset) >= 0);
+      } else {
+        slot = 2 * slot + static_cast<uint64_t>(!KeyCmpLess(search_key, key_tree_p[slot]));
+      }
+    }
+
+    slot >>= __builtin_ffsll(static_cast<int64_t>(~slot));
+
+    return node_p->Begin() + node_p->KeyTreeIndexBegin()[slot];
+  }
+
+  /*
+   * StrippedKeySearch() - Lower bound (or upper bound if Upper is true) for
+   *                       keys stripped by their node
+   *
+   * If the first and the last element share the head, then every element
+   * between them starts with it as well. The search key is compared with
+   * the head once, and then only the bytes after it are compared with the
+   * elements. If the search key does not start with the head then it is
+   * either below or above all elements
+   */
+  template <bool Upper, typename ElementType>
+  NO_ASAN static inline const ElementType *StrippedKeySearch(const ElementType *start_p, const ElementType *end_p,
+                                                             const KeyType &search_key) {
+    uint32_t offset = 0U;
+
+    if (start_p != end_p) {
+      const KeyType &first_key = ElementKey(*start_p);
+      const KeyType &last_key = ElementKey(*(end_p - 1));
+      uint32_t head_size = first_key.GetHeadSize();
+
+      if ((head_size > 0) && (last_key.GetHeadSize() == head_size) && (last_key.GetHead() == first_key.GetHead())) {
+        KeyType head_key{first_key.GetHead(), head_size};
+        if (KeyType::CommonPrefixSize(search_key, head_key) < head_size) {
+          return (search_key < head_key) ? start_p : end_p;
+        }
+
+        offset = head_size;
+      }
+    }
+
+    if constexpr (Upper) {
+      return std::upper_bound(start_p, end_p, search_key, [offset](const KeyType &key, const ElementType &element) {
+        return KeyType::Compare(key, ElementKey(element), offset) < 0;
+      });
+    } else {
+      return std::lower_bound(start_p, end_p, search_key, [offset](const ElementType &element, const KeyType &key) {
+        return KeyType::Compare(ElementKey(element), key, offset) < 0;
+      });
+    }
+  }
+
+  /*
+   * IntegerKeySearch() - Lower bound (or upper bound if Upper is true) for
+   *                      integer keys
+   *
+   * The range is first narrowed by a branch free binary search, in which
+   * the comparison result only selects the next base pointer, until at most
+   * KEY_SEARCH_LINEAR_SIZE elements are left. Then the position is the
+   * number of remaining elements whose key is < (or <=) the search key,
+   * which is counted without branches, two elements per instruction with
+   * AVX2 for 64 bit keys
+   */
+  template <bool Upper, typename ElementType>
+  NO_ASAN static inline const ElementType *IntegerKeySearch(const ElementType *start_p, const ElementType *end_p,
+                                                            const KeyType &search_key) {
+    size_t size = end_p - start_p;
+
+    // The result is always in [start_p, start_p + size]
+    while (size > static_cast<size_t>(KEY_SEARCH_LINEAR_SIZE)) {
+      size_t half = size / 2;
+      bool go_right = Upper ? !(search_key < ElementKey(start_p[half])) : (ElementKey(start_p[half]) < search_key);
+
+      start_p = go_right ? (start_p + half) : start_p;
+      size -= half;
+    }
+
+    size_t index = 0;
+    size_t count = 0;
+
+#if defined(__AVX2__)
+    if constexpr ((sizeof(KeyType) == 8) && (sizeof(ElementType) == 16)) {
+      // Unsigned keys are compared as signed keys with the sign bit flipped
+      const auto flip = static_cast<int64_t>(std::is_signed<KeyType>::value ? 0UL : (1UL << 63));
+      const __m256i flip_v = _mm256_set1_epi64x(flip);
+      const __m256i key_v = _mm256_set1_epi64x(static_cast<int64_t>(search_key) ^ flip);
+
+      // Each load holds two elements, with keys in lane 0 and 2
+      for (; index + 2 <= size; index += 2) {
+        __m256i element_v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(start_p + index));
+        element_v = _mm256_xor_si256(element_v, flip_v);
+
+        if (Upper) {
+          // Elements <= search key are those not > search key
+          __m256i cmp_v = _mm256_cmpgt_epi64(element_v, key_v);
+          count += 2 - __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(cmp_v)) & 0x5);
+        } else {
+          __m256i cmp_v = _mm256_cmpgt_epi64(key_v, element_v);
+          count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(cmp_v)) & 0x5);
+        }
+      }
+    }
+#endif
+
+    for (; index < size; index++) {
+      count += Upper ? !(search_key < ElementKey(start_p[index])) : (ElementKey(start_p[index]) < search_key);
+    }
+
+    return start_p + count;
+  }
+
+  /*
+   * LocateSeparatorByKey() - Locate the child node for a key
+   *
+   * This functions works with any non-empty inner nodes. However
+   * it fails assertion with empty inner node
+   *
+   * NOTE: This function ignores the first element in the sep list
+   * since even if we know the low key of the first element
+   */
+  NO_ASAN inline NodeID LocateSeparatorByKey(const KeyType &search_key, const InnerNode *inner_node_p,
+                                             const KeyNodeIDPair *start_p, const KeyNodeIDPair *end_p) {
+    // Inner node could not be empty
+    NOISEPAGE_ASSERT(inner_node_p->GetSize() != 0UL, "Inner node is empty.");
+
+    auto it = NodeKeyUpperBound(inner_node_p, start_p, end_p, search_key) - 1;
+#ifdef BWTREE_DEBUG
+    // auto it2 = std::upper_bound(inner_node_p->Begin() + 1,
+//                           inner_node_p->End(),
+//                           std::make_pair(search_key, INVALID_NODE_ID),
+//                           key_node_id_pair_cmp_obj) - 1;
+
+// NOISEPAGE_ASSERT(it == it2);
+#endif
+
+    // Since upper_bound returns the first element > given key
+    // so we need to decrease it to find the last element <= given key
+    // which is out separator key
+    return it->second;
   }
 
   /*
@@ -3019,9 +5164,7 @@ class BwTree : public BwTreeBase {
    */
   NO_ASAN inline NodeID LocateSeparatorByKeyBI(const KeyType &search_key, const InnerNode *inner_node_p) {
     NOISEPAGE_ASSERT(inner_node_p->GetSize() != 0UL, "Inner node is empty.");
-    auto it = std::upper_bound(inner_node_p->Begin() + 1, inner_node_p->End(),
-                               std::make_pair(search_key, INVALID_NODE_ID), key_node_id_pair_cmp_obj) -
-              1;
+    auto it = NodeKeyUpperBound(inner_node_p, inner_node_p->Begin() + 1, inner_node_p->End(), search_key) - 1;
 
     if (KeyCmpEqual(it->first, search_key)) {
       // If search key is the low key then we know we should have already
@@ -3407,6 +5550,9 @@ class BwTree : public BwTreeBase {
     NOISEPAGE_ASSERT(inner_node_p->GetSize() == node_p->GetItemCount(), "Invalid node structure.");
     NOISEPAGE_ASSERT(inner_node_p->GetSize() == inner_node_p->GetItemCount(), "Invalid node structure.");
 
+    // This refreshes the subtree counts of all children
+    SetSubtreeItemCounts(inner_node_p);
+
     return inner_node_p;
   }
 
@@ -3648,6 +5794,160 @@ class BwTree : public BwTreeBase {
     NOISEPAGE_ASSERT(false, "Should not get to here.");
   }
 
+  /*
+   * SetSubtreeItemCounts() - Fills subtree counts of a new inner node with
+   *                          the current item counts of its children
+   *
+   * The children must have been installed
+   */
+  NO_ASAN void SetSubtreeItemCounts(InnerNode *inner_node_p) {
+    for (int i = 0; i < inner_node_p->GetSize(); i++) {
+      const KeyNodeIDPair &next_key_pair =
+          (i + 1 < inner_node_p->GetSize()) ? inner_node_p->At(i + 1) : inner_node_p->GetHighKeyPair();
+
+      inner_node_p->SubtreeCountBegin()[i].store(GetSeparatorItemCount(inner_node_p->At(i).second, next_key_pair));
+    }
+  }
+
+  /*
+   * RefreshSubtreeItemCount() - Recounts the separator that covers the current
+   *                             node on the parent base node
+   *
+   * This is called after the current node is consolidated, so that changes
+   * of leaves reach their parents, and changes of inner nodes reach the level
+   * above when they are consolidated. If the separator of the node was posted
+   * by a split after the parent was consolidated, then the separator before
+   * it on the base node covers the node. Nothing is done if the parent has a
+   * merge delta
+   */
+  NO_ASAN void RefreshSubtreeItemCount(Context *context_p) {
+    if (context_p->IsOnRootNode()) {
+      return;
+    }
+
+    const NodeSnapshot *snapshot_p = GetLatestNodeSnapshot(context_p);
+    const BaseNode *top_node_p = GetLatestParentNodeSnapshot(context_p)->node_p;
+    const BaseNode *parent_node_p = top_node_p;
+
+    while (parent_node_p->GetType() != NodeType::InnerType) {
+      if (parent_node_p->GetType() == NodeType::InnerMergeType) {
+        return;
+      }
+
+      parent_node_p = static_cast<const DeltaNode *>(parent_node_p)->child_node_p;
+    }
+
+    const auto *inner_node_p = static_cast<const InnerNode *>(parent_node_p);
+    const KeyNodeIDPair *it = inner_node_p->Begin();
+
+    // The low key of the leftmost child is not compared
+    if (it->second != snapshot_p->node_id) {
+      it = NodeKeyUpperBound(inner_node_p, inner_node_p->Begin() + 1, inner_node_p->End(),
+                             snapshot_p->node_p->GetLowKey()) -
+           1;
+
+      if ((it != inner_node_p->Begin()) && IsSeparatorDeleted(top_node_p, *it)) {
+        return;
+      }
+    }
+
+    const KeyNodeIDPair &next_key_pair = (it + 1 != inner_node_p->End()) ? *(it + 1) : inner_node_p->GetHighKeyPair();
+
+    inner_node_p->SubtreeCountBegin()[it - inner_node_p->Begin()].store(
+        GetSeparatorItemCount(it->second, next_key_pair));
+  }
+
+  /*
+   * GetSeparatorItemCount() - Returns the number of items from the low key of
+   *                           a node to the next separator
+   *
+   * The node and its right siblings are counted until the next separator, which
+   * are more than one node if the node was split after the separator was posted.
+   * A key pair with INVALID_NODE_ID is +Inf
+   */
+  NO_ASAN uint64_t GetSeparatorItemCount(NodeID node_id, const KeyNodeIDPair &next_key_pair) {
+    const BaseNode *node_p = GetNode(node_id);
+    uint64_t count = GetSubtreeItemCount(node_p);
+
+    while (true) {
+      const KeyNodeIDPair &high_key_pair = node_p->GetHighKeyPair();
+
+      if ((high_key_pair.second == INVALID_NODE_ID) ||
+          ((next_key_pair.second != INVALID_NODE_ID) && KeyCmpGreaterEqual(high_key_pair.first, next_key_pair.first))) {
+        break;
+      }
+
+      node_p = GetNode(high_key_pair.second);
+      count += GetSubtreeItemCount(node_p);
+    }
+
+    return count;
+  }
+
+  /*
+   * GetSubtreeItemCount() - Returns the number of items under a logical node
+   *
+   * This is exact for a leaf node, since every leaf delta records the item
+   * count of the logical node. An inner node sums up the subtree counts on its
+   * base node(s), which are as recent as the last consolidation of the
+   * children (see RefreshSubtreeItemCount())
+   *
+   * A removed node is counted as empty, since its items belong to its left
+   * sibling
+   */
+  NO_ASAN uint64_t GetSubtreeItemCount(const BaseNode *node_p) const {
+    NodeType type = node_p->GetType();
+
+    if ((type == NodeType::LeafRemoveType) || (type == NodeType::InnerRemoveType)) {
+      return 0;
+    }
+
+    if (node_p->IsOnLeafDeltaChain()) {
+      return node_p->GetItemCount();
+    }
+
+    return CountItemsBeforeOnInner(node_p, node_p->GetHighKeyPair());
+  }
+
+  /*
+   * CountItemsBeforeOnInner() - Returns the number of items under separators
+   *                             < the given key on an inner delta chain
+   *
+   * A key pair with INVALID_NODE_ID is +Inf. Delta records do not carry
+   * subtree counts, so the count of a separator on the base node covers all
+   * separators that are posted after it by later splits
+   */
+  NO_ASAN uint64_t CountItemsBeforeOnInner(const BaseNode *node_p, const KeyNodeIDPair &key_pair) const {
+    while (node_p->GetType() != NodeType::InnerType) {
+      if (node_p->GetType() == NodeType::InnerMergeType) {
+        const auto *merge_node_p = static_cast<const InnerMergeNode *>(node_p);
+
+        // Separators of the right branch start from the merge key
+        if ((key_pair.second == INVALID_NODE_ID) || KeyCmpGreater(key_pair.first, merge_node_p->delete_item.first)) {
+          return CountItemsBeforeOnInner(merge_node_p->child_node_p, merge_node_p->delete_item) +
+                 CountItemsBeforeOnInner(merge_node_p->right_merge_p, key_pair);
+        }
+      }
+
+      node_p = static_cast<const DeltaNode *>(node_p)->child_node_p;
+    }
+
+    const auto *inner_node_p = static_cast<const InnerNode *>(node_p);
+
+    // The first separator is the low key which is never compared
+    const KeyNodeIDPair *end_p = inner_node_p->End();
+    if (key_pair.second != INVALID_NODE_ID) {
+      end_p = std::lower_bound(inner_node_p->Begin() + 1, inner_node_p->End(), key_pair, key_node_id_pair_cmp_obj);
+    }
+
+    uint64_t count = 0;
+    for (int i = 0; i < end_p - inner_node_p->Begin(); i++) {
+      count += inner_node_p->SubtreeCountBegin()[i].load();
+    }
+
+    return count;
+  }
+
   /*
    * NavigateLeafNode() - Find search key on a logical leaf node and collect
    *                      values associated with the key
@@ -3681,6 +5981,35 @@ class BwTree : public BwTreeBase {
    * map insert conflict
    */
   NO_ASAN void NavigateLeafNode(Context *context_p, std::vector<ValueType> &value_list) {
+    auto visitor = [&value_list](const ValueType &value) {
+      value_list.push_back(value);
+
+      return true;
+    };
+
+    NavigateLeafNodeByVisitor(context_p, visitor);
+  }
+
+  /*
+   * NavigateLeafNodeByVisitor() - Find search key on a logical leaf node and
+   *                               pass values associated with the key to
+   *                               a visitor
+   *
+   * The visitor is called as bool visitor(const ValueType &) once for each
+   * value. If it returns false then no more value is visited. Every value
+   * is visited only after it is known to be present, so stopping early never
+   * reports a deleted value
+   *
+   * This function does not allocate any memory from the heap
+   */
+  template <typename ValueVisitor>
+  NO_ASAN void NavigateLeafNodeByVisitor(Context *context_p, ValueVisitor &visitor) {
+    if constexpr (UniqueKey) {
+      NavigateLeafNodeUnique(context_p, visitor);
+
+      return;
+    }
+
     // This will go to the right sibling until we have seen
     // a node whose range match the search key
     NavigateSiblingChain(context_p);
@@ -3741,11 +6070,23 @@ class BwTree : public BwTreeBase {
           // Here we know the search key < high key of current node
           // NOTE: We only compare keys here, so it will get to the first
           // element >= search key
-          auto copy_start_it =
-              std::lower_bound(start_it, end_it, std::make_pair(search_key, ValueType{}), key_value_pair_cmp_obj);
+          auto copy_start_it = KeyLowerBound(start_it, end_it, search_key);
+          auto copy_end_it = KeyRunEnd(copy_start_it, leaf_node_p->End(), search_key);
+
+          // Without any value on the delta chain, the run of the search key
+          // is visited as a contiguous array
+          if ((present_set.GetSize() == 0) && (deleted_set.GetSize() == 0)) {
+            for (; copy_start_it != copy_end_it; copy_start_it++) {
+              if (!visitor(copy_start_it->second)) {
+                return;
+              }
+            }
+
+            return;
+          }
 
           // If there is something to copy
-          while ((copy_start_it != leaf_node_p->End()) && (KeyCmpEqual(search_key, copy_start_it->first))) {
+          while (copy_start_it != copy_end_it) {
             // If the value has not been deleted then just insert
             // Note that here we use ValueSet, so need to extract value from
             // the key value pair
@@ -3757,7 +6098,9 @@ class BwTree : public BwTreeBase {
                 // definitely will not block the remaining values, since we
                 // know they do not duplicate inside the leaf node
 
-                value_list.push_back(copy_start_it->second);
+                if (!visitor(copy_start_it->second)) {
+                  return;
+                }
               }
             }
 
@@ -3777,7 +6120,9 @@ class BwTree : public BwTreeBase {
               if (!present_set.Exists(insert_node_p->item.second)) {
                 present_set.Insert(insert_node_p->item.second);
 
-                value_list.push_back(insert_node_p->item.second);
+                if (!visitor(insert_node_p->item.second)) {
+                  return;
+                }
               }
             }
           } else if (KeyCmpGreater(search_key, insert_node_p->item.first)) {
@@ -3807,6 +6152,35 @@ class BwTree : public BwTreeBase {
 
           break;
         }  // case LeafDeleteType
+        case NodeType::LeafUpdateType: {
+          const auto *update_node_p = static_cast<const LeafUpdateNode *>(node_p);
+
+          // An update is an insert of the new value and a delete of the
+          // old value at the same time
+          if (KeyCmpEqual(search_key, update_node_p->item.first)) {
+            if (!deleted_set.Exists(update_node_p->item.second)) {
+              if (!present_set.Exists(update_node_p->item.second)) {
+                present_set.Insert(update_node_p->item.second);
+
+                if (!visitor(update_node_p->item.second)) {
+                  return;
+                }
+              }
+            }
+
+            if (!present_set.Exists(update_node_p->old_item.second)) {
+              deleted_set.Insert(update_node_p->old_item.second);
+            }
+          } else if (KeyCmpGreater(search_key, update_node_p->item.first)) {
+            start_index = update_node_p->GetIndexPair().first;
+          } else {
+            end_index = update_node_p->GetIndexPair().first;
+          }
+
+          node_p = update_node_p->child_node_p;
+
+          break;
+        }  // case LeafUpdateType
         case NodeType::LeafRemoveType: {
           INDEX_LOG_ERROR("ERROR: Observed LeafRemoveNode in delta chain");
 
@@ -3857,47 +6231,25 @@ class BwTree : public BwTreeBase {
   }
 
   /*
-   * NavigateLeafNode() - Check existence for a certain value
-   *
-   * Please note that this function is overloaded. This version is used for
-   * insert/delete/update that only checks existence of values, rather than
-   * collecting all values for a single key.
-   *
-   * If return value is nullptr, then the key-value pair is not found. Otherwise
-   * a pointer to the matching item is returned. The caller should check return
-   * value and act accordingly.
-   *
-   * This function works by traversing down the delta chain and compare
-   * values with those in delta nodes and in the base node. No special data
-   * structure is required
+   * NavigateLeafNodeUnique() - NavigateLeafNodeByVisitor() for trees with
+   *                            unique keys
    *
-   * This function calls JumpToNodeID() to switch to a split sibling node
-   * There are possibility that the switch aborts, and in this case this
-   * function returns with value false.
+   * Since a key has at most one value, the topmost record of the search key
+   * on the delta chain decides the result, and no present or deleted value
+   * set is needed. On the base node a single lower_bound() is performed
    */
-  NO_ASAN const KeyValuePair *NavigateLeafNode(Context *context_p, const ValueType &search_value,
-                                               std::pair<int, bool> *index_pair_p, bool unique_key = false) {
-    // This will go to the right sibling until we have seen
-    // a node whose range match the search key
+  template <typename ValueVisitor>
+  NO_ASAN void NavigateLeafNodeUnique(Context *context_p, ValueVisitor &visitor) {
     NavigateSiblingChain(context_p);
 
-    // If navigating sibling chain aborts then abort here
     if (context_p->abort_flag) {
-      return nullptr;
+      return;
     }
 
-    /////////////////////////////////////////////////////////////////
-    // Only after this point could we get snapshot and node_p
-    /////////////////////////////////////////////////////////////////
-
-    // Snapshot pointer, node pointer, and metadata reference all need
-    // updating once LoadNodeID() returns with success
     NodeSnapshot *snapshot_p = GetLatestNodeSnapshot(context_p);
     NOISEPAGE_ASSERT(snapshot_p->IsLeaf(), "Must be a leaf node.");
 
     const BaseNode *node_p = snapshot_p->node_p;
-
-    // Save some typing
     const KeyType &search_key = context_p->search_key;
 
     while (1) {
@@ -3907,38 +6259,154 @@ class BwTree : public BwTreeBase {
         case NodeType::LeafType: {
           const auto *leaf_node_p = static_cast<const LeafNode *>(node_p);
 
-          // Here we know the search key < high key of current node
-          // NOTE: We only compare keys here, so it will get to the first
-          // element >= search key
-          auto scan_start_it = std::lower_bound(leaf_node_p->Begin(), leaf_node_p->End(),
-                                                std::make_pair(search_key, ValueType{}), key_value_pair_cmp_obj);
+          auto it = KeyLowerBound(leaf_node_p->Begin(), leaf_node_p->End(), search_key);
 
-          // Search all values with the search key
-          while ((scan_start_it != leaf_node_p->End()) && (KeyCmpEqual(scan_start_it->first, search_key))) {
-            // If there is a value matching the search value then return true
-            // We do not need to check any delete set here, since if the
-            // value has been deleted earlier then this function would
-            // already have returned
-            if (unique_key || ValueCmpEqual(scan_start_it->second, search_value)) {
-              // Since only Delete() will use this piece of information
-              // we set exist flag to false to indicate that the value
-              // has been invalidated
-              index_pair_p->first = scan_start_it - leaf_node_p->Begin();
-              index_pair_p->second = true;
+          if ((it != leaf_node_p->End()) && KeyCmpEqual(it->first, search_key)) {
+            visitor(it->second);
+          }
 
-              // Return a pointer to the item inside LeafNode;
-              // This pointer should remain valid until epoch is exited
-              return &(*scan_start_it);
-            }
+          return;
+        }  // case LeafType
+        case NodeType::LeafInsertType:
+        case NodeType::LeafUpdateType: {
+          const auto *data_node_p = static_cast<const LeafDataNode *>(node_p);
 
-            scan_start_it++;
+          if (KeyCmpEqual(search_key, data_node_p->item.first)) {
+            visitor(data_node_p->item.second);
+
+            return;
           }
 
-          // Either key does not exist or key exists but value does not
-          // exist will reach here
-          // Since only Insert() will use the index we set exist flag to false
-          index_pair_p->first = scan_start_it - leaf_node_p->Begin();
-          index_pair_p->second = false;
+          node_p = data_node_p->child_node_p;
+
+          break;
+        }  // case LeafInsertType / LeafUpdateType
+        case NodeType::LeafDeleteType: {
+          const auto *delete_node_p = static_cast<const LeafDeleteNode *>(node_p);
+
+          // The only value of the key has been deleted
+          if (KeyCmpEqual(search_key, delete_node_p->item.first)) {
+            return;
+          }
+
+          node_p = delete_node_p->child_node_p;
+
+          break;
+        }  // case LeafDeleteType
+        case NodeType::LeafRemoveType: {
+          INDEX_LOG_ERROR("ERROR: Observed LeafRemoveNode in delta chain");
+
+          NOISEPAGE_ASSERT(false, "Observed LeafRemoveNode in delta chain.");
+          [[fallthrough]];
+        }  // case LeafRemoveType
+        case NodeType::LeafMergeType: {
+          const auto *merge_node_p = static_cast<const LeafMergeNode *>(node_p);
+
+          if (KeyCmpGreaterEqual(search_key, merge_node_p->delete_item.first)) {
+            node_p = merge_node_p->right_merge_p;
+          } else {
+            node_p = merge_node_p->child_node_p;
+          }
+
+          break;
+        }  // case LeafMergeType
+        case NodeType::LeafSplitType: {
+          node_p = static_cast<const LeafSplitNode *>(node_p)->child_node_p;
+
+          break;
+        }  // case LeafSplitType
+        default: {
+          INDEX_LOG_ERROR("ERROR: Unknown leaf delta node type: %d", static_cast<int>(node_p->GetType()));
+
+          NOISEPAGE_ASSERT(false, "Unknown leaf delta node type.");
+        }  // default
+      }    // switch
+    }      // while
+  }
+
+  /*
+   * NavigateLeafNode() - Check existence for a certain value
+   *
+   * Please note that this function is overloaded. This version is used for
+   * insert/delete/update that only checks existence of values, rather than
+   * collecting all values for a single key.
+   *
+   * If return value is nullptr, then the key-value pair is not found. Otherwise
+   * a pointer to the matching item is returned. The caller should check return
+   * value and act accordingly.
+   *
+   * This function works by traversing down the delta chain and compare
+   * values with those in delta nodes and in the base node. No special data
+   * structure is required
+   *
+   * This function calls JumpToNodeID() to switch to a split sibling node
+   * There are possibility that the switch aborts, and in this case this
+   * function returns with value false.
+   */
+  NO_ASAN const KeyValuePair *NavigateLeafNode(Context *context_p, const ValueType &search_value,
+                                               std::pair<int, bool> *index_pair_p, bool unique_key = false) {
+    // This will go to the right sibling until we have seen
+    // a node whose range match the search key
+    NavigateSiblingChain(context_p);
+
+    // If navigating sibling chain aborts then abort here
+    if (context_p->abort_flag) {
+      return nullptr;
+    }
+
+    /////////////////////////////////////////////////////////////////
+    // Only after this point could we get snapshot and node_p
+    /////////////////////////////////////////////////////////////////
+
+    // Snapshot pointer, node pointer, and metadata reference all need
+    // updating once LoadNodeID() returns with success
+    NodeSnapshot *snapshot_p = GetLatestNodeSnapshot(context_p);
+    NOISEPAGE_ASSERT(snapshot_p->IsLeaf(), "Must be a leaf node.");
+
+    const BaseNode *node_p = snapshot_p->node_p;
+
+    // Save some typing
+    const KeyType &search_key = context_p->search_key;
+
+    while (1) {
+      NodeType type = node_p->GetType();
+
+      switch (type) {
+        case NodeType::LeafType: {
+          const auto *leaf_node_p = static_cast<const LeafNode *>(node_p);
+
+          // Here we know the search key < high key of current node
+          // NOTE: We only compare keys here, so it will get to the first
+          // element >= search key
+          auto scan_start_it = KeyLowerBound(leaf_node_p->Begin(), leaf_node_p->End(), search_key);
+          auto scan_end_it = KeyRunEnd(scan_start_it, leaf_node_p->End(), search_key);
+
+          // Search all values with the search key
+          while (scan_start_it != scan_end_it) {
+            // If there is a value matching the search value then return true
+            // We do not need to check any delete set here, since if the
+            // value has been deleted earlier then this function would
+            // already have returned
+            if (unique_key || ValueCmpEqual(scan_start_it->second, search_value)) {
+              // Since only Delete() will use this piece of information
+              // we set exist flag to false to indicate that the value
+              // has been invalidated
+              index_pair_p->first = scan_start_it - leaf_node_p->Begin();
+              index_pair_p->second = true;
+
+              // Return a pointer to the item inside LeafNode;
+              // This pointer should remain valid until epoch is exited
+              return &(*scan_start_it);
+            }
+
+            scan_start_it++;
+          }
+
+          // Either key does not exist or key exists but value does not
+          // exist will reach here
+          // Since only Insert() will use the index we set exist flag to false
+          index_pair_p->first = scan_start_it - leaf_node_p->Begin();
+          index_pair_p->second = false;
 
           return nullptr;
         }  // case LeafType
@@ -3977,6 +6445,29 @@ class BwTree : public BwTreeBase {
 
           break;
         }  // case LeafDeleteType
+        case NodeType::LeafUpdateType: {
+          const auto *update_node_p = static_cast<const LeafUpdateNode *>(node_p);
+
+          if (KeyCmpEqual(search_key, update_node_p->item.first)) {
+            // The new value exists, and for unique key the key exists
+            if (unique_key || ValueCmpEqual(update_node_p->item.second, search_value)) {
+              *index_pair_p = update_node_p->GetIndexPair();
+
+              return &update_node_p->item;
+            }
+
+            // The old value has been replaced which is the same as deleted
+            if (ValueCmpEqual(update_node_p->old_item.second, search_value)) {
+              *index_pair_p = update_node_p->GetIndexPair();
+
+              return nullptr;
+            }
+          }
+
+          node_p = update_node_p->child_node_p;
+
+          break;
+        }  // case LeafUpdateType
         case NodeType::LeafRemoveType: {
           INDEX_LOG_ERROR("ERROR: Observed LeafRemoveNode in delta chain");
 
@@ -4047,11 +6538,14 @@ class BwTree : public BwTreeBase {
    * If only one condition are true then it depends on the order we
    * traverse the delta chain and leaf data node, and could not be
    * guaranteed a specific order
+   *
+   * If unique_key is true then any present value of the key is treated as
+   * existing after the predicate is tested on it
    */
   NO_ASAN const KeyValuePair *NavigateLeafNode(Context *context_p, const ValueType &value,
                                                std::pair<int, bool> *index_pair_p,
                                                std::function<bool(const ValueType)> predicate,
-                                               bool *predicate_satisfied) {
+                                               bool *predicate_satisfied, bool unique_key = false) {
     // NOTE: We do not have to traverse to the right sibling here
     // since Traverse() already traverses to the right sibling
     // if value pointer given to it is nullptr
@@ -4083,10 +6577,10 @@ class BwTree : public BwTreeBase {
         case NodeType::LeafType: {
           const auto *leaf_node_p = static_cast<const LeafNode *>(node_p);
 
-          auto copy_start_it = std::lower_bound(leaf_node_p->Begin(), leaf_node_p->End(),
-                                                std::make_pair(search_key, ValueType{}), key_value_pair_cmp_obj);
+          auto copy_start_it = KeyLowerBound(leaf_node_p->Begin(), leaf_node_p->End(), search_key);
+          auto copy_end_it = KeyRunEnd(copy_start_it, leaf_node_p->End(), search_key);
 
-          while ((copy_start_it != leaf_node_p->End()) && (KeyCmpEqual(search_key, copy_start_it->first))) {
+          while (copy_start_it != copy_end_it) {
             if (!deleted_set.Exists(copy_start_it->second)) {
               if (!present_set.Exists(copy_start_it->second)) {
                 // If the predicate is satified by the value
@@ -4097,7 +6591,7 @@ class BwTree : public BwTreeBase {
 
                   return nullptr;
                 }
-                if (static_cast<bool>(value_eq_obj(value, copy_start_it->second))) {
+                if (unique_key || static_cast<bool>(value_eq_obj(value, copy_start_it->second))) {
                   // We will not insert anyway....
                   return &(*copy_start_it);
                 }
@@ -4133,7 +6627,7 @@ class BwTree : public BwTreeBase {
                   // Could return here since we know the predicate is satisfied
                   return nullptr;
                 }
-                if (static_cast<bool>(value_eq_obj(value, insert_node_p->item.second))) {
+                if (unique_key || static_cast<bool>(value_eq_obj(value, insert_node_p->item.second))) {
                   // Could also return here since we know the value exists
                   // and we could not insert anyway
                   return &insert_node_p->item;
@@ -4161,6 +6655,36 @@ class BwTree : public BwTreeBase {
 
           break;
         }  // case LeafDeleteType
+        case NodeType::LeafUpdateType: {
+          const auto *update_node_p = static_cast<const LeafUpdateNode *>(node_p);
+
+          if (KeyCmpEqual(search_key, update_node_p->item.first)) {
+            // The new value is treated as in LeafInsertNode
+            if (!deleted_set.Exists(update_node_p->item.second)) {
+              if (!present_set.Exists(update_node_p->item.second)) {
+                present_set.Insert(update_node_p->item.second);
+
+                if (predicate(update_node_p->item.second)) {
+                  *predicate_satisfied = true;
+
+                  return nullptr;
+                }
+                if (unique_key || static_cast<bool>(value_eq_obj(value, update_node_p->item.second))) {
+                  return &update_node_p->item;
+                }
+              }
+            }
+
+            // ... and the old value as in LeafDeleteNode
+            if (!present_set.Exists(update_node_p->old_item.second)) {
+              deleted_set.Insert(update_node_p->old_item.second);
+            }
+          }
+
+          node_p = update_node_p->child_node_p;
+
+          break;
+        }  // case LeafUpdateType
         case NodeType::LeafRemoveType: {
           INDEX_LOG_ERROR("ERROR: Observed LeafRemoveNode in delta chain");
 
@@ -4236,6 +6760,24 @@ class BwTree : public BwTreeBase {
 
     NOISEPAGE_ASSERT(leaf_node_p != nullptr, "Leaf node must not be a nullptr.");
 
+    CollectAllValuesOnLeafInto(node_p, leaf_node_p);
+
+    // Item count would not change during consolidation
+    NOISEPAGE_ASSERT(leaf_node_p->GetSize() == node_p->GetItemCount(),
+                   "Item count would not change during consolidation.");
+
+    return leaf_node_p;
+  }
+
+  /*
+   * CollectAllValuesOnLeafInto() - Replay the delta chain of a logical leaf
+   *                                node into an output object
+   *
+   * The output could be a LeafNode, or any type that provides the same
+   * PushBack() interface such as KeyValuePairBuffer
+   */
+  template <typename OutputType>
+  NO_ASAN void CollectAllValuesOnLeafInto(const BaseNode *node_p, OutputType *output_p) {
     /////////////////////////////////////////////////////////////////
     // Prepare Delta Set
     /////////////////////////////////////////////////////////////////
@@ -4248,7 +6790,8 @@ class BwTree : public BwTreeBase {
     // and those in the data list of leaf page do not need to be
     // put in the set
     // This is used to dedup already seen key-value pairs
-    const KeyValuePair *delta_set_data_p[delta_change_num];
+    // NOTE: LeafUpdateNode adds two items into the set
+    const KeyValuePair *delta_set_data_p[delta_change_num * 2];
 
     // This set is used as the set for deduplicating already seen
     // key value pairs
@@ -4295,13 +6838,7 @@ class BwTree : public BwTreeBase {
 
     // We collect all valid values in present_set
     // and deleted_set is just for bookkeeping
-    CollectAllValuesOnLeafRecursive(node_p, sss, delta_set, leaf_node_p);
-
-    // Item count would not change during consolidation
-    NOISEPAGE_ASSERT(leaf_node_p->GetSize() == node_p->GetItemCount(),
-                   "Item count would not change during consolidation.");
-
-    return leaf_node_p;
+    CollectAllValuesOnLeafRecursive(node_p, sss, delta_set, output_p);
   }
 
   /*
@@ -4323,9 +6860,9 @@ class BwTree : public BwTreeBase {
    * DO NOT CALL THIS DIRECTLY - Always use the wrapper (the one without
    * "Recursive" suffix)
    */
-  template <typename T>  // To let the compiler deduce type of sss
+  template <typename T, typename OutputType>  // To let the compiler deduce type of sss
   NO_ASAN void CollectAllValuesOnLeafRecursive(const BaseNode *node_p, T &sss, KeyValuePairBloomFilter &delta_set,
-                                               LeafNode *new_leaf_node_p) const {
+                                               OutputType *new_leaf_node_p) const {
     // The top node is used to derive high key
     // NOTE: Low key for Leaf node and its delta chain is nullptr
     const KeyNodeIDPair &high_key_pair = node_p->GetHighKeyPair();
@@ -4412,9 +6949,10 @@ class BwTree : public BwTreeBase {
               // IndexPair.second == true if the value has been overwritten
               item_overwritten = item_overwritten || sss.GetFront()->GetIndexPair().second;
 
-              // We only insert those in LeafInsertNode
+              // We only insert those in LeafInsertNode and LeafUpdateNode
               // and ignore all LeafDeleteNode
-              if (sss.GetFront()->GetType() == NodeType::LeafInsertType) {
+              if ((sss.GetFront()->GetType() == NodeType::LeafInsertType) ||
+                  (sss.GetFront()->GetType() == NodeType::LeafUpdateType)) {
                 // We remove the element from sss here
                 new_leaf_node_p->PushBack(sss.PopFront()->item);
               } else {
@@ -4468,6 +7006,26 @@ class BwTree : public BwTreeBase {
 
           break;
         }  // case LeafDeleteType
+        case NodeType::LeafUpdateType: {
+          const auto *update_node_p = static_cast<const LeafUpdateNode *>(node_p);
+
+          // If the new value was later deleted then that delete node
+          // inherits our index pair and overwrites the old item instead
+          if (!delta_set.Exists(update_node_p->item)) {
+            delta_set.Insert(update_node_p->item);
+
+            sss.InsertNoDedup(update_node_p);
+          }
+
+          // The old item is hidden from deltas below
+          if (!delta_set.Exists(update_node_p->old_item)) {
+            delta_set.Insert(update_node_p->old_item);
+          }
+
+          node_p = update_node_p->child_node_p;
+
+          break;
+        }  // case LeafUpdateType
         case NodeType::LeafRemoveType: {
           INDEX_LOG_ERROR("ERROR: LeafRemoveNode not allowed");
 
@@ -4777,8 +7335,11 @@ class BwTree : public BwTreeBase {
       return;
     }
 
-    // This does not abort
-    TryConsolidateNode(context_p);
+    // This does not abort. The parent snapshot is only valid here, but not
+    // when jumping to siblings in read optimized traversal
+    if (TryConsolidateNode(context_p)) {
+      RefreshSubtreeItemCount(context_p);
+    }
 
     AdjustNodeSize(context_p);
   }
@@ -4965,7 +7526,115 @@ class BwTree : public BwTreeBase {
     NOISEPAGE_ASSERT(false, "Cannot reach here.");
   }
 
-  NO_ASAN void TraverseReadOptimized(Context *context_p, std::vector<ValueType> *value_list_p) {
+  /*
+   * TraverseBIFromParent() - Finds the leaf node left to the search key
+   *                          starting from a cached parent node
+   *
+   * Leaf nodes only link to their right sibling, so without a hint backward
+   * iteration has to call TraverseBI() from the root for every leaf page.
+   * Consecutive leaf pages mostly share the same parent, so backward scans
+   * remember the parent NodeID of the current page and navigate the parent
+   * directly with NavigateInnerNodeBI().
+   *
+   * The parent is only a hint: it might have been split, merged or even
+   * recycled since it was read. We only accept a leaf whose range lies
+   * directly left of the search key, and do not help along nodes that are
+   * being removed. In all these cases this function returns false and the
+   * caller should fall back to TraverseBI() with the same context
+   *
+   * On success the leaf is the current snapshot of the context, and the
+   * parent is the parent snapshot, as with TraverseBI()
+   */
+  NO_ASAN bool TraverseBIFromParent(NodeID parent_id, Context *context_p) {
+    if (parent_id == INVALID_NODE_ID) {
+      return false;
+    }
+
+    const KeyType &search_key = context_p->search_key;
+    const BaseNode *parent_p = GetNode(parent_id);
+    if (parent_p == nullptr) {
+      return false;
+    }
+
+    NodeType parent_type = parent_p->GetType();
+
+    // The NodeID might have been recycled for a leaf node
+    if (parent_p->IsOnLeafDeltaChain() || (parent_type == NodeType::InnerRemoveType) ||
+        (parent_type == NodeType::InnerAbortType)) {
+      return false;
+    }
+
+    // If the search key is not above the low key of the parent then the left
+    // leaf is under another parent; If it is beyond the high key then the
+    // current leaf has moved to another parent
+    //
+    // The low key of the leftmost parent is not a valid key, and since the
+    // leftmost leaf is never removed the parent is the leftmost one iff its
+    // leftmost child is the first leaf
+    bool is_leftmost = (parent_p->GetLowKeyNodeID() == first_leaf_id);
+    if ((!is_leftmost && KeyCmpLessEqual(search_key, parent_p->GetLowKey())) ||
+        ((parent_p->GetNextNodeID() != INVALID_NODE_ID) && KeyCmpGreater(search_key, parent_p->GetHighKey()))) {
+      return false;
+    }
+
+    context_p->current_snapshot.node_id = parent_id;
+    context_p->current_snapshot.node_p = parent_p;
+
+#ifdef BWTREE_DEBUG
+    context_p->current_level = 0;
+#endif
+
+    // Since search key <= high key this will not go right on the parent level
+    NodeID child_id = NavigateInnerNodeBI(context_p);
+    NOISEPAGE_ASSERT(!context_p->abort_flag, "Should not jump on the parent level.");
+
+#ifdef BWTREE_DEBUG
+    // TraverseBI() expects the default value if we fall back to it
+    context_p->current_level = -1;
+#endif
+
+    const BaseNode *node_p = GetNode(child_id);
+
+    // The left leaf might have been split, with the separator not yet
+    // posted on the parent
+    while (1) {
+      if (!node_p->IsOnLeafDeltaChain() || (node_p->GetType() == NodeType::LeafRemoveType)) {
+        return false;
+      }
+
+      if ((node_p->GetNextNodeID() == INVALID_NODE_ID) || KeyCmpLessEqual(search_key, node_p->GetHighKey())) {
+        break;
+      }
+
+      child_id = node_p->GetNextNodeID();
+      node_p = GetNode(child_id);
+    }
+
+    // This happens if the parent is stale and its child has been merged
+    if ((node_p->GetLowKeyPair().second != INVALID_NODE_ID) && !KeyCmpLess(node_p->GetLowKey(), search_key)) {
+      return false;
+    }
+
+    context_p->parent_snapshot = context_p->current_snapshot;
+    context_p->current_snapshot.node_id = child_id;
+    context_p->current_snapshot.node_p = node_p;
+
+#ifdef BWTREE_DEBUG
+    context_p->current_level = 1;
+#endif
+
+    return true;
+  }
+
+  /*
+   * TraverseReadOptimized() - Read-only traversal that passes values of the
+   *                           search key to a visitor
+   *
+   * See NavigateLeafNodeByVisitor() for the protocol of the visitor. If
+   * visitor_p is nullptr then we only stop on the leaf page
+   */
+  template <typename ValueVisitor>
+  NO_ASAN void TraverseReadOptimized(Context *context_p, ValueVisitor *visitor_p) {
   retry_traverse:
     NOISEPAGE_ASSERT(!context_p->abort_flag, "Abort flag should not be set.");
 #ifdef BWTREE_DEBUG
@@ -5021,10 +7690,10 @@ class BwTree : public BwTreeBase {
       if (snapshot_p->IsLeaf()) {
         INDEX_LOG_TRACE("The next node is a leaf (RO)");
 
-        if (value_list_p == nullptr) {
+        if (visitor_p == nullptr) {
           NavigateSiblingChain(context_p);
         } else {
-          NavigateLeafNode(context_p, *value_list_p);
+          NavigateLeafNodeByVisitor(context_p, *visitor_p);
         }
 
         if (context_p->abort_flag) {
@@ -5435,7 +8104,15 @@ class BwTree : public BwTreeBase {
 
           // Allocate a new node ID for the newly created node
           // If CAS fails we need to free the root ID
-          NodeID new_root_id = GetNextNodeID();
+          NodeID new_root_id = GetNextNodeID(false, INVALID_NODE_ID, snapshot_p->node_id);
+
+          // The split sibling stays reachable through the split delta, and
+          // the root split is tried again by a later traversal
+          if (new_root_id == INVALID_NODE_ID) {
+            INDEX_LOG_TRACE("Could not map a new root node. CONTINUE");
+
+            return;
+          }
 
           // InnerNode requires high key pair which is +Inf, INVALID NODE ID
           // low key pair will be set inside the constructor to be pointing
@@ -5455,6 +8132,7 @@ class BwTree : public BwTreeBase {
           // left most inner node), another points to its split sibling
           inner_node_p->PushBack(first_item);
           inner_node_p->PushBack(*insert_item_p);
+          SetSubtreeItemCounts(inner_node_p);
 
           // First we need to install the new node with NodeID
           // This makes it visible
@@ -5660,7 +8338,7 @@ class BwTree : public BwTreeBase {
    * always abort and start from the beginning, to keep delta chain length
    * upper bound intact
    */
-  NO_ASAN void TryConsolidateNode(Context *context_p) {
+  NO_ASAN bool TryConsolidateNode(Context *context_p) {
     NodeSnapshot *snapshot_p = GetLatestNodeSnapshot(context_p);
 
     // Do not overwrite this pointer since we will use this
@@ -5677,7 +8355,7 @@ class BwTree : public BwTreeBase {
       // JumpToLeftSibling())
       // NOISEPAGE_ASSERT(node_p->metadata.depth == 0);
 
-      return;
+      return false;
     }
 
     // If depth does not exceed threshold then we check recommendation flag
@@ -5685,17 +8363,19 @@ class BwTree : public BwTreeBase {
 
     if (snapshot_p->IsLeaf()) {
       if (depth < GetLeafDeltaChainLengthThreshold()) {
-        return;
+        return false;
       }
     } else {
       if (depth < GetInnerDeltaChainLengthThreshold()) {
-        return;
+        return false;
       }
     }
 
     // After this point we decide to consolidate node
 
     ConsolidateNode(snapshot_p);
+
+    return true;
   }
 
   /*
@@ -5773,7 +8453,18 @@ class BwTree : public BwTreeBase {
         const KeyType &split_key = new_leaf_node_p->At(0).first;
 
         // If leaf split fails this should be recyced using a fake remove node
-        NodeID new_node_id = GetNextNodeID();
+        NodeID new_node_id = GetNextNodeID(true, INVALID_NODE_ID, node_id);
+
+        // If the sibling could not be mapped then the leaf is left oversized
+        // and a later traversal tries again. The sibling is not visible to
+        // other threads but is freed through GC as below
+        if (new_node_id == INVALID_NODE_ID) {
+          INDEX_LOG_TRACE("Could not map leaf split sibling. CONTINUE");
+
+          epoch_manager.AddGarbageNode(new_leaf_node_p);
+
+          return;
+        }
 
         // Note that although split node only stores the new node ID
         // we still need its pointer to compute item_count
@@ -5919,7 +8610,16 @@ class BwTree : public BwTreeBase {
           return;
         }
 
-        NodeID new_node_id = GetNextNodeID();
+        NodeID new_node_id = GetNextNodeID(false, context_p->parent_snapshot.node_id, node_id);
+
+        // Same as for leaf nodes
+        if (new_node_id == INVALID_NODE_ID) {
+          INDEX_LOG_TRACE("Could not map inner split sibling. CONTINUE");
+
+          epoch_manager.AddGarbageNode(new_inner_node_p);
+
+          return;
+        }
 
         const InnerSplitNode *split_node_p = InnerInlineAllocateOfType(
             InnerSplitNode, node_p, std::make_pair(split_key, new_node_id), node_p, new_inner_node_p);
@@ -6554,14 +9254,234 @@ class BwTree : public BwTreeBase {
   }
 
   /*
-   * Insert() - Insert a key-value pair
-   *
-   * This function returns false if value already exists
-   * If CAS fails this function retries until it succeeds
+   * GetBulkLoadNodeNum() - Returns the number of nodes BulkLoad() uses to
+   *                        hold a given number of items on one level
+   *
+   * Each node is filled to BULK_LOAD_FILL_FACTOR of the upper threshold, but
+   * never to or below the lower threshold (which would trigger a merge) and
+   * never to or above the upper threshold (which would trigger a split)
+   */
+  NO_ASAN size_t GetBulkLoadNodeNum(size_t item_num, int upper_threshold, int lower_threshold) const {
+    auto target = static_cast<int>(upper_threshold * BULK_LOAD_FILL_FACTOR);
+    target = std::min(std::max(target, lower_threshold + 1), upper_threshold - 1);
+    target = std::max(target, 2);
+
+    return std::max<size_t>(1UL, (item_num + target - 1) / target);
+  }
+
+  /*
+   * BulkLoad() - Populate an empty tree from a sorted range of key-value pairs
+   *
+   * Leaf nodes and then inner nodes are packed bottom-up to
+   * BULK_LOAD_FILL_FACTOR of their upper size threshold, linked through their
+   * high key NodeID, and installed directly into the mapping table. No delta
+   * record, consolidation or SMO is involved. As in LeafNode::GetSplitSibling()
+   * items with the same key are never separated on two leaf nodes.
+   *
+   * The range must be sorted by key in ascending order and must not contain
+   * the same key-value pair twice. The root NodeID and the first leaf NodeID
+   * are preserved, so iterators and GC work as usual after the load.
+   *
+   * Return false without modifying the tree if the tree is not empty, or if
+   * the mapping table could not map the NodeIDs of the new nodes
+   *
+   * NOTE: This function is not thread-safe. It must be called before the tree
+   * is accessed by any other thread
+   */
+  template <typename IteratorType>
+  NO_ASAN bool BulkLoad(IteratorType begin_it, IteratorType end_it) {
+    INDEX_LOG_TRACE("BulkLoad called");
+
+
+    const BaseNode *old_root_p = GetNode(root_id.load());
+    const BaseNode *old_leaf_p = GetNode(first_leaf_id);
+
+    // We could only replace the layout created by InitNodeLayout()
+    if ((index_size.load() != 0) || (old_root_p->GetType() != NodeType::InnerType) ||
+        (old_root_p->GetItemCount() != 1) || (old_leaf_p->GetType() != NodeType::LeafType) ||
+        (old_leaf_p->GetItemCount() != 0)) {
+      INDEX_LOG_ERROR("BulkLoad() could only be called on an empty tree");
+      return false;
+    }
+
+    if (begin_it == end_it) {
+      return true;
+    }
+
+    auto item_num = static_cast<size_t>(std::distance(begin_it, end_it));
+    size_t leaf_num = GetBulkLoadNodeNum(item_num, GetLeafNodeSizeUpperThreshold(), GetLeafNodeSizeLowerThreshold());
+
+    // First pass: find the start of each leaf node. Item counts are evenly
+    // distributed among the remaining leaves, and a run of equal keys is
+    // always kept in the leaf where it starts
+    std::vector<IteratorType> leaf_start_list{};
+    std::vector<int> leaf_size_list{};
+    size_t consumed_num = 0;
+    auto it = begin_it;
+
+    while (it != end_it) {
+      size_t leaf_left = std::max<size_t>(1UL, leaf_num - std::min(leaf_num, leaf_start_list.size()));
+      size_t target_size = (item_num - consumed_num + leaf_left - 1) / leaf_left;
+
+      leaf_start_list.push_back(it);
+
+      KeyType last_key = it->first;
+      size_t leaf_size = 0;
+      while ((it != end_it) && ((leaf_size < target_size) || KeyCmpEqual(it->first, last_key))) {
+        NOISEPAGE_ASSERT(KeyCmpLessEqual(last_key, it->first), "BulkLoad() input must be sorted by key.");
+
+        last_key = it->first;
+        leaf_size++;
+        it++;
+      }
+
+      leaf_size_list.push_back(static_cast<int>(leaf_size));
+      consumed_num += leaf_size;
+    }
+
+    // The first leaf keeps FIRST_LEAF_NODE_ID since iterators start there
+    std::vector<NodeID> leaf_id_list{};
+    leaf_id_list.reserve(leaf_start_list.size());
+    leaf_id_list.push_back(first_leaf_id);
+    for (size_t i = 1; i < leaf_start_list.size(); i++) {
+      leaf_id_list.push_back(GetNextNodeID(true, INVALID_NODE_ID, leaf_id_list.back()));
+    }
+
+    // NodeIDs of inner levels from the bottom; the top level is the root
+    // and reuses the root NodeID
+    std::vector<std::vector<NodeID>> inner_id_list_list{};
+    size_t child_num = leaf_start_list.size();
+    do {
+      size_t inner_num =
+          GetBulkLoadNodeNum(child_num, GetInnerNodeSizeUpperThreshold(), GetInnerNodeSizeLowerThreshold());
+
+      std::vector<NodeID> inner_id_list{};
+      inner_id_list.reserve(inner_num);
+      for (size_t i = 0; i < inner_num; i++) {
+        inner_id_list.push_back((inner_num == 1) ? root_id.load()
+                                                 : GetNextNodeID(false, INVALID_NODE_ID,
+                                                                 (i == 0) ? root_id.load() : inner_id_list.back()));
+      }
+
+      inner_id_list_list.push_back(std::move(inner_id_list));
+      child_num = inner_num;
+    } while (child_num > 1);
+
+    // All NodeIDs are taken before the initial nodes are replaced, such that
+    // the tree is unchanged if one could not be mapped
+    bool node_id_mapped = std::find(leaf_id_list.begin(), leaf_id_list.end(), INVALID_NODE_ID) == leaf_id_list.end();
+    for (const auto &inner_id_list : inner_id_list_list) {
+      node_id_mapped = node_id_mapped &&
+                       (std::find(inner_id_list.begin(), inner_id_list.end(), INVALID_NODE_ID) == inner_id_list.end());
+    }
+
+    if (!node_id_mapped) {
+      INDEX_LOG_ERROR("BulkLoad() could not map NodeIDs of new nodes");
+
+      for (size_t i = 1; i < leaf_id_list.size(); i++) {
+        if (leaf_id_list[i] != INVALID_NODE_ID) {
+          InvalidateNodeID(leaf_id_list[i]);
+        }
+      }
+      for (const auto &inner_id_list : inner_id_list_list) {
+        for (NodeID inner_id : inner_id_list) {
+          if ((inner_id != INVALID_NODE_ID) && (inner_id != root_id.load())) {
+            InvalidateNodeID(inner_id);
+          }
+        }
+      }
+
+      return false;
+    }
+
+    // The tree is exclusively owned by this thread so the initial nodes
+    // could be freed directly without going through the epoch manager
+    static_cast<const InnerNode *>(old_root_p)->~InnerNode();
+    static_cast<const InnerNode *>(old_root_p)->Destroy();
+    static_cast<const LeafNode *>(old_leaf_p)->~LeafNode();
+    static_cast<const LeafNode *>(old_leaf_p)->Destroy();
+
+    // Separators of the level being built; the first one of a level is
+    // always KeyType{} since it is never read (see InitNodeLayout())
+    std::vector<KeyNodeIDPair> child_list{};
+    child_list.reserve(leaf_start_list.size());
+
+    for (size_t i = 0; i < leaf_start_list.size(); i++) {
+      // The first leaf has -Inf as low key, others use the first key and
+      // a non-INVALID NodeID as is done for split siblings
+      KeyNodeIDPair low_key_pair = (i == 0) ? std::make_pair(KeyType{}, INVALID_NODE_ID)
+                                            : std::make_pair(leaf_start_list[i]->first, ~INVALID_NODE_ID);
+      KeyNodeIDPair high_key_pair = (i + 1 == leaf_start_list.size())
+                                        ? std::make_pair(KeyType{}, INVALID_NODE_ID)
+                                        : std::make_pair(leaf_start_list[i + 1]->first, leaf_id_list[i + 1]);
+
+      auto *leaf_node_p = reinterpret_cast<LeafNode *>(ElasticNode<KeyValuePair>::Get(
+          leaf_size_list[i], NodeType::LeafType, 0, leaf_size_list[i], low_key_pair, high_key_pair));
+
+      auto leaf_it = leaf_start_list[i];
+      for (int j = 0; j < leaf_size_list[i]; j++) {
+        leaf_node_p->PushBack(*leaf_it);
+        leaf_it++;
+      }
+
+      InstallNewNode(leaf_id_list[i], leaf_node_p);
+
+      child_list.push_back(std::make_pair(low_key_pair.first, leaf_id_list[i]));
+    }
+
+    // Build inner levels until a level fits in one node, which becomes the
+    // root
+    for (const auto &inner_id_list : inner_id_list_list) {
+      size_t inner_num = inner_id_list.size();
+
+      std::vector<KeyNodeIDPair> parent_list{};
+      parent_list.reserve(inner_num);
+      size_t child_index = 0;
+
+      for (size_t i = 0; i < inner_num; i++) {
+        size_t inner_left = inner_num - i;
+        size_t inner_size = (child_list.size() - child_index + inner_left - 1) / inner_left;
+        const KeyNodeIDPair *copy_start_p = child_list.data() + child_index;
+
+        KeyNodeIDPair high_key_pair = (i + 1 == inner_num)
+                                          ? std::make_pair(KeyType{}, INVALID_NODE_ID)
+                                          : std::make_pair(child_list[child_index + inner_size].first, inner_id_list[i + 1]);
+
+        // Low key of an inner node is its first separator
+        auto *inner_node_p = reinterpret_cast<InnerNode *>(ElasticNode<KeyNodeIDPair>::Get(
+            static_cast<int>(inner_size), NodeType::InnerType, 0, static_cast<int>(inner_size), *copy_start_p,
+            high_key_pair));
+        inner_node_p->PushBack(copy_start_p, copy_start_p + inner_size);
+        SetSubtreeItemCounts(inner_node_p);
+
+        InstallNewNode(inner_id_list[i], inner_node_p);
+
+        parent_list.push_back(std::make_pair(copy_start_p->first, inner_id_list[i]));
+        child_index += inner_size;
+      }
+
+      NOISEPAGE_ASSERT(child_index == child_list.size(), "All separators must be consumed.");
+
+      child_list.swap(parent_list);
+    }
+
+    index_size.store(item_num);
+
+    INDEX_LOG_TRACE("BulkLoad loaded %lu items into %lu leaf nodes", item_num, leaf_id_list.size());
+
+    return true;
+  }
+
+  /*
+   * Insert() - Insert a key-value pair
+   *
+   * This function returns false if value already exists
+   * If CAS fails this function retries until it succeeds
    *
    * Note that this function also takes a unique_key argument, to indicate whether
    * we allow the same key with different values. For a primary key index this
-   * should be set true. By default we allow non-unique key
+   * should be set true. By default we allow non-unique key. The argument is
+   * ignored if the tree is declared with UniqueKey = true
    */
   NO_ASAN bool Insert(const KeyType &key, const ValueType &value, bool unique_key = false) {
     INDEX_LOG_TRACE("Insert called");
@@ -6580,7 +9500,7 @@ class BwTree : public BwTreeBase {
       // Also if the key previously exists in the delta chain
       // then return the position of the node using next_key_p
       // if there is none then return nullptr
-      const KeyValuePair *item_p = Traverse(&context, &value, &index_pair, unique_key);
+      const KeyValuePair *item_p = Traverse(&context, &value, &index_pair, unique_key || UniqueKey);
 
       // If the key-value pair already exists then return false
       if (item_p != nullptr) {
@@ -6639,6 +9559,178 @@ class BwTree : public BwTreeBase {
     return true;
   }
 
+  /*
+   * InsertBatch() - Insert a batch of key-value pairs
+   *
+   * The batch is sorted by key, and then for each leaf node covering a part
+   * of the batch we traverse only once, and install all items belonging to
+   * that leaf with a single CAS. Instead of posting one LeafInsertNode per
+   * item, the existing delta chain and the new items are consolidated
+   * directly into a new LeafNode, which replaces the delta chain as in
+   * ConsolidateLeafNode(). If the new node is oversized it will be split by
+   * the following traversals in AdjustNodeSize()
+   *
+   * Items that already exist (or, when unique_key is true, items whose key
+   * already exists) are skipped as in Insert(). The return value is the
+   * number of items actually inserted
+   */
+  NO_ASAN size_t InsertBatch(const KeyValuePair *begin_p, const KeyValuePair *end_p, bool unique_key = false) {
+    INDEX_LOG_TRACE("InsertBatch called");
+
+    NOISEPAGE_ASSERT(begin_p <= end_p, "Invalid batch range.");
+
+    unique_key = unique_key || UniqueKey;
+
+    std::vector<KeyValuePair> batch{begin_p, end_p};
+
+    // Stable sort keeps values of the same key in their original order
+    std::stable_sort(batch.begin(), batch.end(), key_value_pair_cmp_obj);
+
+#ifdef BWTREE_DEBUG
+    insert_op_count.fetch_add(batch.size());
+#endif
+
+    EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+
+    size_t inserted_count = 0;
+    size_t start_index = 0;
+
+    while (start_index < batch.size()) {
+      Context context{batch[start_index].first};
+
+      // Stop on the leaf page that the first remaining key belongs to
+      Traverse(&context, nullptr, nullptr);
+
+      NodeSnapshot *snapshot_p = GetLatestNodeSnapshot(&context);
+      const BaseNode *node_p = snapshot_p->node_p;
+      NodeID node_id = snapshot_p->node_id;
+
+      // All following keys < high key also belong to this leaf
+      const KeyNodeIDPair &high_key_pair = node_p->GetHighKeyPair();
+      size_t end_index = start_index + 1;
+      while ((end_index < batch.size()) &&
+             ((high_key_pair.second == INVALID_NODE_ID) || KeyCmpLess(batch[end_index].first, high_key_pair.first))) {
+        end_index++;
+      }
+
+      // This is a private copy of the current content of the leaf
+      LeafNode *old_leaf_node_p = CollectAllValuesOnLeaf(snapshot_p);
+
+      // Mark items in the batch that should be inserted
+      std::vector<bool> accept_list(end_index - start_index, false);
+      int accept_count = 0;
+      for (size_t i = start_index; i < end_index; i++) {
+        const KeyValuePair &item = batch[i];
+
+        if (BatchItemExists(old_leaf_node_p, item, unique_key)) {
+          continue;
+        }
+
+        // Also dedup against previously accepted items of the same key,
+        // which are adjacent since the batch is sorted
+        bool duplicated = false;
+        for (size_t j = i; j > start_index; j--) {
+          const KeyValuePair &prev_item = batch[j - 1];
+          if (!KeyCmpEqual(prev_item.first, item.first)) {
+            break;
+          }
+
+          if (accept_list[j - 1 - start_index] && (unique_key || ValueCmpEqual(prev_item.second, item.second))) {
+            duplicated = true;
+            break;
+          }
+        }
+
+        if (!duplicated) {
+          accept_list[i - start_index] = true;
+          accept_count++;
+        }
+      }
+
+      if (accept_count == 0) {
+        old_leaf_node_p->~LeafNode();
+        old_leaf_node_p->Destroy();
+
+        start_index = end_index;
+        continue;
+      }
+
+      // Merge the old content and accepted items. For equal keys old
+      // items go first, which is the order consolidation would produce
+      int new_size = old_leaf_node_p->GetSize() + accept_count;
+      auto *new_leaf_node_p = reinterpret_cast<LeafNode *>(ElasticNode<KeyValuePair>::Get(
+          new_size, NodeType::LeafType, 0, new_size, node_p->GetLowKeyPair(), high_key_pair));
+
+      const KeyValuePair *old_it = old_leaf_node_p->Begin();
+      for (size_t i = start_index; i < end_index; i++) {
+        if (!accept_list[i - start_index]) {
+          continue;
+        }
+
+        while ((old_it != old_leaf_node_p->End()) && !KeyCmpLess(batch[i].first, old_it->first)) {
+          new_leaf_node_p->PushBack(*old_it);
+          old_it++;
+        }
+
+        new_leaf_node_p->PushBack(batch[i]);
+      }
+
+      new_leaf_node_p->PushBack(old_it, old_leaf_node_p->End());
+
+      NOISEPAGE_ASSERT(new_leaf_node_p->GetSize() == new_size, "Merged number of elements must match.");
+
+      // The private copy is never visible to other threads
+      old_leaf_node_p->~LeafNode();
+      old_leaf_node_p->Destroy();
+
+      bool ret = InstallNodeToReplace(node_id, new_leaf_node_p, node_p);
+      if (ret) {
+        INDEX_LOG_TRACE("Leaf batch insert CAS succeed");
+
+        epoch_manager.AddGarbageNode(node_p);
+
+        inserted_count += accept_count;
+        start_index = end_index;
+        continue;
+      }
+
+      INDEX_LOG_TRACE("Leaf batch insert CAS failed. Retry from the root");
+
+      new_leaf_node_p->~LeafNode();
+      new_leaf_node_p->Destroy();
+
+#ifdef BWTREE_DEBUG
+      insert_abort_count.fetch_add(context.abort_counter + 1);
+#endif
+    }
+
+    epoch_manager.LeaveEpoch(epoch_node_p);
+
+    index_size.fetch_add(inserted_count);
+    return inserted_count;
+  }
+
+  /*
+   * BatchItemExists() - Whether an item of the batch exists in a consolidated
+   *                     leaf node
+   *
+   * If unique_key is true then only the key is checked
+   */
+  NO_ASAN bool BatchItemExists(const LeafNode *leaf_node_p, const KeyValuePair &item, bool unique_key) {
+    const KeyValuePair *it =
+        std::lower_bound(leaf_node_p->Begin(), leaf_node_p->End(), item, key_value_pair_cmp_obj);
+
+    while ((it != leaf_node_p->End()) && KeyCmpEqual(it->first, item.first)) {
+      if (unique_key || ValueCmpEqual(it->second, item.second)) {
+        return true;
+      }
+
+      it++;
+    }
+
+    return false;
+  }
+
   /*
    * ConditionalInsert() - Insert a key-value pair only if a given
    *                       predicate fails for all values with a key
@@ -6650,211 +9742,1173 @@ class BwTree : public BwTreeBase {
    *
    * NOTE: We first test the predicate, and then test for duplicated values
    * so predicate test result is always available
+   *
+   * As with Insert(), if unique_key is true or the tree is declared with
+   * UniqueKey = true then any value of the key is a duplicate
    */
   NO_ASAN bool ConditionalInsert(const KeyType &key, const ValueType &value,
-                                 std::function<bool(const ValueType)> predicate, bool *predicate_satisfied) {
+                                 std::function<bool(const ValueType)> predicate, bool *predicate_satisfied,
+                                 bool unique_key = false) {
     INDEX_LOG_TRACE("Insert (cond.) called");
 
-#ifdef BWTREE_DEBUG
-    insert_op_count.fetch_add(1);
-#endif
+#ifdef BWTREE_DEBUG
+    insert_op_count.fetch_add(1);
+#endif
+
+    EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+
+    while (1) {
+      Context context{key};
+
+      // This will just stop on the correct leaf page
+      // without traversing into it. Next we manually traverse
+      Traverse(&context, nullptr, nullptr);
+
+      *predicate_satisfied = false;
+
+      // This is used to hold the index for which this delta will
+      // be applied to
+      std::pair<int, bool> index_pair;
+
+      // Call navigate leaf node to test predicate and to test duplicates
+      const KeyValuePair *item_p =
+          NavigateLeafNode(&context, value, &index_pair, predicate, predicate_satisfied, unique_key || UniqueKey);
+
+      // We do not insert anything if predicate is satisfied
+      if (*predicate_satisfied) {
+        epoch_manager.LeaveEpoch(epoch_node_p);
+
+        return false;
+      }
+      if (item_p != nullptr) {
+        epoch_manager.LeaveEpoch(epoch_node_p);
+
+        return false;
+      }
+
+      // This retrieves the most up-to-date snapshot (which does not change)
+      NodeSnapshot *snapshot_p = GetLatestNodeSnapshot(&context);
+
+      // We will CAS on top of this
+      const BaseNode *node_p = snapshot_p->node_p;
+      NodeID node_id = snapshot_p->node_id;
+
+      // Here since we could not know which is the next key node
+      // just use child node as a cpnservative way of inserting
+      const LeafInsertNode *insert_node_p =
+          LeafInlineAllocateOfType(LeafInsertNode, node_p, key, value, node_p, index_pair);
+
+      bool ret = InstallNodeToReplace(node_id, insert_node_p, node_p);
+      if (ret) {
+        INDEX_LOG_TRACE("Leaf Insert (cond.) delta CAS succeed");
+
+        // If install is a success then just break from the loop
+        // and return
+        break;
+      }
+
+      INDEX_LOG_TRACE("Leaf insert (cond.) delta CAS failed");
+
+#ifdef BWTREE_DEBUG
+
+      context.abort_counter++;
+
+#endif
+
+      insert_node_p->~LeafInsertNode();
+
+#ifdef BWTREE_DEBUG
+
+      insert_abort_count.fetch_add(context.abort_counter);
+
+#endif
+
+      INDEX_LOG_TRACE("Retry installing leaf insert (cond.) delta from the root");
+    }
+
+    epoch_manager.LeaveEpoch(epoch_node_p);
+
+    index_size.fetch_add(1);
+    return true;
+  }
+
+  /*
+   * Delete() - Remove a key-value pair from the tree
+   *
+   * This function returns false if the key and value pair does not
+   * exist. Return true if delete succeeds
+   *
+   * This functions shares a same structure with the Insert() one
+   */
+  NO_ASAN bool Delete(const KeyType &key, const ValueType &value) {
+    INDEX_LOG_TRACE("Delete called");
+
+#ifdef BWTREE_DEBUG
+    delete_op_count.fetch_add(1);
+#endif
+
+    EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+
+    while (1) {
+      Context context{key};
+      std::pair<int, bool> index_pair;
+
+      // Navigate leaf nodes to check whether the key-value
+      // pair exists
+      const KeyValuePair *item_p = Traverse(&context, &value, &index_pair);
+
+      if (item_p == nullptr) {
+        epoch_manager.LeaveEpoch(epoch_node_p);
+
+        return false;
+      }
+
+      NodeSnapshot *snapshot_p = GetLatestNodeSnapshot(&context);
+
+      // We will CAS on top of this
+      const BaseNode *node_p = snapshot_p->node_p;
+      NodeID node_id = snapshot_p->node_id;
+
+      const LeafDeleteNode *delete_node_p =
+          LeafInlineAllocateOfType(LeafDeleteNode, node_p, item_p->first, value, node_p, index_pair);
+
+      bool ret = InstallNodeToReplace(node_id, delete_node_p, node_p);
+      if (ret) {
+        INDEX_LOG_TRACE("Leaf Delete delta CAS succeed");
+
+        // If install is a success then just break from the loop
+        // and return
+        break;
+      }
+
+      INDEX_LOG_TRACE("Leaf Delete delta CAS failed");
+
+      delete_node_p->~LeafDeleteNode();
+
+#ifdef BWTREE_DEBUG
+
+      context.abort_counter++;
+
+#endif
+
+#ifdef BWTREE_DEBUG
+
+      delete_abort_count.fetch_add(context.abort_counter);
+
+#endif
+
+      // We reach here only because CAS failed
+      INDEX_LOG_TRACE("Retry installing leaf delete delta from the root");
+    }
+
+    epoch_manager.LeaveEpoch(epoch_node_p);
+
+    index_size.fetch_sub(1);
+    return true;
+  }
+
+  /*
+   * DeleteRange() - Remove all key-value pairs with low_key <= key <= high_key
+   *
+   * Instead of posting one LeafDeleteNode per item, each leaf node overlapping
+   * the range is replaced with a single CAS by a new LeafNode without the
+   * deleted items, as in InsertBatch(). Leaves fully covered by the range are
+   * replaced by an empty LeafNode without consolidating their delta chain.
+   * Underflowed leaves are then removed and merged into their left sibling
+   * by the SMO in AdjustNodeSize(), which we trigger by traversing to the
+   * leaf again. The return value is the number of items deleted
+   */
+  NO_ASAN size_t DeleteRange(const KeyType &low_key, const KeyType &high_key) {
+    INDEX_LOG_TRACE("DeleteRange called");
+
+    if (KeyCmpGreater(low_key, high_key)) {
+      return 0;
+    }
+
+    EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+
+    size_t deleted_count = 0;
+    KeyType start_key{low_key};
+
+    while (1) {
+      Context context{start_key};
+
+      // Stop on the leaf page that the remaining range starts from
+      Traverse(&context, nullptr, nullptr);
+
+      NodeSnapshot *snapshot_p = GetLatestNodeSnapshot(&context);
+      const BaseNode *node_p = snapshot_p->node_p;
+      NodeID node_id = snapshot_p->node_id;
+
+      const KeyNodeIDPair &low_key_pair = node_p->GetLowKeyPair();
+      const KeyNodeIDPair &high_key_pair = node_p->GetHighKeyPair();
+
+      // Whether there are leaf nodes after this one that overlap the range
+      bool has_next = (high_key_pair.second != INVALID_NODE_ID) && KeyCmpLessEqual(high_key_pair.first, high_key);
+
+      // All keys in [low key, high key) of the leaf are in the range
+      bool fully_covered = has_next && (low_key_pair.second != INVALID_NODE_ID) &&
+                           KeyCmpLessEqual(low_key, low_key_pair.first);
+
+      LeafNode *new_leaf_node_p;
+      int removed_num;
+
+      if (fully_covered) {
+        removed_num = node_p->GetItemCount();
+        new_leaf_node_p = reinterpret_cast<LeafNode *>(
+            ElasticNode<KeyValuePair>::Get(0, NodeType::LeafType, 0, 0, low_key_pair, high_key_pair));
+      } else {
+        // This is a private copy of the current content of the leaf
+        LeafNode *old_leaf_node_p = CollectAllValuesOnLeaf(snapshot_p);
+
+        KeyValuePair *delete_start_p = std::lower_bound(
+            old_leaf_node_p->Begin(), old_leaf_node_p->End(), std::make_pair(low_key, ValueType{}), key_value_pair_cmp_obj);
+        KeyValuePair *delete_end_p = std::upper_bound(
+            delete_start_p, old_leaf_node_p->End(), std::make_pair(high_key, ValueType{}), key_value_pair_cmp_obj);
+
+        removed_num = static_cast<int>(delete_end_p - delete_start_p);
+        new_leaf_node_p = nullptr;
+
+        if (removed_num != 0) {
+          int new_size = old_leaf_node_p->GetSize() - removed_num;
+          new_leaf_node_p = reinterpret_cast<LeafNode *>(ElasticNode<KeyValuePair>::Get(
+              new_size, NodeType::LeafType, 0, new_size, low_key_pair, high_key_pair));
+
+          new_leaf_node_p->PushBack(old_leaf_node_p->Begin(), delete_start_p);
+          new_leaf_node_p->PushBack(delete_end_p, old_leaf_node_p->End());
+        }
+
+        old_leaf_node_p->~LeafNode();
+        old_leaf_node_p->Destroy();
+      }
+
+      if (new_leaf_node_p != nullptr) {
+        bool ret = InstallNodeToReplace(node_id, new_leaf_node_p, node_p);
+        if (!ret) {
+          INDEX_LOG_TRACE("Leaf range delete CAS failed. Retry from the root");
+
+          new_leaf_node_p->~LeafNode();
+          new_leaf_node_p->Destroy();
+
+#ifdef BWTREE_DEBUG
+          delete_abort_count.fetch_add(context.abort_counter + 1);
+#endif
+
+          continue;
+        }
+
+        INDEX_LOG_TRACE("Leaf range delete CAS succeed");
+
+        epoch_manager.AddGarbageNode(node_p);
+
+        deleted_count += removed_num;
+
+#ifdef BWTREE_DEBUG
+        delete_op_count.fetch_add(removed_num);
+#endif
+
+        // Loading the leaf again posts the remove delta if it underflows
+        if (new_leaf_node_p->GetSize() <= LEAF_NODE_SIZE_LOWER_THRESHOLD) {
+          Context remove_context{start_key};
+          Traverse(&remove_context, nullptr, nullptr);
+        }
+      }
+
+      if (!has_next) {
+        break;
+      }
+
+      start_key = high_key_pair.first;
+    }
+
+    epoch_manager.LeaveEpoch(epoch_node_p);
+
+    index_size.fetch_sub(deleted_count);
+    return deleted_count;
+  }
+
+  /*
+   * Update() - Replace the value of a key-value pair with a new value
+   *
+   * This function returns false if the old key-value pair does not exist,
+   * or if the new key-value pair already exists. Otherwise a single
+   * LeafUpdateNode is installed, so there is no point in time at which
+   * neither the old nor the new value is visible
+   *
+   * This functions shares a same structure with the Delete() one
+   */
+  NO_ASAN bool Update(const KeyType &key, const ValueType &old_value, const ValueType &new_value) {
+    INDEX_LOG_TRACE("Update called");
+
+#ifdef BWTREE_DEBUG
+    update_op_count.fetch_add(1);
+#endif
+
+    EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+
+    while (1) {
+      Context context{key};
+      std::pair<int, bool> index_pair;
+
+      // The new value takes the index of the old value
+      const KeyValuePair *item_p = Traverse(&context, &old_value, &index_pair);
+
+      if (item_p == nullptr) {
+        epoch_manager.LeaveEpoch(epoch_node_p);
+
+        return false;
+      }
+
+      // Nothing to change
+      if (ValueCmpEqual(old_value, new_value)) {
+        epoch_manager.LeaveEpoch(epoch_node_p);
+
+        return true;
+      }
+
+      // Check the new value on the same snapshot we will CAS on
+      std::pair<int, bool> new_index_pair;
+      const KeyValuePair *new_item_p = NavigateLeafNode(&context, new_value, &new_index_pair);
+
+      // Traverse() has settled on the leaf so this should not happen, but
+      // if it does we simply retry
+      if (context.abort_flag) {
+        continue;
+      }
+
+      if (new_item_p != nullptr) {
+        epoch_manager.LeaveEpoch(epoch_node_p);
+
+        return false;
+      }
+
+      NodeSnapshot *snapshot_p = GetLatestNodeSnapshot(&context);
+
+      // We will CAS on top of this
+      const BaseNode *node_p = snapshot_p->node_p;
+      NodeID node_id = snapshot_p->node_id;
+
+      const LeafUpdateNode *update_node_p =
+          LeafInlineAllocateOfType(LeafUpdateNode, node_p, item_p->first, old_value, new_value, node_p, index_pair);
+
+      bool ret = InstallNodeToReplace(node_id, update_node_p, node_p);
+      if (ret) {
+        INDEX_LOG_TRACE("Leaf Update delta CAS succeed");
+
+        break;
+      }
+
+      INDEX_LOG_TRACE("Leaf Update delta CAS failed");
+
+      update_node_p->~LeafUpdateNode();
+
+#ifdef BWTREE_DEBUG
+
+      context.abort_counter++;
+
+      update_abort_count.fetch_add(context.abort_counter);
+
+#endif
+
+      INDEX_LOG_TRACE("Retry installing leaf update delta from the root");
+    }
+
+    epoch_manager.LeaveEpoch(epoch_node_p);
+
+    return true;
+  }
+
+  /*
+   * Upsert() - Insert a key-value pair, or replace the value if the key
+   *            already exists
+   *
+   * This is meant for unique key indices: if the key has more than one
+   * value then only one of them is replaced. The return value is true if a
+   * new key is inserted, and false if an existing value is replaced (or
+   * already equals the given value)
+   *
+   * Without UniqueKey a delete delta of one value does not mean that the
+   * key has no value, so the value to replace is the first one found to be
+   * present by the predicate version of NavigateLeafNode()
+   */
+  NO_ASAN bool Upsert(const KeyType &key, const ValueType &value) {
+    INDEX_LOG_TRACE("Upsert called");
+
+#ifdef BWTREE_DEBUG
+    update_op_count.fetch_add(1);
+#endif
+
+    EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+
+    bool inserted;
+
+    while (1) {
+      Context context{key};
+      std::pair<int, bool> index_pair;
+      const KeyValuePair *item_p;
+
+      if constexpr (UniqueKey) {
+        // Search for the key only
+        item_p = Traverse(&context, &value, &index_pair, true);
+      } else {
+        // This will just stop on the correct leaf page
+        Traverse(&context, nullptr, nullptr);
+
+        // The predicate is never satisfied, such that all present values
+        // are visited unless the given value is found
+        std::optional<ValueType> present_value;
+        bool predicate_satisfied = false;
+        item_p = NavigateLeafNode(
+            &context, value, &index_pair,
+            [&present_value](const ValueType present) {
+              if (!present_value.has_value()) {
+                present_value.emplace(present);
+              }
+
+              return false;
+            },
+            &predicate_satisfied);
+
+        // Find the value to replace on the same snapshot we will CAS on
+        if ((item_p == nullptr) && present_value.has_value()) {
+          item_p = NavigateLeafNode(&context, *present_value, &index_pair);
+
+          if (context.abort_flag) {
+            continue;
+          }
+        }
+      }
+
+      if ((item_p != nullptr) && ValueCmpEqual(item_p->second, value)) {
+        epoch_manager.LeaveEpoch(epoch_node_p);
+
+        return false;
+      }
+
+      NodeSnapshot *snapshot_p = GetLatestNodeSnapshot(&context);
+
+      // We will CAS on top of this
+      const BaseNode *node_p = snapshot_p->node_p;
+      NodeID node_id = snapshot_p->node_id;
+
+      const LeafDataNode *data_node_p;
+      if (item_p == nullptr) {
+        data_node_p = LeafInlineAllocateOfType(LeafInsertNode, node_p, key, value, node_p, index_pair);
+      } else {
+        data_node_p =
+            LeafInlineAllocateOfType(LeafUpdateNode, node_p, item_p->first, item_p->second, value, node_p, index_pair);
+      }
+
+      bool ret = InstallNodeToReplace(node_id, data_node_p, node_p);
+      if (ret) {
+        INDEX_LOG_TRACE("Leaf Upsert delta CAS succeed");
+
+        inserted = (item_p == nullptr);
+        break;
+      }
+
+      INDEX_LOG_TRACE("Leaf Upsert delta CAS failed");
+
+      if (item_p == nullptr) {
+        static_cast<const LeafInsertNode *>(data_node_p)->~LeafInsertNode();
+      } else {
+        static_cast<const LeafUpdateNode *>(data_node_p)->~LeafUpdateNode();
+      }
+
+#ifdef BWTREE_DEBUG
+
+      context.abort_counter++;
+
+      update_abort_count.fetch_add(context.abort_counter);
+
+#endif
+
+      INDEX_LOG_TRACE("Retry installing leaf upsert delta from the root");
+    }
+
+    epoch_manager.LeaveEpoch(epoch_node_p);
+
+    if (inserted) {
+      index_size.fetch_add(1);
+    }
+
+    return inserted;
+  }
+
+  /** GetSize() - Return the size of the BwTree. */
+  NO_ASAN uint64_t GetSize() const { return index_size.load(); }
+
+  /*
+   * GetValue() - Fill a value list with values stored
+   *
+   * This function accepts a value list as argument,
+   * and will copy all values into the list
+   *
+   * The return value is used to indicate whether the value set
+   * is empty or not
+   */
+  NO_ASAN void GetValue(const KeyType &search_key, std::vector<ValueType> &value_list) {
+    INDEX_LOG_TRACE("GetValue()");
+
+    VisitValue(search_key, [&value_list](const ValueType &value) {
+      value_list.push_back(value);
+
+      return true;
+    });
+  }
+
+  /*
+   * GetValue() - Return value in a ValueSet object
+   *
+   * This is used for verification in the benchmark test suite. Do not
+   * remove this method
+   */
+  NO_ASAN ValueSet GetValue(const KeyType &search_key) {
+    INDEX_LOG_TRACE("GetValue()");
+
+    EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+
+    Context context{search_key};
+
+    ValueSet value_set{10, value_hash_obj, value_eq_obj};
+    auto visitor = [&value_set](const ValueType &value) {
+      value_set.insert(value);
+
+      return true;
+    };
+
+    TraverseReadOptimized(&context, &visitor);
+
+    epoch_manager.LeaveEpoch(epoch_node_p);
+
+    return value_set;
+  }
+
+  /*
+   * VisitValue() - Pass values of a key to a visitor without copying them
+   *                into a container
+   *
+   * The visitor is called as bool visitor(const ValueType &) for each value
+   * of the key, and it could return false to stop visiting more values.
+   * The reference is only valid during the call. No memory is allocated
+   * from the heap by the lookup itself
+   */
+  template <typename ValueVisitor>
+  NO_ASAN void VisitValue(const KeyType &search_key, ValueVisitor &&visitor) {
+    INDEX_LOG_TRACE("VisitValue()");
+
+    EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+
+    Context context{search_key};
+
+    TraverseReadOptimized(&context, &visitor);
+
+    epoch_manager.LeaveEpoch(epoch_node_p);
+  }
+
+  /*
+   * Contains() - Whether there is at least one value for the key
+   */
+  NO_ASAN bool Contains(const KeyType &search_key) {
+    bool found = false;
+
+    VisitValue(search_key, [&found](const ValueType &value) {
+      (void)value;
+      found = true;
+
+      return false;
+    });
+
+    return found;
+  }
+
+  /*
+   * GetFirst() - Copy the first value found for the key
+   *
+   * This is meant for unique key indices. If the key has more than one value
+   * then which one is returned is unspecified. Return false if the key
+   * does not exist, in which case *value_p is not changed
+   */
+  NO_ASAN bool GetFirst(const KeyType &search_key, ValueType *value_p) {
+    bool found = false;
+
+    VisitValue(search_key, [&found, value_p](const ValueType &value) {
+      *value_p = value;
+      found = true;
+
+      return false;
+    });
+
+    return found;
+  }
+
+  /*
+   * GetValueBatch() - Look up a list of keys with interleaved traversals
+   *
+   * value_list is resized to the number of keys, and values of the i-th key
+   * are appended to value_list[i]. This function has the same semantics as
+   * calling GetValue() once for each key
+   *
+   * Keys are processed in groups of GET_VALUE_BATCH_GROUP_SIZE. Lookups in a
+   * group descend the tree one level at a time in lock-step: we first
+   * prefetch mapping table slots for all lookups, then prefetch the nodes,
+   * and only then read the nodes. In this way cache misses of independent
+   * lookups overlap instead of being serialized
+   */
+  NO_ASAN void GetValueBatch(const std::vector<KeyType> &key_list, std::vector<std::vector<ValueType>> &value_list) {
+    INDEX_LOG_TRACE("GetValueBatch()");
+
+    value_list.resize(key_list.size());
+
+    for (size_t group_start = 0; group_start < key_list.size(); group_start += GET_VALUE_BATCH_GROUP_SIZE) {
+      auto group_size =
+          static_cast<int>(std::min<size_t>(GET_VALUE_BATCH_GROUP_SIZE, key_list.size() - group_start));
+
+      EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+
+      TraverseReadOptimizedGroup(&key_list[group_start], &value_list[group_start], group_size);
+
+      epoch_manager.LeaveEpoch(epoch_node_p);
+    }
+  }
+
+  /*
+   * TraverseReadOptimizedGroup() - Interleaved version of
+   *                                TraverseReadOptimized()
+   *
+   * Each lookup in the group has its own context and follows exactly the
+   * same steps as TraverseReadOptimized(), including restarting from the
+   * root on abort. The only difference is that a step is taken for every
+   * lookup before any lookup takes the next step
+   *
+   * NOTE: Caller must have joined an epoch
+   */
+  NO_ASAN void TraverseReadOptimizedGroup(const KeyType *key_p, std::vector<ValueType> *value_list_p, int group_size) {
+    NOISEPAGE_ASSERT(group_size <= GET_VALUE_BATCH_GROUP_SIZE, "Group is too large.");
+
+    // Context could neither be copied nor moved, so we construct them in
+    // place on a stack buffer
+    alignas(Context) char context_buffer[sizeof(Context) * GET_VALUE_BATCH_GROUP_SIZE];
+    auto *context_list = reinterpret_cast<Context *>(context_buffer);
+
+    // Next NodeID to load for each lookup, or INVALID_NODE_ID if finished
+    NodeID node_id_list[GET_VALUE_BATCH_GROUP_SIZE];
+
+    for (int i = 0; i < group_size; i++) {
+      new (context_list + i) Context{key_p[i]};
+      node_id_list[i] = root_id.load();
+    }
+
+    int active_count = group_size;
+
+    while (active_count > 0) {
+      // Stage 1: Prefetch mapping table entries
+      for (int i = 0; i < group_size; i++) {
+        if (node_id_list[i] != INVALID_NODE_ID) {
+          __builtin_prefetch(&GetMappingTableEntry(node_id_list[i]));
+        }
+      }
+
+      // Stage 2: Prefetch node header and the beginning of its content
+      for (int i = 0; i < group_size; i++) {
+        if (node_id_list[i] != INVALID_NODE_ID) {
+          const BaseNode *node_p = GetNode(node_id_list[i]);
+
+          __builtin_prefetch(node_p);
+          __builtin_prefetch(reinterpret_cast<const char *>(node_p) + CACHE_LINE_SIZE);
+        }
+      }
+
+      // Stage 3: Load the node and take one step down the tree
+      for (int i = 0; i < group_size; i++) {
+        if (node_id_list[i] == INVALID_NODE_ID) {
+          continue;
+        }
+
+        Context *context_p = context_list + i;
+
+        LoadNodeIDReadOptimized(node_id_list[i], context_p);
+
+        if (!context_p->abort_flag) {
+          if (GetLatestNodeSnapshot(context_p)->IsLeaf()) {
+            NavigateLeafNode(context_p, value_list_p[i]);
+
+            if (!context_p->abort_flag) {
+              node_id_list[i] = INVALID_NODE_ID;
+              active_count--;
+
+              continue;
+            }
+          } else {
+            node_id_list[i] = NavigateInnerNode(context_p);
+
+            if (!context_p->abort_flag) {
+              continue;
+            }
+          }
+        }
+
+        INDEX_LOG_TRACE("Lookup in group aborts (RO). Restart from the root");
+
+        // Same as abort_traverse in TraverseReadOptimized()
+#ifdef BWTREE_DEBUG
+        context_p->current_level = -1;
+        context_p->abort_counter++;
+#endif
+
+        context_p->current_snapshot.node_id = INVALID_NODE_ID;
+        context_p->abort_flag = false;
+
+        node_id_list[i] = root_id.load();
+      }
+    }
+
+    for (int i = 0; i < group_size; i++) {
+      context_list[i].~Context();
+    }
+  }
+
+  /*
+   * ScanRange() - Visit all key-value pairs with low_key <= key <= high_key
+   *               in key order
+   *
+   * The visitor is called as bool visitor(const KeyType &, const ValueType &)
+   * and could return false to end the scan early. References are only valid
+   * during the call
+   *
+   * The whole scan runs inside one epoch. Leaf nodes without a delta chain
+   * are read in place; only leaves with deltas are replayed, into a buffer
+   * that is reused by all scans of the same thread. We move to the next leaf
+   * through the sibling NodeID, and only traverse from the root again when
+   * the sibling is being removed
+   *
+   * NOTE: Since the visitor runs inside the epoch, it should not block for
+   * a long time, which would delay garbage collection
+   */
+  template <typename ScanVisitor>
+  NO_ASAN void ScanRange(const KeyType &low_key, const KeyType &high_key, ScanVisitor &&visitor) {
+    INDEX_LOG_TRACE("ScanRange()");
+
+    if (KeyCmpGreater(low_key, high_key)) {
+      return;
+    }
+
+    // Take the thread's buffer out while the scan runs, such that a nested
+    // scan from inside the visitor would not overwrite it
+    static thread_local KeyValuePairBuffer thread_buffer{};
+    KeyValuePairBuffer buffer{std::move(thread_buffer)};
+
+    EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+
+    Context context{low_key};
+
+    // This stops on the leaf page containing low key
+    Traverse(&context, nullptr, nullptr);
+
+    const BaseNode *node_p = GetLatestNodeSnapshot(&context)->node_p;
+
+    // Items below this key have been visited (or are out of range)
+    KeyType start_key{low_key};
+
+    while (1) {
+      const KeyValuePair *start_p;
+      const KeyValuePair *end_p;
+
+      if (node_p->GetType() == NodeType::LeafType) {
+        // All items in a base node are within its range
+        const auto *leaf_node_p = static_cast<const LeafNode *>(node_p);
+
+        start_p = leaf_node_p->Begin();
+        end_p = leaf_node_p->End();
+      } else {
+        buffer.Clear();
+        CollectAllValuesOnLeafInto(node_p, &buffer);
+
+        start_p = buffer.Begin();
+        end_p = buffer.End();
+      }
+
+      // The first leaf, or a leaf found from the root after a merge,
+      // could contain keys that should be skipped
+      start_p = KeyLowerBound(start_p, end_p, start_key);
+
+      bool finished = false;
+      for (; start_p != end_p; start_p++) {
+        if (KeyCmpGreater(start_p->first, high_key) || !visitor(start_p->first, start_p->second)) {
+          finished = true;
+          break;
+        }
+      }
+
+      const KeyNodeIDPair &next_key_pair = node_p->GetHighKeyPair();
+
+      // Either this is the last leaf or the next leaf starts after high key
+      if (finished || (next_key_pair.second == INVALID_NODE_ID) || KeyCmpGreater(next_key_pair.first, high_key)) {
+        break;
+      }
+
+      start_key = next_key_pair.first;
+
+      node_p = GetSiblingOnLeaf(next_key_pair);
+    }
+
+    epoch_manager.LeaveEpoch(epoch_node_p);
+
+    buffer.Clear();
+    thread_buffer = std::move(buffer);
+  }
+
+  /*
+   * ScanRangeReverse() - Visit all key-value pairs with
+   *                      low_key <= key <= high_key in descending key order
+   *
+   * The visitor and the buffering of leaf nodes are the same as ScanRange().
+   * Values of the same key are visited in the reverse of their order in
+   * ScanRange()
+   *
+   * Since there is no left sibling link, the left leaf is found from the
+   * parent of the current leaf using TraverseBIFromParent(). We only
+   * traverse from the root once for every parent node, or when the
+   * parent is being modified
+   */
+  template <typename ScanVisitor>
+  NO_ASAN void ScanRangeReverse(const KeyType &low_key, const KeyType &high_key, ScanVisitor &&visitor) {
+    INDEX_LOG_TRACE("ScanRangeReverse()");
+
+    if (KeyCmpGreater(low_key, high_key)) {
+      return;
+    }
+
+    static thread_local KeyValuePairBuffer thread_buffer{};
+    KeyValuePairBuffer buffer{std::move(thread_buffer)};
 
     EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
 
-    while (1) {
-      Context context{key};
+    Context context{high_key};
 
-      // This will just stop on the correct leaf page
-      // without traversing into it. Next we manually traverse
-      Traverse(&context, nullptr, nullptr);
+    // This stops on the leaf page containing high key
+    Traverse(&context, nullptr, nullptr);
 
-      *predicate_satisfied = false;
+    const BaseNode *node_p = GetLatestNodeSnapshot(&context)->node_p;
+    NodeID parent_id = context.parent_snapshot.node_id;
 
-      // This is used to hold the index for which this delta will
-      // be applied to
-      std::pair<int, bool> index_pair;
+    // Items above this key have been visited (or are out of range). Only
+    // for the first leaf the key itself is included
+    KeyType end_key{high_key};
+    bool include_end_key = true;
 
-      // Call navigate leaf node to test predicate and to test duplicates
-      const KeyValuePair *item_p = NavigateLeafNode(&context, value, &index_pair, predicate, predicate_satisfied);
+    while (1) {
+      const KeyValuePair *start_p;
+      const KeyValuePair *end_p;
 
-      // We do not insert anything if predicate is satisfied
-      if (*predicate_satisfied) {
-        epoch_manager.LeaveEpoch(epoch_node_p);
+      if (node_p->GetType() == NodeType::LeafType) {
+        const auto *leaf_node_p = static_cast<const LeafNode *>(node_p);
 
-        return false;
-      }
-      if (item_p != nullptr) {
-        epoch_manager.LeaveEpoch(epoch_node_p);
+        start_p = leaf_node_p->Begin();
+        end_p = leaf_node_p->End();
+      } else {
+        buffer.Clear();
+        CollectAllValuesOnLeafInto(node_p, &buffer);
 
-        return false;
+        start_p = buffer.Begin();
+        end_p = buffer.End();
       }
 
-      // This retrieves the most up-to-date snapshot (which does not change)
-      NodeSnapshot *snapshot_p = GetLatestNodeSnapshot(&context);
+      // A leaf found after a merge could contain keys already visited
+      if (include_end_key) {
+        end_p = KeyUpperBound(start_p, end_p, end_key);
+      } else {
+        end_p = KeyLowerBound(start_p, end_p, end_key);
+      }
 
-      // We will CAS on top of this
-      const BaseNode *node_p = snapshot_p->node_p;
-      NodeID node_id = snapshot_p->node_id;
+      bool finished = false;
+      while (end_p != start_p) {
+        end_p--;
 
-      // Here since we could not know which is the next key node
-      // just use child node as a cpnservative way of inserting
-      const LeafInsertNode *insert_node_p =
-          LeafInlineAllocateOfType(LeafInsertNode, node_p, key, value, node_p, index_pair);
+        if (KeyCmpLess(end_p->first, low_key) || !visitor(end_p->first, end_p->second)) {
+          finished = true;
+          break;
+        }
+      }
 
-      bool ret = InstallNodeToReplace(node_id, insert_node_p, node_p);
-      if (ret) {
-        INDEX_LOG_TRACE("Leaf Insert (cond.) delta CAS succeed");
+      const KeyNodeIDPair &low_key_pair = node_p->GetLowKeyPair();
 
-        // If install is a success then just break from the loop
-        // and return
+      // Either this is the first leaf or the previous leaf ends before low key
+      if (finished || (low_key_pair.second == INVALID_NODE_ID) || KeyCmpLessEqual(low_key_pair.first, low_key)) {
         break;
       }
 
-      INDEX_LOG_TRACE("Leaf insert (cond.) delta CAS failed");
-
-#ifdef BWTREE_DEBUG
+      end_key = low_key_pair.first;
+      include_end_key = false;
 
-      context.abort_counter++;
+      Context prev_context{end_key};
 
-#endif
+      if (!TraverseBIFromParent(parent_id, &prev_context)) {
+        TraverseBI(&prev_context);
+      }
 
-      insert_node_p->~LeafInsertNode();
+      node_p = GetLatestNodeSnapshot(&prev_context)->node_p;
+      parent_id = prev_context.parent_snapshot.node_id;
+    }
 
-#ifdef BWTREE_DEBUG
+    epoch_manager.LeaveEpoch(epoch_node_p);
 
-      insert_abort_count.fetch_add(context.abort_counter);
+    buffer.Clear();
+    thread_buffer = std::move(buffer);
+  }
 
-#endif
+  /*
+   * CountRange() - Returns the number of key-value pairs with
+   *                low_key <= key <= high_key
+   *
+   * This is the difference of two root-to-leaf descents (see
+   * CountItemsBefore()), so it takes O(log n) time no matter how large the
+   * range is.
+   *
+   * NOTE: Inner nodes keep the item count of each child, which is only
+   * refreshed when the child is consolidated (see RefreshSubtreeItemCount()).
+   * So the result is an estimate that misses changes after the last
+   * consolidation of nodes on the two paths. The leaves on the boundary of
+   * the range are counted exactly, so a range inside one leaf is exact
+   */
+  NO_ASAN size_t CountRange(const KeyType &low_key, const KeyType &high_key) {
+    INDEX_LOG_TRACE("CountRange()");
 
-      INDEX_LOG_TRACE("Retry installing leaf insert (cond.) delta from the root");
+    if (KeyCmpGreater(low_key, high_key)) {
+      return 0;
     }
 
-    epoch_manager.LeaveEpoch(epoch_node_p);
+    uint64_t high_count = CountItemsBefore(high_key, true);
+    uint64_t low_count = CountItemsBefore(low_key, false);
 
-    index_size.fetch_add(1);
-    return true;
+    // Counts on the two paths could be refreshed at different times
+    return (high_count > low_count) ? high_count - low_count : 0;
   }
 
   /*
-   * Delete() - Remove a key-value pair from the tree
-   *
-   * This function returns false if the key and value pair does not
-   * exist. Return true if delete succeeds
+   * Rank() - Returns the number of key-value pairs whose key < the given key
    *
-   * This functions shares a same structure with the Insert() one
+   * This is the position of the first item with the given key (or the next
+   * larger key) in the key order. It takes O(log n) time, and is an estimate
+   * like CountRange()
    */
-  NO_ASAN bool Delete(const KeyType &key, const ValueType &value) {
-    INDEX_LOG_TRACE("Delete called");
+  NO_ASAN size_t Rank(const KeyType &key) {
+    INDEX_LOG_TRACE("Rank()");
 
-#ifdef BWTREE_DEBUG
-    delete_op_count.fetch_add(1);
-#endif
+    return CountItemsBefore(key, false);
+  }
+
+  /*
+   * CountItemsBefore() - Count items with key < the given key, or key <= the
+   *                      given key if include_key is true
+   *
+   * This goes down from the root to the leaf of the key. On each inner node
+   * the subtree counts of the elements before the child are added, and the
+   * leaf is counted exactly. A node that no longer covers the key after a
+   * split is counted as a whole before going right
+   */
+  NO_ASAN uint64_t CountItemsBefore(const KeyType &key, bool include_key) {
+    static thread_local KeyValuePairBuffer thread_buffer{};
+    KeyValuePairBuffer buffer{std::move(thread_buffer)};
 
     EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
 
+    const BaseNode *node_p = GetNode(root_id.load());
+    uint64_t count = 0;
+
     while (1) {
-      Context context{key};
-      std::pair<int, bool> index_pair;
+      const KeyNodeIDPair &high_key_pair = node_p->GetHighKeyPair();
 
-      // Navigate leaf nodes to check whether the key-value
-      // pair exists
-      const KeyValuePair *item_p = Traverse(&context, &value, &index_pair);
+      if ((high_key_pair.second != INVALID_NODE_ID) && KeyCmpGreaterEqual(key, high_key_pair.first)) {
+        count += GetSubtreeItemCount(node_p);
+        node_p = GetNode(high_key_pair.second);
 
-      if (item_p == nullptr) {
-        epoch_manager.LeaveEpoch(epoch_node_p);
+        continue;
+      }
 
-        return false;
+      NodeType type = node_p->GetType();
+
+      // Items of a removed node could still be read below the remove delta
+      if ((type == NodeType::LeafRemoveType) || (type == NodeType::InnerRemoveType)) {
+        node_p = static_cast<const DeltaNode *>(node_p)->child_node_p;
+      } else if (node_p->IsOnLeafDeltaChain()) {
+        break;
+      } else {
+        node_p = GetNode(LocateSeparatorWithCount(node_p, key, &count));
       }
+    }
 
-      NodeSnapshot *snapshot_p = GetLatestNodeSnapshot(&context);
+    const KeyValuePair *start_p;
+    const KeyValuePair *end_p;
 
-      // We will CAS on top of this
-      const BaseNode *node_p = snapshot_p->node_p;
-      NodeID node_id = snapshot_p->node_id;
+    if (node_p->GetType() == NodeType::LeafType) {
+      const auto *leaf_node_p = static_cast<const LeafNode *>(node_p);
 
-      const LeafDeleteNode *delete_node_p =
-          LeafInlineAllocateOfType(LeafDeleteNode, node_p, key, value, node_p, index_pair);
+      start_p = leaf_node_p->Begin();
+      end_p = leaf_node_p->End();
+    } else {
+      buffer.Clear();
+      CollectAllValuesOnLeafInto(node_p, &buffer);
 
-      bool ret = InstallNodeToReplace(node_id, delete_node_p, node_p);
-      if (ret) {
-        INDEX_LOG_TRACE("Leaf Delete delta CAS succeed");
+      start_p = buffer.Begin();
+      end_p = buffer.End();
+    }
 
-        // If install is a success then just break from the loop
-        // and return
-        break;
-      }
+    if (include_key) {
+      count += KeyUpperBound(start_p, end_p, key) - start_p;
+    } else {
+      count += KeyLowerBound(start_p, end_p, key) - start_p;
+    }
 
-      INDEX_LOG_TRACE("Leaf Delete delta CAS failed");
+    epoch_manager.LeaveEpoch(epoch_node_p);
 
-      delete_node_p->~LeafDeleteNode();
+    buffer.Clear();
+    thread_buffer = std::move(buffer);
 
-#ifdef BWTREE_DEBUG
+    return count;
+  }
 
-      context.abort_counter++;
+  /*
+   * LocateSeparatorWithCount() - Locate the child node for a key on an inner
+   *                              delta chain, and add the number of items
+   *                              under separators before it
+   *
+   * This only uses separators on base nodes, since delta records do not
+   * carry subtree counts. If the child has been split, then the caller goes
+   * right from it
+   */
+  NO_ASAN NodeID LocateSeparatorWithCount(const BaseNode *node_p, const KeyType &key, uint64_t *count_p) {
+    const BaseNode *top_node_p = node_p;
 
-#endif
+    while (node_p->GetType() != NodeType::InnerType) {
+      if (node_p->GetType() == NodeType::InnerMergeType) {
+        const auto *merge_node_p = static_cast<const InnerMergeNode *>(node_p);
 
-#ifdef BWTREE_DEBUG
+        if (KeyCmpGreaterEqual(key, merge_node_p->delete_item.first)) {
+          *count_p += CountItemsBeforeOnInner(merge_node_p->child_node_p, merge_node_p->delete_item);
+          node_p = merge_node_p->right_merge_p;
 
-      delete_abort_count.fetch_add(context.abort_counter);
+          continue;
+        }
+      }
 
-#endif
+      node_p = static_cast<const DeltaNode *>(node_p)->child_node_p;
+    }
 
-      // We reach here only because CAS failed
-      INDEX_LOG_TRACE("Retry installing leaf delete delta from the root");
+    const auto *inner_node_p = static_cast<const InnerNode *>(node_p);
+    const KeyNodeIDPair *it = NodeKeyUpperBound(inner_node_p, inner_node_p->Begin() + 1, inner_node_p->End(), key) - 1;
+
+    // The node of a deleted separator has been merged into its left sibling
+    while ((it != inner_node_p->Begin()) && IsSeparatorDeleted(top_node_p, *it)) {
+      it--;
     }
 
-    epoch_manager.LeaveEpoch(epoch_node_p);
+    for (int i = 0; i < it - inner_node_p->Begin(); i++) {
+      *count_p += inner_node_p->SubtreeCountBegin()[i].load();
+    }
 
-    index_size.fetch_sub(1);
-    return true;
+    return it->second;
   }
 
-  /** GetSize() - Return the size of the BwTree. */
-  NO_ASAN uint64_t GetSize() const { return index_size.load(); }
-
   /*
-   * GetValue() - Fill a value list with values stored
-   *
-   * This function accepts a value list as argument,
-   * and will copy all values into the list
+   * LocateSeparatorByRank() - Locate the child node for a position on an
+   *                           inner delta chain, and make the position
+   *                           relative to the child
    *
-   * The return value is used to indicate whether the value set
-   * is empty or not
+   * This is the counterpart of LocateSeparatorWithCount() for Select(). If
+   * the position is after all items then the last child is returned
    */
-  NO_ASAN void GetValue(const KeyType &search_key, std::vector<ValueType> &value_list) {
-    INDEX_LOG_TRACE("GetValue()");
+  NO_ASAN NodeID LocateSeparatorByRank(const BaseNode *node_p, uint64_t *rank_p) {
+    const BaseNode *top_node_p = node_p;
 
-    EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+    while (node_p->GetType() != NodeType::InnerType) {
+      if (node_p->GetType() == NodeType::InnerMergeType) {
+        const auto *merge_node_p = static_cast<const InnerMergeNode *>(node_p);
+        uint64_t left_count = CountItemsBeforeOnInner(merge_node_p->child_node_p, merge_node_p->delete_item);
 
-    Context context{search_key};
+        if (*rank_p >= left_count) {
+          *rank_p -= left_count;
+          node_p = merge_node_p->right_merge_p;
 
-    TraverseReadOptimized(&context, &value_list);
+          continue;
+        }
+      }
 
-    epoch_manager.LeaveEpoch(epoch_node_p);
+      node_p = static_cast<const DeltaNode *>(node_p)->child_node_p;
+    }
+
+    const auto *inner_node_p = static_cast<const InnerNode *>(node_p);
+
+    // Skip children that end at or before the position
+    int index = 0;
+    while (index + 1 < inner_node_p->GetSize()) {
+      uint64_t count = inner_node_p->SubtreeCountBegin()[index].load();
+      if (*rank_p < count) {
+        break;
+      }
+
+      *rank_p -= count;
+      index++;
+    }
+
+    // The node of a deleted separator has been merged into its left sibling
+    while ((index > 0) && IsSeparatorDeleted(top_node_p, inner_node_p->At(index))) {
+      index--;
+      *rank_p += inner_node_p->SubtreeCountBegin()[index].load();
+    }
+
+    return inner_node_p->At(index).second;
   }
 
   /*
-   * GetValue() - Return value in a ValueSet object
+   * IsSeparatorDeleted() - Returns whether a separator on a base node is
+   *                        deleted by a delta record on the inner delta chain
    *
-   * This is used for verification in the benchmark test suite. Do not
-   * remove this method
+   * The NodeID of a deleted separator could have been recycled, so it should
+   * not be followed. The first separator of a base node is never deleted
    */
-  NO_ASAN ValueSet GetValue(const KeyType &search_key) {
-    INDEX_LOG_TRACE("GetValue()");
+  NO_ASAN bool IsSeparatorDeleted(const BaseNode *node_p, const KeyNodeIDPair &item) const {
+    while (node_p->GetType() != NodeType::InnerType) {
+      if (node_p->GetType() == NodeType::InnerDeleteType) {
+        if (static_cast<const InnerDeleteNode *>(node_p)->item.second == item.second) {
+          return true;
+        }
+      } else if (node_p->GetType() == NodeType::InnerMergeType) {
+        const auto *merge_node_p = static_cast<const InnerMergeNode *>(node_p);
 
-    EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+        if (KeyCmpGreaterEqual(item.first, merge_node_p->delete_item.first)) {
+          node_p = merge_node_p->right_merge_p;
 
-    Context context{search_key};
+          continue;
+        }
+      }
+
+      node_p = static_cast<const DeltaNode *>(node_p)->child_node_p;
+    }
 
-    std::vector<ValueType> value_list{};
-    TraverseReadOptimized(&context, &value_list);
+    return false;
+  }
 
-    epoch_manager.LeaveEpoch(epoch_node_p);
+  /*
+   * GetSiblingOnLeaf() - Returns the right sibling of a leaf node given its
+   *                      high key pair
+   *
+   * If the sibling is being removed then its items are being merged into its
+   * left sibling, and we find them from the root. In this case the returned
+   * node might also contain keys < the high key
+   */
+  NO_ASAN const BaseNode *GetSiblingOnLeaf(const KeyNodeIDPair &high_key_pair) {
+    const BaseNode *next_node_p = GetNode(high_key_pair.second);
 
-    ValueSet value_set{value_list.begin(), value_list.end(), 10, value_hash_obj, value_eq_obj};
+    if (next_node_p->GetType() == NodeType::LeafRemoveType) {
+      Context next_context{high_key_pair.first};
 
-    return value_set;
+      Traverse(&next_context, nullptr, nullptr);
+
+      next_node_p = GetLatestNodeSnapshot(&next_context)->node_p;
+    }
+
+    return next_node_p;
   }
 
   ///////////////////////////////////////////////////////////////////
@@ -6922,13 +10976,36 @@ class BwTree : public BwTreeBase {
   NodeID first_leaf_id;
 
   std::atomic<NodeID> next_unused_node_id;
-  std::atomic<const BaseNode *> *mapping_table;
 
-  // This list holds free NodeID which was removed by remove delta
-  // We recycle NodeID in epoch manager
+  // A NodeID in the cluster taken most recently for inner (0) and leaf (1)
+  // nodes (see GetNextNodeID())
+  std::atomic<NodeID> latest_cluster_node_id[2];
+
+  // Directory of mapping table chunks (see GetMappingTableEntry())
+  std::atomic<std::atomic<const BaseNode *> *> mapping_table[MAPPING_TABLE_CHUNK_COUNT];
+
+  // Free masks of NodeID clusters of each mapping table chunk (see
+  // GetNodeIDClusterMask())
+  std::atomic<std::atomic<uint64_t> *> node_id_cluster_mask_table[MAPPING_TABLE_CHUNK_COUNT];
+
+  // These stacks hold full batches of free NodeIDs which were removed by
+  // remove delta, and empty batches to be reused
+  // We recycle NodeID in epoch manager (see InvalidateNodeID())
+  AtomicLinkedStack<NodeIDBatch> free_node_id_batch_stack;
+  AtomicLinkedStack<NodeIDBatch> empty_node_id_batch_stack;
+
+  // All batches ever allocated (see AllocateNodeIDBatch())
+  std::atomic<NodeIDBatch *> node_id_batch_list_p;
+
+  // The batch of threads without a GC slot, i.e. the epoch manager
+  NodeIDBatch *unregistered_node_id_batch_p;
 
-  std::mutex node_id_list_lock;
-  std::deque<NodeID> node_id_list;
+  // Garbage nodes freed by the epoch manager from shared epochs, which are
+  // reused by threads that have no free garbage node in their GC slot
+  AtomicLinkedStack<GarbageNode> free_garbage_node_stack;
+
+  // All garbage node slabs ever allocated (see AllocateGarbageNode())
+  std::atomic<GarbageNodeSlab *> garbage_node_slab_list_p;
 
   std::atomic<uint64_t> insert_op_count;
   std::atomic<uint64_t> insert_abort_count;
@@ -6959,17 +11036,6 @@ class BwTree : public BwTreeBase {
     // Garbage collection interval (milliseconds)
     constexpr static int GC_INTERVAL = 50;
 
-    /*
-     * struct GarbageNode - A linked list of garbages
-     */
-    struct GarbageNode {
-      const BaseNode *node_p;
-
-      // This does not have to be atomic, since we only
-      // insert at the head of garbage list
-      GarbageNode *next_p;
-    };
-
     /*
      * struct EpochNode - A linked list of epoch node that records thread count
      *
@@ -6990,6 +11056,14 @@ class BwTree : public BwTreeBase {
       // This does not need to be atomic since it is
       // only maintained by the epoch thread
       EpochNode *next_p;
+
+      // The global epoch of the tree when this epoch node is created, which
+      // no thread joining this epoch node could be earlier than
+      uint64_t start_epoch;
+
+      // The global epoch of the tree when this epoch node is cleared, which
+      // no garbage node in this epoch node could be deleted after
+      uint64_t clear_epoch;
     };
 
     // The head pointer does not need to be atomic
@@ -7001,6 +11075,22 @@ class BwTree : public BwTreeBase {
     // acceptable that allocations are delayed to the next epoch
     EpochNode *current_epoch_p;
 
+    // Cleared epoch nodes whose garbage could still be seen by threads with
+    // a GC slot, in the order of clear_epoch. Only accessed by epoch manager
+    EpochNode *pending_head_p;
+    EpochNode *pending_tail_p;
+
+    // The start epoch of the oldest epoch node that has not been cleared,
+    // i.e. a lower bound of the epochs of threads in shared epoch nodes
+    std::atomic<uint64_t> shared_min_epoch;
+
+    // Freed epoch nodes to be reused by CreateNewEpoch(). Only accessed by
+    // epoch manager. Their thread counts stay negative, such that a thread
+    // joining with a stale epoch pointer retries as if they were cleaned.
+    // The count is never reset, since such a thread might not have undone
+    // its increment yet
+    EpochNode *free_epoch_p;
+
     // This flag indicates whether the destructor is running
     // If it is true then GC thread should not clean
     // Therefore, strict ordering is required
@@ -7039,6 +11129,7 @@ class BwTree : public BwTreeBase {
      * might take a long time
      */
     NO_ASAN EpochManager(BwTree *p_tree_p) : tree_p{p_tree_p} {
+      free_epoch_p = nullptr;
       current_epoch_p = new EpochNode{};
 
       // These two are atomic variables but we could
@@ -7047,9 +11138,15 @@ class BwTree : public BwTreeBase {
       current_epoch_p->garbage_list_p = nullptr;
 
       current_epoch_p->next_p = nullptr;
+      current_epoch_p->start_epoch = tree_p->GetGlobalEpoch();
+      current_epoch_p->clear_epoch = 0UL;
 
       head_epoch_p = current_epoch_p;
 
+      pending_head_p = nullptr;
+      pending_tail_p = nullptr;
+      shared_min_epoch.store(current_epoch_p->start_epoch);
+
       // We allocate and run this later
       thread_p = nullptr;
 
@@ -7068,32 +11165,7 @@ class BwTree : public BwTreeBase {
      * and we neither wait nor free the pointer.
      */
     NO_ASAN ~EpochManager() {
-      // Set stop flag and let thread terminate
-      // Also if there is an external GC thread then it should
-      // check this flag everytime it does cleaning since otherwise
-      // the un-thread-safe function ClearEpoch() would be ran
-      // by more than 1 threads
-      exited_flag.store(true);
-
-      // If thread pointer is nullptr then we know the GC thread
-      // is not started. In this case do not wait for the thread, and just
-      // call destructor
-      //
-      // NOTE: The destructor routine is not thread-safe, so if an external
-      // GC thread is being used then that thread should check for
-      // exited_flag everytime it wants to do GC
-      //
-      // If the external thread calls ThreadFunc() then it is safe
-      if (thread_p != nullptr) {
-        INDEX_LOG_TRACE("Waiting for thread");
-
-        thread_p->join();
-
-        // Free memory
-        delete thread_p;
-
-        INDEX_LOG_TRACE("Thread stops");
-      }
+      StopThread();
 
       // So that in the following function the comparison
       // would always fail, until we have cleaned all epoch nodes
@@ -7121,9 +11193,20 @@ class BwTree : public BwTreeBase {
         ClearEpoch();
       }
 
+      // There is no thread in the tree, so pending epochs are freed without
+      // computing the minimum epoch
+      FreePendingEpoch(QUIESCENT_EPOCH);
+
       NOISEPAGE_ASSERT(head_epoch_p == nullptr, "All garbage nodes should be freed.");
+      NOISEPAGE_ASSERT(pending_head_p == nullptr, "All garbage nodes should be freed.");
       INDEX_LOG_TRACE("Garbage Collector has finished freeing all garbage nodes");
 
+      while (free_epoch_p != nullptr) {
+        EpochNode *next_epoch_node_p = free_epoch_p->next_p;
+        delete free_epoch_p;
+        free_epoch_p = next_epoch_node_p;
+      }
+
 #ifdef BWTREE_DEBUG
       INDEX_LOG_TRACE("Stat: Freed %" PRIu64 " nodes and %" PRIu64 " NodeID by epoch manager", freed_count,
                       freed_id_count);
@@ -7134,37 +11217,47 @@ class BwTree : public BwTreeBase {
                       epoch_leave.load());
 #endif
 
-      // NOTE: Only unmap memory here because we need to access the mapping
-      // table in the above routine. If it was unmapped in ~BwTree() then this
+      // NOTE: Only free memory here because we need to access the mapping
+      // table in the above routine. If it was freed in ~BwTree() then this
       // function will invoke illegal memory access
-      int munmap_ret = munmap(tree_p->mapping_table, sizeof(BaseNode *) * MAPPING_TABLE_SIZE);
+      tree_p->FreeMappingTable();
+      tree_p->FreeNodeIDBatches();
+      tree_p->FreeGarbageNodeSlabs();
 
-      // Although failure of munmap is not fatal, we still print out
-      // an error log entry
-      // Otherwise just trace log
-      if (munmap_ret != 0) {
-        INDEX_LOG_ERROR("munmap() returns with %d", munmap_ret);
-      } else {
-        INDEX_LOG_TRACE("Mapping table is unmapped for Bw-Tree");
-      }
+      INDEX_LOG_TRACE("Mapping table is freed for Bw-Tree");
     }
 
     /*
      * CreateNewEpoch() - Create a new epoch node
      *
      * This functions does not have to consider race conditions
+     *
+     * Epoch nodes freed before are reused, so a new epoch does not allocate
+     * memory in the steady state
      */
     NO_ASAN void CreateNewEpoch() {
       INDEX_LOG_TRACE("Creating new epoch...");
 
-      auto *epoch_node_p = new EpochNode{};
+      EpochNode *epoch_node_p = free_epoch_p;
+      if (epoch_node_p != nullptr) {
+        free_epoch_p = epoch_node_p->next_p;
+
+        // Undo the fetch_sub() of ClearEpoch() instead of storing 0, such
+        // that the count is still right after threads that joined with a
+        // stale pointer do their fetch_sub()
+        epoch_node_p->active_thread_count.fetch_add(MAX_THREAD_COUNT);
+      } else {
+        epoch_node_p = new EpochNode{};
+        epoch_node_p->active_thread_count = 0;
+      }
 
-      epoch_node_p->active_thread_count = 0;
       epoch_node_p->garbage_list_p = nullptr;
 
       // We always append to the tail of the linked list
       // so this field for new node is always nullptr
       epoch_node_p->next_p = nullptr;
+      epoch_node_p->start_epoch = tree_p->GetGlobalEpoch();
+      epoch_node_p->clear_epoch = 0UL;
 
       // Update its previous node (current tail)
       current_epoch_p->next_p = epoch_node_p;
@@ -7173,15 +11266,13 @@ class BwTree : public BwTreeBase {
       current_epoch_p = epoch_node_p;
     }
 
-#ifdef USE_OLD_EPOCH
-
     /*
-     * AddGarbageNode() - Add garbage node into the current epoch
+     * AddSharedGarbageNode() - Add garbage node into the current epoch
      *
      * NOTE: This function is called by worker threads so it has
      * to consider race conditions
      */
-    NO_ASAN void AddGarbageNode(const BaseNode *node_p) {
+    NO_ASAN void AddSharedGarbageNode(const BaseNode *node_p) {
       // We need to keep a copy of current epoch node
       // in case that this pointer is increased during
       // the execution of this function
@@ -7194,16 +11285,18 @@ class BwTree : public BwTreeBase {
       EpochNode *epoch_p = current_epoch_p;
 
       // These two could be predetermined
-      auto *garbage_node_p = new GarbageNode;
-      garbage_node_p->node_p = node_p;
+      GarbageNode *garbage_node_p = tree_p->AllocateGarbageNode();
+      garbage_node_p->node_p = (void *)(node_p);
 
-      garbage_node_p->next_p = epoch_p->garbage_list_p.load();
+      GarbageNode *next_garbage_node_p = epoch_p->garbage_list_p.load();
 
       while (1) {
+        garbage_node_p->next_p.store(next_garbage_node_p, std::memory_order_relaxed);
+
         // Then CAS previous node with new garbage node
-        // If this fails, then garbage_node_p->next_p is the actual value
+        // If this fails, then next_garbage_node_p is the actual value
         // of garbage_list_p, in which case we do not need to load it again
-        bool ret = epoch_p->garbage_list_p.compare_exchange_strong(garbage_node_p->next_p, garbage_node_p);
+        bool ret = epoch_p->garbage_list_p.compare_exchange_strong(next_garbage_node_p, garbage_node_p);
 
         // If CAS succeeds then just return
         if (ret) {
@@ -7215,7 +11308,23 @@ class BwTree : public BwTreeBase {
     }
 
     /*
-     * JoinEpoch() - Let current thread join this epoch
+     * AddSharedGarbageChain() - Adds a linked chain of garbage nodes into the
+     *                           current epoch
+     *
+     * NOTE: This function is called by the epoch manager, but worker threads
+     * might add garbage nodes at the same time
+     */
+    NO_ASAN void AddSharedGarbageChain(GarbageNode *first_p, GarbageNode *last_p) {
+      EpochNode *epoch_p = current_epoch_p;
+      GarbageNode *next_garbage_node_p = epoch_p->garbage_list_p.load();
+
+      do {
+        last_p->next_p.store(next_garbage_node_p, std::memory_order_relaxed);
+      } while (!epoch_p->garbage_list_p.compare_exchange_weak(next_garbage_node_p, first_p));
+    }
+
+    /*
+     * JoinSharedEpoch() - Let current thread join this epoch
      *
      * The effect is that all memory deallocated on and after
      * current epoch will not be freed before current thread leaves
@@ -7224,7 +11333,7 @@ class BwTree : public BwTreeBase {
      * the cleaner thread will decrease the epoch counter by a large amount
      * to prevent this function using an epoch currently being recycled
      */
-    NO_ASAN inline EpochNode *JoinEpoch() {
+    NO_ASAN inline EpochNode *JoinSharedEpoch() {
     try_join_again:
       // We must make sure the epoch we join and the epoch we
       // return are the same one because the current point
@@ -7258,17 +11367,31 @@ class BwTree : public BwTreeBase {
     }
 
     /*
-     * LeaveEpoch() - Leave epoch a thread has once joined
+     * LeaveSharedEpoch() - Leave epoch a thread has once joined
      *
      * After an epoch has been cleared all memories allocated on
      * and before that epoch could safely be deallocated
      */
-    NO_ASAN inline void LeaveEpoch(EpochNode *epoch_p) {
+    NO_ASAN inline void LeaveSharedEpoch(EpochNode *epoch_p) {
       // This might return a negative value if the current epoch
       // is being cleaned
       epoch_p->active_thread_count.fetch_sub(1);
     }
 
+    /*
+     * GetSharedMinEpoch() - Returns a lower bound of the epochs of threads
+     *                       that are in shared epoch nodes
+     */
+    NO_ASAN inline uint64_t GetSharedMinEpoch() { return shared_min_epoch.load(); }
+
+#ifdef USE_OLD_EPOCH
+
+    NO_ASAN inline void AddGarbageNode(const BaseNode *node_p) { AddSharedGarbageNode(node_p); }
+
+    NO_ASAN inline EpochNode *JoinEpoch() { return JoinSharedEpoch(); }
+
+    NO_ASAN inline void LeaveEpoch(EpochNode *epoch_p) { LeaveSharedEpoch(epoch_p); }
+
     /*
      * PerformGarbageCollection() - Actual job of GC is done here
      *
@@ -7284,31 +11407,62 @@ class BwTree : public BwTreeBase {
 #else  // #ifdef USE_OLD_EPOCH
 
     /*
-     * AddGarbageNode() - This encapsulates BwTree::AddGarbageNode()
+     * AddGarbageNode() - Adds the garbage node into the thread-local GC
+     *                    context, or into the current epoch for threads
+     *                    without a GC slot
      */
     NO_ASAN inline void AddGarbageNode(const BaseNode *node_p) {
-      tree_p->AddGarbageNode(node_p);
+      if (tree_p->GetRegisteredGCMetaData() == nullptr) {
+        AddSharedGarbageNode(node_p);
+        return;
+      }
 
-      return;
+      tree_p->AddGarbageNode(node_p);
     }
 
+    /*
+     * JoinEpoch() - Let current thread join the current epoch
+     *
+     * Threads with a GC slot only write their own slot and return nullptr,
+     * such that read-only operations never write a shared cache line. Other
+     * threads join the current shared epoch node
+     */
     NO_ASAN inline EpochNode *JoinEpoch() {
-      tree_p->UpdateLastActiveEpoch();
+      GCMetaData *metadata_p = tree_p->GetEpochGCMetaData();
+      if (metadata_p == nullptr) {
+        return JoinSharedEpoch();
+      }
+
+      tree_p->EnterEpoch(metadata_p);
 
       return nullptr;
     }
 
+    /*
+     * LeaveEpoch() - Leave epoch a thread has once joined
+     */
     NO_ASAN inline void LeaveEpoch(EpochNode *epoch_p) {
-      tree_p->UpdateLastActiveEpoch();
+      if (epoch_p != nullptr) {
+        LeaveSharedEpoch(epoch_p);
+        return;
+      }
 
-      (void)epoch_p;
-      return;
+      tree_p->ExitEpoch(tree_p->GetCurrentGCMetaData());
     }
 
-    NO_ASAN inline void PerformGarbageCollection() {
+    /*
+     * PerformGarbageCollection() - Advances the global epoch and clears
+     *                              shared epoch nodes
+     *
+     * Garbage left by exited threads in their GC slots is moved to the
+     * current epoch node first
+     */
+    NO_ASAN void PerformGarbageCollection() {
       tree_p->IncreaseEpoch();
+      tree_p->SweepReleasedGCSlots();
 
-      return;
+      ClearEpoch();
+      CreateNewEpoch();
     }
 
 #endif  // #ifdef USE_OLD_EPOCH
@@ -7351,6 +11505,16 @@ class BwTree : public BwTreeBase {
 
             ((LeafDeleteNode *)node_p)->~LeafDeleteNode();
 
+#ifdef BWTREE_DEBUG
+            freed_count++;
+#endif
+
+            break;
+          case NodeType::LeafUpdateType:
+            next_node_p = ((LeafUpdateNode *)node_p)->child_node_p;
+
+            ((LeafUpdateNode *)node_p)->~LeafUpdateNode();
+
 #ifdef BWTREE_DEBUG
             freed_count++;
 #endif
@@ -7549,33 +11713,30 @@ class BwTree : public BwTreeBase {
         // a negative value which will cause re-read of current_epoch_p
         // to prevent joining an epoch that is being deleted
 
-        // If the epoch has cleared we just loop through its garbage chain
-        // and then free each delta chain
-
-        const GarbageNode *next_garbage_node_p = nullptr;
-
-        // Walk through its garbage chain
-        for (const GarbageNode *garbage_node_p = head_epoch_p->garbage_list_p.load(); garbage_node_p != nullptr;
-             garbage_node_p = next_garbage_node_p) {
-          FreeEpochDeltaChain(garbage_node_p->node_p);
-
-          // Save the next pointer so that we could
-          // delete current node directly
-          next_garbage_node_p = garbage_node_p->next_p;
-
-          // This invalidates any further reference to its
-          // members (so we saved next pointer above)
-          delete garbage_node_p;
-        }  // for
-
         // First need to save this in order to delete current node
         // safely
         EpochNode *next_epoch_node_p = head_epoch_p->next_p;
 
-        delete head_epoch_p;
+#ifdef USE_OLD_EPOCH
+        FreeEpochNode(head_epoch_p);
+#else
+        // Threads with a GC slot do not join epoch nodes, so they might
+        // still see the garbage of the epoch. Since all threads adding
+        // garbage to it have left, it is freed after all threads with a slot
+        // have entered an epoch later than the current one
+        if (head_epoch_p->garbage_list_p.load() == nullptr) {
+          FreeEpochNode(head_epoch_p);
+        } else {
+          head_epoch_p->clear_epoch = tree_p->GetGlobalEpoch();
+          head_epoch_p->next_p = nullptr;
 
-#ifdef BWTREE_DEBUG
-        epoch_freed++;
+          if (pending_tail_p == nullptr) {
+            pending_head_p = head_epoch_p;
+          } else {
+            pending_tail_p->next_p = head_epoch_p;
+          }
+          pending_tail_p = head_epoch_p;
+        }
 #endif
 
         // Then advance to the next epoch
@@ -7585,6 +11746,72 @@ class BwTree : public BwTreeBase {
         // pointer to nullptr
         head_epoch_p = next_epoch_node_p;
       }  // while(1) through epoch nodes
+
+      shared_min_epoch.store((head_epoch_p == nullptr) ? QUIESCENT_EPOCH : head_epoch_p->start_epoch);
+
+      ClearPendingEpoch();
+    }
+
+    /*
+     * ClearPendingEpoch() - Frees cleared epoch nodes whose garbage could not
+     *                       be seen by any thread with a GC slot
+     *
+     * The slots are only scanned if there is such an epoch node, which only
+     * happens if threads without a slot have deleted nodes
+     */
+    NO_ASAN void ClearPendingEpoch() {
+      if (pending_head_p == nullptr) {
+        return;
+      }
+
+      FreePendingEpoch(tree_p->SummarizeGCEpoch(pending_tail_p->clear_epoch));
+    }
+
+    /*
+     * FreePendingEpoch() - Frees cleared epoch nodes that are cleared before
+     *                      the given epoch
+     */
+    NO_ASAN void FreePendingEpoch(uint64_t min_epoch) {
+      while (pending_head_p != nullptr && pending_head_p->clear_epoch < min_epoch) {
+        EpochNode *next_epoch_node_p = pending_head_p->next_p;
+
+        FreeEpochNode(pending_head_p);
+
+        pending_head_p = next_epoch_node_p;
+      }
+
+      if (pending_head_p == nullptr) {
+        pending_tail_p = nullptr;
+      }
+    }
+
+    /*
+     * FreeEpochNode() - Frees the garbage chain of a cleared epoch node and
+     *                   the epoch node itself
+     */
+    NO_ASAN void FreeEpochNode(EpochNode *epoch_node_p) {
+      GarbageNode *next_garbage_node_p = nullptr;
+
+      // Walk through its garbage chain
+      for (GarbageNode *garbage_node_p = epoch_node_p->garbage_list_p.load(); garbage_node_p != nullptr;
+           garbage_node_p = next_garbage_node_p) {
+        FreeEpochDeltaChain((const BaseNode *)garbage_node_p->node_p);
+
+        // Save the next pointer so that we could
+        // reuse current node directly
+        next_garbage_node_p = garbage_node_p->next_p.load(std::memory_order_relaxed);
+
+        // This invalidates any further reference to its
+        // members (so we saved next pointer above)
+        tree_p->free_garbage_node_stack.Push(garbage_node_p);
+      }  // for
+
+      epoch_node_p->next_p = free_epoch_p;
+      free_epoch_p = epoch_node_p;
+
+#ifdef BWTREE_DEBUG
+      epoch_freed++;
+#endif
     }
 
     /*
@@ -7618,6 +11845,42 @@ class BwTree : public BwTreeBase {
     NO_ASAN void StartThread() {
       thread_p = new std::thread{[this]() { this->ThreadFunc(); }};
     }
+
+    /*
+     * StopThread() - Stop cleaner thread and wait for it
+     *
+     * This is called by the destructor of the tree before it frees garbage
+     * in GC slots, which the cleaner thread could be sweeping
+     */
+    NO_ASAN void StopThread() {
+      // Set stop flag and let thread terminate
+      // Also if there is an external GC thread then it should
+      // check this flag everytime it does cleaning since otherwise
+      // the un-thread-safe function ClearEpoch() would be ran
+      // by more than 1 threads
+      exited_flag.store(true);
+
+      // If thread pointer is nullptr then we know the GC thread
+      // is not started. In this case do not wait for the thread, and just
+      // call destructor
+      //
+      // NOTE: The destructor routine is not thread-safe, so if an external
+      // GC thread is being used then that thread should check for
+      // exited_flag everytime it wants to do GC
+      //
+      // If the external thread calls ThreadFunc() then it is safe
+      if (thread_p != nullptr) {
+        INDEX_LOG_TRACE("Waiting for thread");
+
+        thread_p->join();
+
+        // Free memory
+        delete thread_p;
+        thread_p = nullptr;
+
+        INDEX_LOG_TRACE("Thread stops");
+      }
+    }
   };  // Epoch manager
 
   /*
@@ -7643,6 +11906,21 @@ class BwTree : public BwTreeBase {
    */
   NO_ASAN ForwardIterator Begin(const KeyType &start_key) { return ForwardIterator{this, start_key}; }
 
+  /*
+   * RBegin() - Return an iterator for backward iteration using a given key
+   *
+   * The iterator returned points to the data item with the largest key that
+   * is less than or equal to the given start key. Use operator-- to move
+   * backward, and IsREnd() to detect the end of iteration. If there is no
+   * such key then the iterator is already REnd()
+   */
+  NO_ASAN ForwardIterator RBegin(const KeyType &start_key) {
+    ForwardIterator it{};
+    it.ReverseLowerBound(this, &start_key);
+
+    return it;
+  }
+
   /*
    * NullIterator() - Returns an empty iterator that cannot do anything
    *
@@ -7654,6 +11932,116 @@ class BwTree : public BwTreeBase {
    */
   NO_ASAN ForwardIterator NullIterator() { return ForwardIterator{}; }
 
+  /*
+   * Select() - Returns an iterator pointing to the item at a given position
+   *            in the key order, starting from 0
+   *
+   * This goes down from the root using the subtree counts of inner nodes,
+   * and then skips leaves from there using their item count. If the position
+   * is not less than the number of items then the returned iterator is an end
+   * iterator. This could be used for OFFSET in pagination and then continue
+   * the iteration
+   *
+   * NOTE: This takes O(log n) time, and like Rank() the position is an
+   * estimate (see CountRange())
+   */
+  NO_ASAN ForwardIterator Select(size_t rank) {
+    INDEX_LOG_TRACE("Select()");
+
+    KeyValuePairBuffer buffer{};
+
+    EpochNode *epoch_node_p = epoch_manager.JoinEpoch();
+
+    const BaseNode *node_p = GetNode(root_id.load());
+
+    // Position relative to the current node
+    uint64_t node_rank = rank;
+
+    while (1) {
+      NodeType type = node_p->GetType();
+
+      // Items of a removed node could still be read below the remove delta
+      if ((type == NodeType::LeafRemoveType) || (type == NodeType::InnerRemoveType)) {
+        node_p = static_cast<const DeltaNode *>(node_p)->child_node_p;
+      } else if (node_p->IsOnLeafDeltaChain()) {
+        break;
+      } else {
+        node_p = GetNode(LocateSeparatorByRank(node_p, &node_rank));
+      }
+    }
+
+    rank = node_rank;
+
+    // Items below this key have been counted
+    KeyType start_key{};
+    bool has_start_key = false;
+
+    while (1) {
+      const KeyNodeIDPair &low_key_pair = node_p->GetLowKeyPair();
+
+      // A leaf found from the root after a merge might contain counted items
+      bool below_covered = !has_start_key || ((low_key_pair.second != INVALID_NODE_ID) &&
+                                              KeyCmpGreaterEqual(low_key_pair.first, start_key));
+
+      if (!below_covered || (rank < static_cast<size_t>(node_p->GetItemCount()))) {
+        buffer.Clear();
+        CollectAllValuesOnLeafInto(node_p, &buffer);
+
+        const KeyValuePair *start_p = buffer.Begin();
+        if (has_start_key) {
+          start_p = std::lower_bound(start_p, buffer.End(), std::make_pair(start_key, ValueType{}),
+                                     key_value_pair_cmp_obj);
+        }
+
+        size_t item_num = buffer.End() - start_p;
+        if (rank < item_num) {
+          const KeyValuePair *item_p = start_p + rank;
+          KeyType key = item_p->first;
+
+          // All values of a key are in the same leaf, and the iterator
+          // returns them in the same order as consolidation
+          size_t value_index = item_p - std::lower_bound(buffer.Begin(), item_p, std::make_pair(key, ValueType{}),
+                                                         key_value_pair_cmp_obj);
+
+          // The bytes of a ByteKey could be freed with the leaf after
+          // leaving the epoch
+          std::string key_bytes{};
+          if constexpr (BYTE_KEY) {
+            key_bytes = key.ToString();
+            key = KeyType{key_bytes};
+          }
+
+          epoch_manager.LeaveEpoch(epoch_node_p);
+
+          ForwardIterator it = Begin(key);
+          for (size_t i = 0; (i < value_index) && !it.IsEnd(); i++) {
+            it++;
+          }
+
+          return it;
+        }
+
+        rank -= item_num;
+      } else {
+        rank -= node_p->GetItemCount();
+      }
+
+      const KeyNodeIDPair &next_key_pair = node_p->GetHighKeyPair();
+      if (next_key_pair.second == INVALID_NODE_ID) {
+        break;
+      }
+
+      start_key = next_key_pair.first;
+      has_start_key = true;
+
+      node_p = GetSiblingOnLeaf(next_key_pair);
+    }
+
+    epoch_manager.LeaveEpoch(epoch_node_p);
+
+    return NullIterator();
+  }
+
   /*
    * Iterators
    */
@@ -7670,10 +12058,9 @@ class BwTree : public BwTreeBase {
    * threaded environment. This is a valid assumption since different threads
    * could always start their own iterators
    *
-   * Since the instance of this class is created as char[], with a class
-   * ElasticNode<KeyValuePair> embedded, when destroy the instance we must
-   * manually call destructor first, and then call member Destroy() to free
-   * the chunk of memory as char[] rather than IteratorContext instance.
+   * The leaf node is allocated by ElasticNode::Get() such that key bytes are
+   * copied into it (see AllocationMeta::CopyKey()). A key copied from the
+   * leaf node is only valid while the instance holding it is referenced
    */
   class IteratorContext {
    private:
@@ -7685,42 +12072,55 @@ class BwTree : public BwTreeBase {
     // then we could not recycle it even if the ref count has droped to 0
     size_t ref_count;
 
-    // This is a stub that points to class LeafNode which is used to
-    // receive consolidated key value pairs from a leaf delta chain
-    LeafNode leaf_node_p[0];
+    // Parent of the leaf page when it was loaded. This is used as a hint to
+    // find the left page in backward iteration
+    NodeID parent_id;
+
+    // This is the LeafNode which is used to receive consolidated key value
+    // pairs from a leaf delta chain
+    LeafNode *leaf_node_p;
 
     /*
      * Constructor - Initialize class IteratorContext part
      *
      * Note that the LeafNode instance is initialized outside of this class
      */
-    NO_ASAN IteratorContext(BwTree *p_tree_p) : tree_p{p_tree_p}, ref_count{0UL} {}
+    NO_ASAN IteratorContext(BwTree *p_tree_p, LeafNode *p_leaf_node_p)
+        : tree_p{p_tree_p}, ref_count{0UL}, parent_id{INVALID_NODE_ID}, leaf_node_p{p_leaf_node_p} {}
 
     /*
-     * Destructor
-     *
-     * Note that this could not be directly deleted by calling operator delete[]
-     * since we allocate it as char[], so the destructor must be called
-     * manually and then free the chunk of memory as char[] rather than as
-     * class IteratorContext instance
+     * Destructor - Destroys the leaf node and frees its memory
      */
     NO_ASAN ~IteratorContext() {
       // Call destructor to destruct all KeyValuePairs stored in its array
-      GetLeafNode()->~ElasticNode<KeyValuePair>();
+      leaf_node_p->~ElasticNode<KeyValuePair>();
+      leaf_node_p->Destroy();
     }
 
    public:
     /*
-     * GetLeafNode() - Returns a pointer to the leaf node object embedded inside
+     * GetLeafNode() - Returns a pointer to the leaf node object owned by
      *                 class IteratorContext object
      */
-    NO_ASAN inline LeafNode *GetLeafNode() { return &leaf_node_p[0]; }
+    NO_ASAN inline LeafNode *GetLeafNode() { return leaf_node_p; }
 
     /*
      * GetTree() - Returns a tree instance
      */
     NO_ASAN inline BwTree *GetTree() { return tree_p; }
 
+    /*
+     * GetParentNodeID() - Returns the parent NodeID of the leaf page
+     *
+     * This is INVALID_NODE_ID if the parent is unknown
+     */
+    NO_ASAN inline NodeID GetParentNodeID() const { return parent_id; }
+
+    /*
+     * SetParentNodeID() - Sets the parent NodeID of the leaf page
+     */
+    NO_ASAN inline void SetParentNodeID(NodeID p_parent_id) { parent_id = p_parent_id; }
+
     /*
      * InnRef() - Increase reference counter
      *
@@ -7759,11 +12159,8 @@ class BwTree : public BwTreeBase {
 
       ref_count--;
       if (ref_count == 0UL) {
-        // 1. calls d'tor of class IteratorContext which calls d'tor
-        //    for class ElasticNode
-        this->~IteratorContext();
-        // 2. Frees memory as char[]
-        this->Destroy();
+        // Calls d'tor of class IteratorContext which destroys the leaf node
+        delete this;
       }
     }
 
@@ -7785,21 +12182,12 @@ class BwTree : public BwTreeBase {
      * the leaf node if it is provided in the argument list.
      */
     NO_ASAN inline static IteratorContext *Get(BwTree *p_tree_p, const BaseNode *node_p) {
-      // This is the size of the memory chunk we allocate for the leaf node
-      size_t size = sizeof(IteratorContext) + sizeof(LeafNode) + sizeof(KeyValuePair) * node_p->GetItemCount();
-
-      // This is the size of memory we wish to initialize for IteratorContext
-      // plus data
-      auto *ic_p = reinterpret_cast<IteratorContext *>(new char[size]);
-      NOISEPAGE_ASSERT(ic_p != nullptr, "Cannot be nullptr.");
-
-      // Initialize class IteratorContext part
-      new (ic_p) IteratorContext{p_tree_p};
+      // Initialize class LeafNode, i.e. class ElasticNode<KeyValuePair> part
+      auto *leaf_node_p = reinterpret_cast<LeafNode *>(
+          ElasticNode<KeyValuePair>::Get(node_p->GetItemCount(), node_p->GetType(), node_p->GetDepth(),
+                                         node_p->GetItemCount(), node_p->GetLowKeyPair(), node_p->GetHighKeyPair()));
 
-      // Then initialize class LeafNode
-      // i.e. class ElasticNode<KeyValuePair> part
-      new (ic_p->GetLeafNode()) ElasticNode<KeyValuePair>{node_p->GetType(), node_p->GetDepth(), node_p->GetItemCount(),
-                                                          node_p->GetLowKeyPair(), node_p->GetHighKeyPair()};
+      auto *ic_p = new IteratorContext{p_tree_p, leaf_node_p};
 
       // So after this function returns the ref count should be exactly 1
       ic_p->IncRef();
@@ -7807,24 +12195,6 @@ class BwTree : public BwTreeBase {
 
       return ic_p;
     }
-
-    /*
-     * Destroy() - Manually frees memory as char[]
-     *
-     * This function is necessary to ensure well defined bahavior of the
-     * class since the memory of "this" pointer is allocated through operator
-     * new[] of type char[], so we must reclaim memory using the same
-     * operator delete[] of type char[]
-     *
-     * Note that class ElasticNode<KeyValuePair> d'tor needs to be called
-     * before this function is called then it is deleted in the d'tor
-     */
-    NO_ASAN inline void Destroy() {
-      // Note that we must cast it as char * before
-      // delete[] otherwise C++ will try to find the size of the array
-      // and call d'tor for each element
-      delete[] reinterpret_cast<char *>(this);
-    }
   };
 
   /*
@@ -7886,6 +12256,13 @@ class BwTree : public BwTreeBase {
 
       // Leave epoch
       p_tree_p->epoch_manager.LeaveEpoch(epoch_node_p);
+
+      // The first leaf page is never removed, so it could be empty (e.g.
+      // after DeleteRange()) while there are keys on the right
+      if ((kv_p == ic_p->GetLeafNode()->End()) && !IsEnd()) {
+        KeyType high_key = ic_p->GetLeafNode()->GetHighKeyPair().first;
+        LowerBound(p_tree_p, &high_key);
+      }
     }
 
     /*
@@ -8237,7 +12614,9 @@ class BwTree : public BwTreeBase {
       NOISEPAGE_ASSERT(start_key_p != nullptr, "start key must not be nullptr.");
       // This is required since start_key_p might be pointing inside the
       // currently buffered IteratorContext which will be destroyed
-      // after new IteratorContext is created
+      // after new IteratorContext is created. The bytes of a ByteKey are
+      // still there, so that IteratorContext is only released after the
+      // search on the new one
       KeyType start_key = *start_key_p;
 
       while (1) {
@@ -8255,17 +12634,14 @@ class BwTree : public BwTreeBase {
         const BaseNode *node_p = snapshot_p->node_p;
         NOISEPAGE_ASSERT(node_p->IsOnLeafDeltaChain(), "node must be on the delta chain.");
 
-        // After this point, start_key_p from the last page becomes invalid
-
         // We are releasing the IteratorContext object currently held
         // because we are now going to the next page after it
-        if (ic_p != nullptr) {
-          ic_p->DecRef();
-        }
+        IteratorContext *prev_ic_p = ic_p;
 
         // Refresh the IteratorContext object and also refresh kv_p
         ic_p = IteratorContext::Get(p_tree_p, node_p);
         NOISEPAGE_ASSERT(ic_p->GetRefCount() == 1UL, "ref_count must be 1.");
+        ic_p->SetParentNodeID(context.parent_snapshot.node_id);
 
         // Consolidate the current node and store all key value pairs
         // to the embedded leaf node
@@ -8289,6 +12665,11 @@ class BwTree : public BwTreeBase {
         kv_p = std::lower_bound(ic_p->GetLeafNode()->Begin(), ic_p->GetLeafNode()->End(),
                                 std::make_pair(start_key, ValueType{}), p_tree_p->key_value_pair_cmp_obj);
 
+        // After this point, start_key_p from the last page becomes invalid
+        if (prev_ic_p != nullptr) {
+          prev_ic_p->DecRef();
+        }
+
         // All keys in the leaf page are < start key. Switch the next key until
         // we have found the key or until we have reached end of tree
         if (kv_p != ic_p->GetLeafNode()->End()) {
@@ -8304,13 +12685,55 @@ class BwTree : public BwTreeBase {
       }  // while(1)
     }
 
+    /*
+     * ReverseLowerBound() - Load leaf page with the last key <= start_key
+     *
+     * If there is no such key then the iterator becomes REnd()
+     */
+    NO_ASAN void ReverseLowerBound(BwTree *p_tree_p, const KeyType *start_key_p) {
+      NOISEPAGE_ASSERT(start_key_p != nullptr, "start key must not be nullptr.");
+      KeyType start_key = *start_key_p;
+
+      EpochNode *epoch_node_p = p_tree_p->epoch_manager.JoinEpoch();
+
+      Context context{start_key};
+      p_tree_p->Traverse(&context, nullptr, nullptr);
+
+      NodeSnapshot *snapshot_p = BwTree::GetLatestNodeSnapshot(&context);
+      const BaseNode *node_p = snapshot_p->node_p;
+      NOISEPAGE_ASSERT(node_p->IsOnLeafDeltaChain(), "node must be on the delta chain.");
+
+      // Released after the search, since start_key might be in it
+      IteratorContext *prev_ic_p = ic_p;
+
+      ic_p = IteratorContext::Get(p_tree_p, node_p);
+      NOISEPAGE_ASSERT(ic_p->GetRefCount() == 1UL, "ref_count must be 1.");
+      ic_p->SetParentNodeID(context.parent_snapshot.node_id);
+      p_tree_p->CollectAllValuesOnLeaf(snapshot_p, ic_p->GetLeafNode());
+
+      p_tree_p->epoch_manager.LeaveEpoch(epoch_node_p);
+
+      // Points to the first key > start_key, and then go back by one, which
+      // might go to the left page if all keys in this page are > start_key
+      kv_p = std::upper_bound(ic_p->GetLeafNode()->Begin(), ic_p->GetLeafNode()->End(),
+                              std::make_pair(start_key, ValueType{}), p_tree_p->key_value_pair_cmp_obj);
+
+      if (prev_ic_p != nullptr) {
+        prev_ic_p->DecRef();
+      }
+
+      MoveBackByOne();
+    }
+
     /*
      * MoveBackByOne() - Moves to the left key if there is one
      *
      * This function works by querying the tree using low key of the current
      * node (which must be nonempty), keeping going left until we have seen
      * a node whose low key is higher than or equal to the current low key,
-     * thus locating the left node of the current node
+     * thus locating the left node of the current node. The query starts
+     * from the parent of the current node if it is still valid, and from the
+     * root otherwise
      *
      * Note that when this function is called, the following must be satisfied:
      *   (1) There must be a valid IteratorContext
@@ -8338,7 +12761,9 @@ class BwTree : public BwTreeBase {
 
       while (1) {
         // Saves the low key such that even if we release the reference to
-        // the IteratorContext object, it is still valid key
+        // the IteratorContext object, it is still valid key. The bytes of a
+        // ByteKey are still there, so that IteratorContext is only released
+        // after the search on the new one
         KeyType low_key = ic_p->GetLeafNode()->GetLowKey();
 
         // Traverse backward using the low key. This function will
@@ -8348,9 +12773,13 @@ class BwTree : public BwTreeBase {
 
         EpochNode *epoch_node_p = tree_p->epoch_manager.JoinEpoch();
 
-        // This function stops and does not traverse LeafNode after adjusting
-        // itself by traversing sibling chain
-        tree_p->TraverseBI(&context);
+        // The left page is usually under the same parent as the current page.
+        // Otherwise TraverseBI() stops and does not traverse LeafNode after
+        // adjusting itself by traversing sibling chain
+        if (!tree_p->TraverseBIFromParent(ic_p->GetParentNodeID(), &context)) {
+          tree_p->TraverseBI(&context);
+        }
+
         NodeSnapshot *snapshot_p = tree_p->GetLatestNodeSnapshot(&context);
         const BaseNode *node_p = snapshot_p->node_p;
 
@@ -8361,10 +12790,11 @@ class BwTree : public BwTreeBase {
             (node_p->GetLowKeyPair().second == INVALID_NODE_ID) || tree_p->KeyCmpLess(node_p->GetLowKey(), low_key),
             "reached an incorrect node.");
 
-        // Release the current leaf page, and
-        ic_p->DecRef();
+        // Release the current leaf page after the search below, and
+        IteratorContext *prev_ic_p = ic_p;
         ic_p = IteratorContext::Get(tree_p, node_p);
         NOISEPAGE_ASSERT(ic_p->GetRefCount() == 1UL, "ref_count must be 1.");
+        ic_p->SetParentNodeID(context.parent_snapshot.node_id);
         tree_p->CollectAllValuesOnLeaf(snapshot_p, ic_p->GetLeafNode());
 
         // Now we could safely release the reference
@@ -8385,6 +12815,7 @@ class BwTree : public BwTreeBase {
         kv_p = std::lower_bound(ic_p->GetLeafNode()->Begin(), ic_p->GetLeafNode()->End(),
                                 std::make_pair(low_key, ValueType{}), tree_p->key_value_pair_cmp_obj) -
                1;
+        prev_ic_p->DecRef();
 
         // If after decreament the kv_p points to the element before Begin()
         // then we know we should try again
@@ -8444,29 +12875,113 @@ class BwTree : public BwTreeBase {
    *
    * This is always called by the thread owning thread local data, so we
    * do not have to worry about thread identity issues
+   *
+   * NOTE: The node has been unlinked with a sequentially consistent CAS,
+   * so the global epoch read here is no earlier than the last active epoch
+   * of any thread that could still see the node (see EnterEpoch())
    */
   NO_ASAN void AddGarbageNode(const BaseNode *node_p) {
-    auto *garbage_node_p = new GarbageNode{GetGlobalEpoch(), (void *)(node_p)};
-    NOISEPAGE_ASSERT(garbage_node_p != nullptr, "Allocation failed.");
+    GCMetaData *metadata_p = GetCurrentGCMetaData();
+
+    GarbageNode *garbage_node_p = AllocateGarbageNode();
+    garbage_node_p->delete_epoch = GetGlobalEpoch();
+    garbage_node_p->node_p = (void *)(node_p);
+    garbage_node_p->next_p.store(nullptr, std::memory_order_relaxed);
 
     // Link this new node to the end of the linked list
     // and then update last_p
-    GetCurrentGCMetaData()->last_p->next_p = garbage_node_p;
-    GetCurrentGCMetaData()->last_p = garbage_node_p;
+    if (metadata_p->last_p == nullptr) {
+      metadata_p->head_p = garbage_node_p;
+    } else {
+      metadata_p->last_p->next_p.store(garbage_node_p, std::memory_order_relaxed);
+    }
+    metadata_p->last_p = garbage_node_p;
 
     // Update the counter
-    GetCurrentGCMetaData()->node_count++;
+    metadata_p->node_count++;
 
     // It is possible that we could not free enough number of nodes to
     // make it less than this threshold
     // So it is important to let the epoch counter be constantly increased
-    // to guarantee progress
-    if (GetCurrentGCMetaData()->node_count > GC_NODE_COUNT_THREADHOLD) {
+    // to guarantee progress. Until then we do not try again, since the
+    // minimum epoch could not exceed the global epoch
+    if (metadata_p->node_count > GC_NODE_COUNT_THREADHOLD && metadata_p->last_gc_epoch != GetGlobalEpoch()) {
       // Use current thread's gc id to perform GC
       PerformGC(gc_id);
     }
   }
 
+  /*
+   * AllocateGarbageNode() - Returns a garbage node, reusing a free one if
+   *                         possible
+   *
+   * Garbage nodes freed by the current thread are used first, then those
+   * freed by the epoch manager, and only then a new slab is allocated. The
+   * rest of a new slab goes to the free list of the current thread, or to
+   * the shared stack if the thread has no GC slot
+   */
+  NO_ASAN GarbageNode *AllocateGarbageNode() {
+    GCMetaData *metadata_p = GetRegisteredGCMetaData();
+
+    GarbageNode *garbage_node_p = (metadata_p != nullptr) ? metadata_p->free_garbage_p : nullptr;
+    if (garbage_node_p != nullptr) {
+      metadata_p->free_garbage_p = garbage_node_p->next_p.load(std::memory_order_relaxed);
+      return garbage_node_p;
+    }
+
+    garbage_node_p = free_garbage_node_stack.Pop();
+    if (garbage_node_p != nullptr) {
+      return garbage_node_p;
+    }
+
+    auto *slab_p = new GarbageNodeSlab{};
+
+    GarbageNodeSlab *list_head_p = garbage_node_slab_list_p.load();
+    do {
+      slab_p->next_p = list_head_p;
+    } while (!garbage_node_slab_list_p.compare_exchange_weak(list_head_p, slab_p));
+
+    for (size_t i = 1; i < GARBAGE_NODE_SLAB_SIZE; i++) {
+      if (metadata_p != nullptr) {
+        slab_p->node_list[i].next_p.store(metadata_p->free_garbage_p, std::memory_order_relaxed);
+        metadata_p->free_garbage_p = &slab_p->node_list[i];
+      } else {
+        free_garbage_node_stack.Push(&slab_p->node_list[i]);
+      }
+    }
+
+    return &slab_p->node_list[0];
+  }
+
+  /*
+   * FreeGarbageNodeSlabs() - Frees all garbage node slabs
+   *
+   * NOTE: This function only works in a single-threaded environment, after
+   * all garbage nodes have been freed
+   */
+  void FreeGarbageNodeSlabs() {
+    GarbageNodeSlab *slab_p = garbage_node_slab_list_p.exchange(nullptr);
+
+    while (slab_p != nullptr) {
+      GarbageNodeSlab *next_p = slab_p->next_p;
+      delete slab_p;
+      slab_p = next_p;
+    }
+  }
+
+  /*
+   * GetGarbageNodeSlabCount() - Returns the number of garbage node slabs
+   */
+  size_t GetGarbageNodeSlabCount() {
+    size_t slab_count = 0;
+
+    for (GarbageNodeSlab *slab_p = garbage_node_slab_list_p.load(); slab_p != nullptr; slab_p = slab_p->next_p) {
+      slab_count++;
+    }
+
+    return slab_count;
+  }
+
   /*
    * PerformGC() - This function performs GC on the current thread's garbage
    *               chain using the call back function
@@ -8479,36 +12994,61 @@ class BwTree : public BwTreeBase {
    * GetCurrentGCMetaData()
    */
   NO_ASAN void PerformGC(int thread_id) {
+    // Read the global epoch first, such that a failed attempt is not
+    // retried before the minimum epoch could have changed
+    uint64_t global_epoch = GetGlobalEpoch();
+
+    GCMetaData *metadata_p = GetGCMetaData(thread_id);
+    if (metadata_p->head_p == nullptr) {
+      return;
+    }
+
     // First of all get the minimum epoch of all active threads
     // This is the upper bound for deleted epoch in garbage node
-    uint64_t min_epoch = SummarizeGCEpoch();
+    // We try to free all garbage, so bounds are only refreshed if they
+    // could keep the last garbage node from being freed
+    // Threads in shared epochs are represented by the oldest shared epoch
+    uint64_t min_epoch =
+        std::min(SummarizeGCEpoch(metadata_p->last_p->delete_epoch), epoch_manager.GetSharedMinEpoch());
+
+    FreeThreadLocalGarbage(thread_id, min_epoch);
+
+    metadata_p->last_gc_epoch = (metadata_p->node_count > GC_NODE_COUNT_THREADHOLD) ? global_epoch : QUIESCENT_EPOCH;
+  }
 
-    // This is the pointer we use to perform GC
-    // Note that we only fetch the metadata using the current thread-local id
-    GarbageNode *header_p = &GetGCMetaData(thread_id)->header;
-    GarbageNode *first_p = header_p->next_p;
+  /*
+   * FreeThreadLocalGarbage() - Frees garbage nodes of a thread that are
+   *                            deleted before the given epoch
+   */
+  NO_ASAN void FreeThreadLocalGarbage(int thread_id, uint64_t min_epoch) {
+    // Note that we only fetch the metadata using the given thread id
+    GCMetaData *metadata_p = GetGCMetaData(thread_id);
+    GarbageNode *first_p = metadata_p->head_p;
 
     // Then traverse the linked list
     // Only reclaim memory when the deleted epoch < min epoch
     while (first_p != nullptr && first_p->delete_epoch < min_epoch) {
       // First unlink the current node from the linked list
       // This could set it to nullptr
-      header_p->next_p = first_p->next_p;
+      metadata_p->head_p = first_p->next_p.load(std::memory_order_relaxed);
 
       // Then free memory
       epoch_manager.FreeEpochDeltaChain((const BaseNode *)first_p->node_p);
 
-      delete first_p;
-      NOISEPAGE_ASSERT(GetGCMetaData(thread_id)->node_count != 0UL, "Node count cannot be 0.");
-      GetGCMetaData(thread_id)->node_count--;
+      // The garbage node is reused by the next AddGarbageNode()
+      first_p->next_p.store(metadata_p->free_garbage_p, std::memory_order_relaxed);
+      metadata_p->free_garbage_p = first_p;
+
+      NOISEPAGE_ASSERT(metadata_p->node_count != 0UL, "Node count cannot be 0.");
+      metadata_p->node_count--;
 
-      first_p = header_p->next_p;
+      first_p = metadata_p->head_p;
     }
 
     // If we have freed all nodes in the linked list we should
     // reset last_p to the header
     if (first_p == nullptr) {
-      GetGCMetaData(thread_id)->last_p = header_p;
+      metadata_p->last_p = nullptr;
     }
   }
 };  // class BwTree
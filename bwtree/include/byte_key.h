@@ -0,0 +1,267 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace bwtree {
+
+/*
+ * class ByteKey - Variable length key of bytes
+ *
+ * The key is a fixed sized object that holds the length of the key, a pointer
+ * to the bytes and the first PREFIX_SIZE bytes inline as an integer. Since
+ * the key is trivially copyable, copying it into delta nodes, pairs and
+ * consolidated nodes does not allocate, and the key tree of inner nodes is
+ * also used.
+ *
+ * Keys are ordered by bytes as unsigned chars, and a key is less than a
+ * longer key that starts with it (i.e. the same as memcmp() or std::string).
+ * Comparison first compares the inline prefixes, which decides the order
+ * unless the first PREFIX_SIZE bytes are the same, without reading the bytes.
+ *
+ * A key may also be stripped, i.e. its first GetHeadSize() bytes (the head)
+ * are stored somewhere else than the remaining bytes, and the pointer to the
+ * head is stored right before the remaining bytes. A node of a tree that
+ * strips key prefixes stores the common prefix of its keys once as the head
+ * of all of them (see BwTree::STRIP_KEY_PREFIX). Keys that share the head are
+ * then compared without reading it. Keys read from such a tree could be
+ * stripped, so ToString() should be used instead of ToStringView()
+ *
+ * NOTE: ByteKey does not own the bytes. BwTree copies bytes of keys it
+ * stores into the memory of the node that holds them, so the caller only
+ * needs to keep the bytes valid during the call
+ */
+class ByteKey {
+ public:
+  // The number of bytes compared inline
+  static constexpr uint32_t PREFIX_SIZE = sizeof(uint64_t);
+
+ private:
+  // First PREFIX_SIZE bytes in big endian, padded with zeros, such that
+  // comparing prefixes as integers is the same as comparing bytes
+  uint64_t prefix = 0UL;
+
+  // Bytes after the head
+  const char *data = nullptr;
+  uint32_t size = 0U;
+
+  // The number of bytes in the head, which is 0 if the key is not stripped
+  uint32_t head_size = 0U;
+
+ public:
+  /*
+   * Default Constructor - Empty key
+   */
+  ByteKey() = default;
+
+  /*
+   * Constructor - Refers to bytes without copying them
+   */
+  inline ByteKey(const char *p_data, uint32_t p_size) : prefix{LoadPrefix(p_data, p_size)}, data{p_data}, size{p_size} {}
+
+  inline ByteKey(std::string_view bytes) : ByteKey{bytes.data(), static_cast<uint32_t>(bytes.size())} {}
+
+  /*
+   * Constructor - Refers to a stripped key of p_size bytes
+   *
+   * The pointer to the head, p_head, must be stored right before p_suffix.
+   * The head must have at least PREFIX_SIZE bytes
+   */
+  inline ByteKey(const char *p_head, uint32_t p_head_size, const char *p_suffix, uint32_t p_size)
+      : prefix{LoadPrefix(p_head, PREFIX_SIZE)}, data{p_suffix}, size{p_size}, head_size{p_head_size} {}
+
+  /*
+   * GetData() - Returns the bytes after the head
+   */
+  inline const char *GetData() const { return data; }
+
+  inline uint32_t GetSize() const { return size; }
+
+  inline uint32_t GetHeadSize() const { return head_size; }
+
+  /*
+   * GetHead() - Returns the head of a stripped key
+   */
+  inline const char *GetHead() const {
+    const char *head_p;
+    std::memcpy(&head_p, data - sizeof(head_p), sizeof(head_p));
+
+    return head_p;
+  }
+
+  /*
+   * ToStringView() - Returns the bytes of a key that is not stripped
+   */
+  inline std::string_view ToStringView() const { return std::string_view{data, size}; }
+
+  /*
+   * ToString() - Returns a copy of the bytes
+   */
+  inline std::string ToString() const {
+    std::string bytes(size, '\0');
+    CopyTo(bytes.data());
+
+    return bytes;
+  }
+
+  /*
+   * CopyTo() - Copies the bytes from an offset to the end
+   */
+  inline void CopyTo(char *p_data, uint32_t offset = 0U) const {
+    while (offset < size) {
+      uint32_t length;
+      const char *bytes_p = BytesAt(offset, &length);
+      std::memcpy(p_data, bytes_p, length);
+
+      p_data += length;
+      offset += length;
+    }
+  }
+
+  /*
+   * Compare() - Compares bytes from an offset, and returns a negative value,
+   *             zero or a positive value as memcmp()
+   *
+   * The first offset bytes of the two keys must be the same. Below
+   * PREFIX_SIZE the prefixes are compared first. If the two keys share the
+   * head then it is skipped as well. After that, the shorter key of the two
+   * has all of its bytes in the prefix unless both keys are longer than the
+   * prefix
+   */
+  static inline int Compare(const ByteKey &key_1, const ByteKey &key_2, uint32_t offset = 0U) {
+    if (offset < PREFIX_SIZE) {
+      if (key_1.prefix != key_2.prefix) {
+        return (key_1.prefix < key_2.prefix) ? -1 : 1;
+      }
+
+      offset = PREFIX_SIZE;
+    }
+
+    if ((key_1.head_size > offset) && (key_1.head_size == key_2.head_size) && (key_1.GetHead() == key_2.GetHead())) {
+      offset = key_1.head_size;
+    }
+
+    uint32_t common_size = std::min(key_1.size, key_2.size);
+    while (offset < common_size) {
+      uint32_t length_1;
+      uint32_t length_2;
+      const char *bytes_1 = key_1.BytesAt(offset, &length_1);
+      const char *bytes_2 = key_2.BytesAt(offset, &length_2);
+
+      uint32_t length = std::min({length_1, length_2, common_size - offset});
+      int cmp = std::memcmp(bytes_1, bytes_2, length);
+      if (cmp != 0) {
+        return cmp;
+      }
+
+      offset += length;
+    }
+
+    return (key_1.size < key_2.size) ? -1 : static_cast<int>(key_1.size > key_2.size);
+  }
+
+  /*
+   * CommonPrefixSize() - Returns the number of leading bytes that are the
+   *                      same in two keys
+   */
+  static inline uint32_t CommonPrefixSize(const ByteKey &key_1, const ByteKey &key_2) {
+    uint32_t common_size = std::min(key_1.size, key_2.size);
+
+    uint32_t offset = 0U;
+    while (offset < common_size) {
+      uint32_t length_1;
+      uint32_t length_2;
+      const char *bytes_1 = key_1.BytesAt(offset, &length_1);
+      const char *bytes_2 = key_2.BytesAt(offset, &length_2);
+
+      uint32_t length = std::min({length_1, length_2, common_size - offset});
+      uint32_t same_length = std::mismatch(bytes_1, bytes_1 + length, bytes_2).first - bytes_1;
+      offset += same_length;
+
+      if (same_length < length) {
+        break;
+      }
+    }
+
+    return offset;
+  }
+
+  /*
+   * Hash() - Hashes the bytes of the key (FNV-1a)
+   *
+   * Bytes are read the same way whether or not the key is stripped, such
+   * that equal keys have the same hash
+   */
+  inline size_t Hash() const {
+    uint64_t hash = 14695981039346656037UL;
+
+    uint32_t offset = 0U;
+    while (offset < size) {
+      uint32_t length;
+      const char *bytes_p = BytesAt(offset, &length);
+      for (uint32_t i = 0; i < length; i++) {
+        hash = (hash ^ static_cast<unsigned char>(bytes_p[i])) * 1099511628211UL;
+      }
+
+      offset += length;
+    }
+
+    return static_cast<size_t>(hash);
+  }
+
+  friend inline bool operator<(const ByteKey &key_1, const ByteKey &key_2) { return Compare(key_1, key_2) < 0; }
+
+  friend inline bool operator==(const ByteKey &key_1, const ByteKey &key_2) {
+    return (key_1.size == key_2.size) && (Compare(key_1, key_2) == 0);
+  }
+
+  friend inline bool operator!=(const ByteKey &key_1, const ByteKey &key_2) { return !(key_1 == key_2); }
+
+ private:
+  /*
+   * BytesAt() - Returns the address of the byte at an offset, and the
+   *             number of bytes stored contiguously from there
+   */
+  inline const char *BytesAt(uint32_t offset, uint32_t *length_p) const {
+    if (offset < head_size) {
+      *length_p = head_size - offset;
+      return GetHead() + offset;
+    }
+
+    *length_p = size - offset;
+    return data + (offset - head_size);
+  }
+
+  /*
+   * LoadPrefix() - Loads the first PREFIX_SIZE bytes as a big endian integer
+   */
+  static inline uint64_t LoadPrefix(const char *p_data, uint32_t p_size) {
+    uint64_t value = 0UL;
+    if (p_size > 0) {
+      std::memcpy(&value, p_data, std::min(p_size, PREFIX_SIZE));
+    }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+
+    return value;
+  }
+};
+
+}  // namespace bwtree
+
+namespace std {
+
+/*
+ * std::hash<bwtree::ByteKey> - Hashes the bytes of the key
+ */
+template <>
+struct hash<bwtree::ByteKey> {
+  inline size_t operator()(const bwtree::ByteKey &key) const { return key.Hash(); }
+};
+
+}  // namespace std
@@ -0,0 +1,228 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "bwtree.h"
+
+namespace bwtree {
+
+/*
+ * NormalizeInteger() - Returns an unsigned integer with the same order as
+ *                      the given integer
+ *
+ * The sign bit of signed integers is flipped, such that negative integers
+ * come before non-negative ones
+ */
+template <typename IntegerType, typename = std::enable_if_t<std::is_integral<IntegerType>::value>>
+inline std::make_unsigned_t<IntegerType> NormalizeInteger(IntegerType value) {
+  using UnsignedType = std::make_unsigned_t<IntegerType>;
+
+  if constexpr (std::is_signed<IntegerType>::value) {
+    return static_cast<UnsignedType>(value) ^ (static_cast<UnsignedType>(1) << (sizeof(IntegerType) * 8 - 1));
+  } else {
+    return value;
+  }
+}
+
+/*
+ * AppendNormalized() - Appends a field to a normalized byte string key
+ *
+ * Fields appended in the same order to two keys compare with memcmp() (and
+ * ByteKey) the same as the fields compare one by one:
+ *   1. Integers are appended in big endian after NormalizeInteger()
+ *   2. Strings have each zero byte escaped as 0x00 0xFF and are terminated
+ *      by 0x00 0x00, such that a string is less than any longer string
+ *      starting with it whatever the following fields are
+ */
+template <typename IntegerType, typename = std::enable_if_t<std::is_integral<IntegerType>::value>>
+inline void AppendNormalized(std::string *key_p, IntegerType value) {
+  auto normalized = NormalizeInteger(value);
+
+  for (int shift = static_cast<int>(sizeof(IntegerType) * 8) - 8; shift >= 0; shift -= 8) {
+    key_p->push_back(static_cast<char>((normalized >> shift) & 0xFF));
+  }
+}
+
+inline void AppendNormalized(std::string *key_p, std::string_view value) {
+  for (char c : value) {
+    key_p->push_back(c);
+
+    if (c == '\0') {
+      key_p->push_back(static_cast<char>(0xFF));
+    }
+  }
+
+  key_p->push_back('\0');
+  key_p->push_back('\0');
+}
+
+/*
+ * class NormalizedBwTree - BwTree that stores keys in a normalized form
+ *
+ * Each key is converted once per operation by KeyNormalizer into a form
+ * whose order is the order of keys, and the tree only stores and compares
+ * the normalized form. This way comparisons on the hot path are a single
+ * integer comparison (with branch free and SIMD search of BwTree) or a
+ * prefix comparison followed by memcmp() (see ByteKey) instead of calls to
+ * a multi-field comparator.
+ *
+ * KeyNormalizer must have a const operator() that takes a KeyType and
+ * returns either an integer (KeyType order must be the integer order) or a
+ * std::string (KeyType order must be the memcmp() order, for which see
+ * AppendNormalized()). Equal keys must have the same normalized form.
+ *
+ * Range operations take KeyType bounds, and ScanRange() visitors and
+ * GetTree() see normalized keys (ByteKey for std::string). Composite keys
+ * normalized into std::string usually share long prefixes in a node, which
+ * StripKeyPrefix stores once per node (see BwTree)
+ */
+template <typename KeyType, typename ValueType, typename KeyNormalizer,
+          typename ValueEqualityChecker = std::equal_to<ValueType>, typename ValueHashFunc = std::hash<ValueType>,
+          bool UniqueKey = false, bool StripKeyPrefix = false>
+class NormalizedBwTree {
+ public:
+  // This is the type returned by KeyNormalizer
+  using NormalizedType = std::decay_t<std::invoke_result_t<const KeyNormalizer &, const KeyType &>>;
+
+  static_assert(std::is_integral<NormalizedType>::value || std::is_same<NormalizedType, std::string>::value,
+                "KeyNormalizer must return an integer or std::string.");
+
+  // This is the key type of the underlying tree
+  using TreeKeyType = std::conditional_t<std::is_integral<NormalizedType>::value, NormalizedType, ByteKey>;
+
+  using TreeType = BwTree<TreeKeyType, ValueType, std::less<TreeKeyType>, std::equal_to<TreeKeyType>,
+                          std::hash<TreeKeyType>, ValueEqualityChecker, ValueHashFunc, UniqueKey, StripKeyPrefix>;
+
+ private:
+  TreeType tree;
+
+  const KeyNormalizer key_normalizer_obj;
+
+ public:
+  explicit NormalizedBwTree(bool start_gc_thread = true, KeyNormalizer p_key_normalizer_obj = KeyNormalizer{},
+                            ValueEqualityChecker p_value_eq_obj = ValueEqualityChecker{},
+                            ValueHashFunc p_value_hash_obj = ValueHashFunc{})
+      : tree{start_gc_thread,
+             std::less<TreeKeyType>{},
+             std::equal_to<TreeKeyType>{},
+             std::hash<TreeKeyType>{},
+             p_value_eq_obj,
+             p_value_hash_obj},
+        key_normalizer_obj{p_key_normalizer_obj} {}
+
+  /*
+   * GetTree() - Returns the underlying tree on normalized keys
+   */
+  inline TreeType *GetTree() { return &tree; }
+
+  /*
+   * Normalize() - Returns the normalized form of a key
+   */
+  inline NormalizedType Normalize(const KeyType &key) const { return key_normalizer_obj(key); }
+
+  inline bool Insert(const KeyType &key, const ValueType &value, bool unique_key = false) {
+    return WithTreeKey(key, [&](const TreeKeyType &tree_key) { return tree.Insert(tree_key, value, unique_key); });
+  }
+
+  inline bool ConditionalInsert(const KeyType &key, const ValueType &value,
+                                std::function<bool(const ValueType)> predicate, bool *predicate_satisfied) {
+    return WithTreeKey(key, [&](const TreeKeyType &tree_key) {
+      return tree.ConditionalInsert(tree_key, value, predicate, predicate_satisfied);
+    });
+  }
+
+  inline bool Delete(const KeyType &key, const ValueType &value) {
+    return WithTreeKey(key, [&](const TreeKeyType &tree_key) { return tree.Delete(tree_key, value); });
+  }
+
+  inline bool Update(const KeyType &key, const ValueType &old_value, const ValueType &new_value) {
+    return WithTreeKey(key,
+                       [&](const TreeKeyType &tree_key) { return tree.Update(tree_key, old_value, new_value); });
+  }
+
+  inline bool Upsert(const KeyType &key, const ValueType &value) {
+    return WithTreeKey(key, [&](const TreeKeyType &tree_key) { return tree.Upsert(tree_key, value); });
+  }
+
+  inline void GetValue(const KeyType &search_key, std::vector<ValueType> &value_list) {
+    WithTreeKey(search_key, [&](const TreeKeyType &tree_key) { tree.GetValue(tree_key, value_list); });
+  }
+
+  template <typename ValueVisitor>
+  inline void VisitValue(const KeyType &search_key, ValueVisitor &&visitor) {
+    WithTreeKey(search_key, [&](const TreeKeyType &tree_key) {
+      tree.VisitValue(tree_key, std::forward<ValueVisitor>(visitor));
+    });
+  }
+
+  inline bool Contains(const KeyType &search_key) {
+    return WithTreeKey(search_key, [&](const TreeKeyType &tree_key) { return tree.Contains(tree_key); });
+  }
+
+  template <typename ScanVisitor>
+  inline void ScanRange(const KeyType &low_key, const KeyType &high_key, ScanVisitor &&visitor) {
+    WithTreeKeyRange(low_key, high_key, [&](const TreeKeyType &tree_low_key, const TreeKeyType &tree_high_key) {
+      tree.ScanRange(tree_low_key, tree_high_key, std::forward<ScanVisitor>(visitor));
+    });
+  }
+
+  template <typename ScanVisitor>
+  inline void ScanRangeReverse(const KeyType &low_key, const KeyType &high_key, ScanVisitor &&visitor) {
+    WithTreeKeyRange(low_key, high_key, [&](const TreeKeyType &tree_low_key, const TreeKeyType &tree_high_key) {
+      tree.ScanRangeReverse(tree_low_key, tree_high_key, std::forward<ScanVisitor>(visitor));
+    });
+  }
+
+  inline size_t DeleteRange(const KeyType &low_key, const KeyType &high_key) {
+    return WithTreeKeyRange(low_key, high_key,
+                            [&](const TreeKeyType &tree_low_key, const TreeKeyType &tree_high_key) {
+                              return tree.DeleteRange(tree_low_key, tree_high_key);
+                            });
+  }
+
+  inline size_t CountRange(const KeyType &low_key, const KeyType &high_key) {
+    return WithTreeKeyRange(low_key, high_key,
+                            [&](const TreeKeyType &tree_low_key, const TreeKeyType &tree_high_key) {
+                              return tree.CountRange(tree_low_key, tree_high_key);
+                            });
+  }
+
+  inline size_t Rank(const KeyType &key) {
+    return WithTreeKey(key, [&](const TreeKeyType &tree_key) { return tree.Rank(tree_key); });
+  }
+
+ private:
+  /*
+   * WithTreeKey() - Calls a function with the tree key of a key
+   *
+   * ByteKey refers to the normalized string, which lives until the
+   * function returns. The tree copies the bytes of keys it stores
+   */
+  template <typename Function>
+  inline decltype(auto) WithTreeKey(const KeyType &key, Function &&function) {
+    if constexpr (std::is_integral<NormalizedType>::value) {
+      return function(Normalize(key));
+    } else {
+      const std::string normalized_key = Normalize(key);
+      return function(ByteKey{normalized_key});
+    }
+  }
+
+  template <typename Function>
+  inline decltype(auto) WithTreeKeyRange(const KeyType &low_key, const KeyType &high_key, Function &&function) {
+    if constexpr (std::is_integral<NormalizedType>::value) {
+      return function(Normalize(low_key), Normalize(high_key));
+    } else {
+      const std::string normalized_low_key = Normalize(low_key);
+      const std::string normalized_high_key = Normalize(high_key);
+      return function(ByteKey{normalized_low_key}, ByteKey{normalized_high_key});
+    }
+  }
+};
+
+}  // namespace bwtree
@@ -7,6 +7,24 @@ namespace bwtree {
 // is free to change them
 thread_local int bwtree::BwTreeBase::gc_id = -1;
 
-std::atomic<size_t> bwtree::BwTreeBase::total_thread_num{0UL};
+// The GC ID claimed by RegisterThread(), which is released on thread exit
+thread_local bwtree::BwTreeBase::GCIDOwner bwtree::BwTreeBase::gc_id_owner;
+
+std::atomic<uint64_t> bwtree::BwTreeBase::gc_id_bitmap[bwtree::BwTreeBase::GC_ID_BITMAP_SIZE]{};
+
+std::atomic<size_t> bwtree::BwTreeBase::gc_id_high_water{0UL};
+
+std::atomic<uint64_t> bwtree::BwTreeBase::gc_id_sweep_bitmap[bwtree::BwTreeBase::GC_ID_BITMAP_SIZE]{};
+
+// Free node memory is kept per thread, and returned when the thread exits
+thread_local bwtree::BwTreeBase::NodeCache bwtree::BwTreeBase::node_cache;
+
+std::mutex bwtree::BwTreeBase::node_cache_list_lock;
+
+bwtree::BwTreeBase::NodeCache *bwtree::BwTreeBase::node_cache_list_head_p = nullptr;
+
+bwtree::BwTreeBase::NodeCacheCounters bwtree::BwTreeBase::exited_node_cache_stats{};
+
+std::atomic<size_t> bwtree::BwTreeBase::node_cache_reserved_size{0UL};
 
 }  // namespace bwtree
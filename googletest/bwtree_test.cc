@@ -1,5 +1,6 @@
 #include "bwtree.h"
 #include "bwtree_test_util.h"
+#include "key_normalizer.h"
 #include "multithread_test_util.h"
 #include "worker_pool.h"
 
@@ -7,9 +8,11 @@
 #include <gtest/gtest.h>
 
 #include <algorithm>
+#include <map>
 #include <random>
 #include <vector>
 #include <string>
+#include <tuple>
 
 /*******************************************************************************
  * The test structures stated here were written to give you and idea of what a
@@ -212,3 +215,1761 @@ TEST_F(BwtreeSkewedTest, ConcurrentInsertDelete) {
   tree->UpdateThreadLocal(1);
 }
 
+
+/*
+ * Bulk load sorted records with duplicated keys, then check point lookups,
+ * iteration order, and that the tree accepts modifications afterwards.
+ */
+TEST(BwtreeBulkLoadTest, LoadSortedRange) {
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+
+  // Every 16th key has 3 values to exercise duplicated key runs
+  const int64_t key_num = 64 * 1024;
+  std::vector<std::pair<int64_t, int64_t>> kv_list;
+  for (int64_t key = 0; key < key_num; key++) {
+    kv_list.emplace_back(key, key);
+    if (key % 16 == 0) {
+      kv_list.emplace_back(key, key + 1);
+      kv_list.emplace_back(key, key + 2);
+    }
+  }
+
+  EXPECT_TRUE(tree->BulkLoad(kv_list.begin(), kv_list.end()));
+  EXPECT_EQ(tree->GetSize(), kv_list.size());
+
+  // A loaded tree could not be loaded again
+  EXPECT_FALSE(tree->BulkLoad(kv_list.begin(), kv_list.end()));
+
+  for (int64_t key = 0; key < key_num; key++) {
+    EXPECT_EQ(tree->GetValue(key).size(), (key % 16 == 0) ? 3U : 1U);
+  }
+
+  size_t scan_count = 0;
+  for (auto it = tree->Begin(); !it.IsEnd(); it++) {
+    EXPECT_EQ(it->first, kv_list[scan_count].first);
+    scan_count++;
+  }
+  EXPECT_EQ(scan_count, kv_list.size());
+
+  for (int64_t key = 0; key < key_num; key += 2) {
+    EXPECT_TRUE(tree->Delete(key, key));
+    EXPECT_TRUE(tree->Insert(key_num + key, key));
+  }
+
+  for (int64_t key = 0; key < key_num; key++) {
+    EXPECT_EQ(tree->GetValue(key_num + key).size(), (key % 2 == 0) ? 1U : 0U);
+  }
+
+  delete tree;
+}
+
+/*
+ * Insert shuffled batches concurrently, with duplicates inside and across
+ * batches, and check that every record is inserted exactly once.
+ */
+TEST(BwtreeInsertBatchTest, ConcurrentBatches) {
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+  const uint32_t num_threads = test::MultiThreadTestUtil::HardwareConcurrency();
+  const int64_t key_num = 128 * 1024;
+  const size_t batch_size = 1000;
+  std::atomic<size_t> inserted_count = 0;
+  std::atomic<int> gc_id = 0;
+
+  common::WorkerPool thread_pool(num_threads, {});
+  thread_pool.Startup();
+
+  auto workload = [&](uint32_t id) {
+    const uint32_t gcid = gc_id.fetch_add(1);
+    std::default_random_engine thread_generator(id);
+    std::vector<std::pair<int64_t, int64_t>> kv_list;
+
+    tree->AssignGCID(gcid);
+
+    // Every thread tries to insert all keys, each with values 0 and 1
+    for (int64_t key = 0; key < key_num; key++) {
+      kv_list.emplace_back(key, key % 2);
+      kv_list.emplace_back(key, 1 - key % 2);
+    }
+    std::shuffle(kv_list.begin(), kv_list.end(), thread_generator);
+
+    for (size_t i = 0; i < kv_list.size(); i += batch_size) {
+      size_t end = std::min(kv_list.size(), i + batch_size);
+      inserted_count.fetch_add(tree->InsertBatch(kv_list.data() + i, kv_list.data() + end));
+    }
+
+    tree->UnregisterThread(gcid);
+  };
+
+  tree->UpdateThreadLocal(num_threads + 1);
+  test::MultiThreadTestUtil::RunThreadsUntilFinish(&thread_pool, num_threads, workload);
+  tree->UpdateThreadLocal(1);
+  tree->AssignGCID(0);
+
+  EXPECT_EQ(inserted_count.load(), 2 * key_num);
+  EXPECT_EQ(tree->GetSize(), 2 * key_num);
+
+  for (int64_t key = 0; key < key_num; key++) {
+    EXPECT_EQ(tree->GetValue(key).size(), 2U);
+  }
+
+  // Unique key batches reject keys that are present in the tree or batch
+  std::vector<std::pair<int64_t, int64_t>> unique_list{{0, 5}, {key_num, 0}, {key_num, 1}};
+  EXPECT_EQ(tree->InsertBatch(unique_list.data(), unique_list.data() + unique_list.size(), true), 1U);
+
+  delete tree;
+}
+
+/*
+ * Batched lookups must return the same values as one GetValue() per key,
+ * including keys that do not exist.
+ */
+TEST(BwtreeGetValueBatchTest, MatchesPointLookups) {
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+  const int64_t key_num = 64 * 1024;
+
+  for (int64_t key = 0; key < key_num; key += 2) {
+    EXPECT_TRUE(tree->Insert(key, key));
+    EXPECT_TRUE(tree->Insert(key, key + 1));
+  }
+
+  std::default_random_engine generator(0);
+  std::uniform_int_distribution<int64_t> uniform_dist(-16, key_num + 16);
+  std::vector<int64_t> key_list;
+  for (int i = 0; i < 10000; i++) {
+    key_list.push_back(uniform_dist(generator));
+  }
+
+  std::vector<std::vector<int64_t>> value_list;
+  tree->GetValueBatch(key_list, value_list);
+  ASSERT_EQ(value_list.size(), key_list.size());
+
+  for (size_t i = 0; i < key_list.size(); i++) {
+    std::vector<int64_t> expected;
+    tree->GetValue(key_list[i], expected);
+
+    std::sort(expected.begin(), expected.end());
+    std::sort(value_list[i].begin(), value_list[i].end());
+    EXPECT_EQ(value_list[i], expected);
+  }
+
+  delete tree;
+}
+
+/*
+ * Update and upsert records, and check values through point lookups, the
+ * iterator (which consolidates leaves) and subsequent inserts/deletes.
+ */
+TEST(BwtreeUpdateTest, UpdateAndUpsert) {
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+  const int64_t key_num = 16 * 1024;
+
+  for (int64_t key = 0; key < key_num; key++) {
+    EXPECT_TRUE(tree->Insert(key, key));
+  }
+
+  for (int64_t key = 0; key < key_num; key++) {
+    // Old value does not exist
+    EXPECT_FALSE(tree->Update(key, key + 1, key + 2));
+    EXPECT_TRUE(tree->Update(key, key, key + 1));
+    EXPECT_TRUE(tree->Update(key, key + 1, key + 2));
+
+    // Replacing and then re-inserting an old value keeps both
+    if (key % 3 == 0) {
+      EXPECT_TRUE(tree->Insert(key, key));
+    }
+  }
+
+  EXPECT_EQ(tree->GetSize(), key_num + (key_num + 2) / 3);
+
+  for (int64_t key = 0; key < key_num; key++) {
+    auto value_set = tree->GetValue(key);
+    EXPECT_EQ(value_set.size(), (key % 3 == 0) ? 2U : 1U);
+    EXPECT_EQ(value_set.count(key + 2), 1U);
+  }
+
+  // Upsert replaces existing keys and inserts missing ones
+  for (int64_t key = 1; key < key_num; key += 3) {
+    EXPECT_FALSE(tree->Upsert(key, -key));
+    EXPECT_FALSE(tree->Upsert(key, -key));
+    EXPECT_TRUE(tree->Upsert(key_num + key, key));
+  }
+
+  size_t scan_count = 0;
+  for (auto it = tree->Begin(); !it.IsEnd(); it++) {
+    if (it->first < key_num && it->first % 3 == 1) {
+      EXPECT_EQ(it->second, -it->first);
+    }
+    scan_count++;
+  }
+  EXPECT_EQ(scan_count, tree->GetSize());
+
+  for (int64_t key = 1; key < key_num; key += 3) {
+    EXPECT_FALSE(tree->Delete(key, key + 2));
+    EXPECT_TRUE(tree->Delete(key, -key));
+    EXPECT_EQ(tree->GetValue(key).size(), 0U);
+  }
+
+  // A delete delta of one value does not hide the other values of the key
+  EXPECT_TRUE(tree->Insert(-1, 1));
+  EXPECT_TRUE(tree->Insert(-1, 2));
+  EXPECT_TRUE(tree->Delete(-1, 1));
+  EXPECT_FALSE(tree->Upsert(-1, 3));
+  auto value_set = tree->GetValue(-1);
+  EXPECT_EQ(value_set.size(), 1U);
+  EXPECT_EQ(value_set.count(3), 1U);
+
+  delete tree;
+}
+
+/*
+ * Visitor based lookups must see the same values as GetValue(), and stop
+ * early when the visitor asks so.
+ */
+TEST(BwtreeVisitValueTest, ContainsAndGetFirst) {
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+  const int64_t key_num = 16 * 1024;
+
+  for (int64_t key = 0; key < key_num; key++) {
+    EXPECT_TRUE(tree->Insert(key, key));
+    if (key % 4 == 0) {
+      EXPECT_TRUE(tree->Insert(key, -key - 1));
+      EXPECT_TRUE(tree->Delete(key, key));
+    }
+  }
+
+  for (int64_t key = -1; key <= key_num; key++) {
+    bool exists = (key >= 0) && (key < key_num);
+    int64_t expected = (key % 4 == 0) ? -key - 1 : key;
+
+    EXPECT_EQ(tree->Contains(key), exists);
+
+    int64_t value = 12345;
+    EXPECT_EQ(tree->GetFirst(key, &value), exists);
+    EXPECT_EQ(value, exists ? expected : 12345);
+
+    size_t visit_count = 0;
+    tree->VisitValue(key, [&](const int64_t &v) {
+      EXPECT_EQ(v, expected);
+      visit_count++;
+      return true;
+    });
+    EXPECT_EQ(visit_count, exists ? 1U : 0U);
+  }
+
+  // Stop after the first of several values
+  for (int64_t value = 1; value < 10; value++) {
+    EXPECT_TRUE(tree->Insert(key_num, value));
+  }
+  size_t visit_count = 0;
+  tree->VisitValue(key_num, [&](const int64_t &v) {
+    (void)v;
+    visit_count++;
+    return false;
+  });
+  EXPECT_EQ(visit_count, 1U);
+
+  delete tree;
+}
+
+/*
+ * A tree declared with unique keys rejects a second value for a key even if
+ * Insert() is not told so, and lookups return the latest value.
+ */
+TEST(BwtreeUniqueKeyTest, RejectsDuplicatedKeys) {
+  using UniqueTreeType =
+      bwtree::BwTree<int64_t, int64_t, test::BwTreeTestUtil::KeyComparator, test::BwTreeTestUtil::KeyEqualityChecker,
+                     std::hash<int64_t>, std::equal_to<int64_t>, std::hash<int64_t>, true>;
+
+  auto *const tree = new UniqueTreeType{true, test::BwTreeTestUtil::KeyComparator{1},
+                                        test::BwTreeTestUtil::KeyEqualityChecker{1}};
+  tree->UpdateThreadLocal(1);
+  tree->AssignGCID(0);
+
+  const int64_t key_num = 16 * 1024;
+
+  for (int64_t key = 0; key < key_num; key++) {
+    bool predicate_satisfied;
+    EXPECT_TRUE(tree->Insert(key, key));
+    EXPECT_FALSE(tree->Insert(key, key + 1));
+    EXPECT_FALSE(tree->ConditionalInsert(key, key + 2, [](const int64_t) { return false; }, &predicate_satisfied));
+    EXPECT_FALSE(predicate_satisfied);
+  }
+
+  for (int64_t key = 0; key < key_num; key += 2) {
+    EXPECT_TRUE(tree->Delete(key, key));
+    EXPECT_TRUE(tree->Insert(key, -key - 1));
+  }
+
+  for (int64_t key = 0; key < key_num; key += 3) {
+    EXPECT_TRUE(tree->Update(key, tree->GetValue(key).count(key) ? key : -key - 1, key * 10));
+  }
+
+  for (int64_t key = 0; key < key_num; key++) {
+    int64_t expected = (key % 3 == 0) ? key * 10 : ((key % 2 == 0) ? -key - 1 : key);
+    int64_t value;
+
+    EXPECT_TRUE(tree->GetFirst(key, &value));
+    EXPECT_EQ(value, expected);
+
+    auto value_set = tree->GetValue(key);
+    EXPECT_EQ(value_set.size(), 1U);
+    EXPECT_EQ(value_set.count(expected), 1U);
+  }
+
+  // A deleted key could be inserted again, and only once
+  for (int64_t key = 1; key < key_num; key += 6) {
+    bool predicate_satisfied;
+    EXPECT_TRUE(tree->Delete(key, key));
+    EXPECT_TRUE(tree->ConditionalInsert(key, -key, [](const int64_t) { return false; }, &predicate_satisfied));
+    EXPECT_FALSE(tree->ConditionalInsert(key, key, [](const int64_t) { return false; }, &predicate_satisfied));
+    EXPECT_FALSE(predicate_satisfied);
+  }
+
+  int64_t item_count = 0;
+  for (auto it = tree->Begin(); !it.IsEnd(); it++) {
+    item_count++;
+  }
+  EXPECT_EQ(item_count, key_num);
+  EXPECT_EQ(tree->GetSize(), key_num);
+
+  delete tree;
+}
+
+/*
+ * Range scans must return the same items as the iterator, both on leaves
+ * with and without delta chains, and stop when the visitor returns false.
+ */
+TEST(BwtreeScanRangeTest, MatchesIterator) {
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+  const int64_t key_num = 64 * 1024;
+
+  std::vector<std::pair<int64_t, int64_t>> kv_list;
+  for (int64_t key = 0; key < key_num; key += 2) {
+    kv_list.emplace_back(key, key);
+  }
+  EXPECT_TRUE(tree->BulkLoad(kv_list.begin(), kv_list.end()));
+
+  // Leave delta chains on part of the leaves
+  for (int64_t key = 1; key < key_num / 2; key += 4) {
+    EXPECT_TRUE(tree->Insert(key, key));
+    EXPECT_TRUE(tree->Delete(key - 1, key - 1));
+  }
+
+  std::vector<std::pair<int64_t, int64_t>> expected;
+  for (auto it = tree->Begin(); !it.IsEnd(); it++) {
+    expected.emplace_back(it->first, it->second);
+  }
+
+  std::default_random_engine generator(0);
+  std::uniform_int_distribution<int64_t> uniform_dist(-10, key_num + 10);
+  for (int i = 0; i < 100; i++) {
+    int64_t low = uniform_dist(generator);
+    int64_t high = low + uniform_dist(generator) / 4;
+
+    std::vector<std::pair<int64_t, int64_t>> result;
+    tree->ScanRange(low, high, [&](const int64_t &key, const int64_t &value) {
+      result.emplace_back(key, value);
+      return true;
+    });
+
+    std::vector<std::pair<int64_t, int64_t>> expected_range;
+    for (const auto &item : expected) {
+      if (item.first >= low && item.first <= high) {
+        expected_range.push_back(item);
+      }
+    }
+    EXPECT_EQ(result, expected_range);
+  }
+
+  size_t visit_count = 0;
+  tree->ScanRange(0, key_num, [&](const int64_t &key, const int64_t &value) {
+    (void)key;
+    (void)value;
+    return ++visit_count < 1000;
+  });
+  EXPECT_EQ(visit_count, 1000U);
+
+  delete tree;
+}
+
+/*
+ * Reverse range scans and reverse iterators must return the items of the
+ * forward iterator in reverse order.
+ */
+TEST(BwtreeScanRangeTest, ReverseMatchesIterator) {
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+  const int64_t key_num = 64 * 1024;
+
+  // Negative keys are below the (invalid) low key of the leftmost parent
+  std::vector<std::pair<int64_t, int64_t>> kv_list;
+  for (int64_t key = -key_num / 4; key < key_num; key += 2) {
+    kv_list.emplace_back(key, key);
+  }
+  EXPECT_TRUE(tree->BulkLoad(kv_list.begin(), kv_list.end()));
+
+  // Leave delta chains on part of the leaves
+  for (int64_t key = 1; key < key_num / 2; key += 4) {
+    EXPECT_TRUE(tree->Insert(key, key));
+    EXPECT_TRUE(tree->Delete(key - 1, key - 1));
+  }
+
+  std::vector<std::pair<int64_t, int64_t>> expected;
+  for (auto it = tree->Begin(); !it.IsEnd(); it++) {
+    expected.emplace_back(it->first, it->second);
+  }
+  std::reverse(expected.begin(), expected.end());
+
+  std::vector<std::pair<int64_t, int64_t>> result;
+  for (auto it = tree->RBegin(key_num); !it.IsREnd(); it--) {
+    result.emplace_back(it->first, it->second);
+  }
+  EXPECT_EQ(result, expected);
+
+  std::default_random_engine generator(0);
+  std::uniform_int_distribution<int64_t> uniform_dist(-10, key_num + 10);
+  for (int i = 0; i < 100; i++) {
+    int64_t low = uniform_dist(generator);
+    int64_t high = low + uniform_dist(generator) / 4;
+
+    result.clear();
+    tree->ScanRangeReverse(low, high, [&](const int64_t &key, const int64_t &value) {
+      result.emplace_back(key, value);
+      return true;
+    });
+
+    std::vector<std::pair<int64_t, int64_t>> expected_range;
+    for (const auto &item : expected) {
+      if (item.first >= low && item.first <= high) {
+        expected_range.push_back(item);
+      }
+    }
+    EXPECT_EQ(result, expected_range);
+
+    result.clear();
+    for (auto it = tree->RBegin(high); !it.IsREnd() && it->first >= low; it--) {
+      result.emplace_back(it->first, it->second);
+    }
+    EXPECT_EQ(result, expected_range);
+  }
+
+  EXPECT_TRUE(tree->RBegin(-key_num / 4 - 1).IsREnd());
+
+  delete tree;
+}
+
+/*
+ * Range deletes must remove exactly the items in the range, on leaves with
+ * and without delta chains, and keep the tree usable for later inserts.
+ */
+TEST(BwtreeDeleteRangeTest, MatchesPointDeletes) {
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+  const int64_t key_num = 64 * 1024;
+
+  std::vector<std::pair<int64_t, int64_t>> kv_list;
+  for (int64_t key = 0; key < key_num; key += 2) {
+    kv_list.emplace_back(key, key);
+  }
+  EXPECT_TRUE(tree->BulkLoad(kv_list.begin(), kv_list.end()));
+
+  // Leave delta chains on part of the leaves
+  for (int64_t key = 1; key < key_num / 2; key += 4) {
+    EXPECT_TRUE(tree->Insert(key, key));
+  }
+
+  std::vector<std::pair<int64_t, int64_t>> expected;
+  for (auto it = tree->Begin(); !it.IsEnd(); it++) {
+    expected.emplace_back(it->first, it->second);
+  }
+
+  std::default_random_engine generator(0);
+  std::uniform_int_distribution<int64_t> uniform_dist(-10, key_num + 10);
+  for (int i = 0; i < 20; i++) {
+    int64_t low = uniform_dist(generator);
+    int64_t high = low + uniform_dist(generator) / 16;
+
+    auto remove_it = std::remove_if(expected.begin(), expected.end(), [&](const std::pair<int64_t, int64_t> &item) {
+      return item.first >= low && item.first <= high;
+    });
+    size_t expected_count = expected.end() - remove_it;
+    expected.erase(remove_it, expected.end());
+
+    EXPECT_EQ(tree->DeleteRange(low, high), expected_count);
+    EXPECT_EQ(tree->GetSize(), expected.size());
+  }
+
+  std::vector<std::pair<int64_t, int64_t>> result;
+  for (auto it = tree->Begin(); !it.IsEnd(); it++) {
+    result.emplace_back(it->first, it->second);
+  }
+  EXPECT_EQ(result, expected);
+
+  // Deleted keys could be inserted again
+  EXPECT_EQ(tree->DeleteRange(0, key_num), expected.size());
+  for (int64_t key = 0; key < key_num; key += 3) {
+    EXPECT_TRUE(tree->Insert(key, key));
+  }
+  for (int64_t key = 0; key < key_num; key++) {
+    std::vector<int64_t> value_set;
+    tree->GetValue(key, value_set);
+    EXPECT_EQ(value_set.size(), key % 3 == 0 ? 1U : 0U);
+  }
+
+  delete tree;
+}
+
+/*
+ * Range counts, ranks and selects must agree with the iterator on a bulk
+ * loaded tree. After inserts and deletes leave delta chains and duplicated
+ * keys, they are estimates that must stay close to the iterator.
+ */
+TEST(BwtreeCountRangeTest, MatchesIterator) {
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+  const int64_t key_num = 64 * 1024;
+
+  std::vector<std::pair<int64_t, int64_t>> kv_list;
+  for (int64_t key = 0; key < key_num; key += 2) {
+    kv_list.emplace_back(key, key);
+  }
+  EXPECT_TRUE(tree->BulkLoad(kv_list.begin(), kv_list.end()));
+
+  std::default_random_engine generator(0);
+  std::uniform_int_distribution<int64_t> uniform_dist(-10, key_num + 10);
+
+  // Compares with the iterator, allowing results to be off by tolerance
+  auto check = [&](int64_t tolerance) {
+    std::vector<std::pair<int64_t, int64_t>> expected;
+    for (auto it = tree->Begin(); !it.IsEnd(); it++) {
+      expected.emplace_back(it->first, it->second);
+    }
+
+    for (int i = 0; i < 100; i++) {
+      int64_t low = uniform_dist(generator);
+      int64_t high = low + uniform_dist(generator) / 4;
+
+      int64_t expected_count = 0;
+      int64_t expected_rank = 0;
+      for (const auto &item : expected) {
+        expected_count += (item.first >= low && item.first <= high) ? 1 : 0;
+        expected_rank += (item.first < low) ? 1 : 0;
+      }
+      EXPECT_LE(std::abs(static_cast<int64_t>(tree->CountRange(low, high)) - expected_count), tolerance);
+      EXPECT_LE(std::abs(static_cast<int64_t>(tree->Rank(low)) - expected_rank), tolerance);
+
+      size_t rank = uniform_dist(generator) % expected.size();
+      auto it = tree->Select(rank);
+      ASSERT_FALSE(it.IsEnd());
+      // Values of a key are not sorted
+      auto item_it = std::find(expected.begin(), expected.end(), *it);
+      ASSERT_NE(item_it, expected.end());
+      int64_t position = item_it - expected.begin();
+      EXPECT_LE(std::abs(position - static_cast<int64_t>(rank)), tolerance);
+    }
+
+    EXPECT_EQ(tree->CountRange(1, 0), 0U);
+    EXPECT_TRUE(tree->Select(expected.size() + tolerance).IsEnd());
+  };
+
+  check(0);
+
+  // Leave delta chains and duplicated keys on part of the leaves
+  for (int64_t key = 1; key < key_num / 2; key += 4) {
+    EXPECT_TRUE(tree->Insert(key, key));
+    EXPECT_TRUE(tree->Insert(key, key + 1));
+    EXPECT_TRUE(tree->Delete(key - 1, key - 1));
+  }
+
+  // Inner nodes see changes of their children when the children are
+  // consolidated, so the estimates are off by at most a few leaves
+  check(8 * tree->GetLeafNodeSizeUpperThreshold());
+
+  delete tree;
+}
+
+/*
+ * Trees with integer keys and the default comparator use the integer key
+ * search. Lookups and scans must match those with the test comparator,
+ * including negative keys and unsigned keys with the top bit set.
+ */
+TEST(BwtreeIntegerKeySearchTest, MatchesComparatorSearch) {
+  static_assert(bwtree::BwTree<int64_t, int64_t>::INTEGER_KEY_SEARCH, "int64_t keys use the integer search");
+  static_assert(!test::BwTreeTestUtil::TreeType::INTEGER_KEY_SEARCH, "custom comparators use std::lower_bound");
+
+  auto *const signed_tree = new bwtree::BwTree<int64_t, int64_t>{};
+  auto *const unsigned_tree = new bwtree::BwTree<uint64_t, uint64_t>{};
+  auto *const reference_tree = test::BwTreeTestUtil::GetEmptyTree();
+
+  std::default_random_engine generator(0);
+  std::uniform_int_distribution<int64_t> uniform_dist(-4096, 4096);
+  for (int i = 0; i < 64 * 1024; i++) {
+    int64_t key = uniform_dist(generator) * 1024;
+    int64_t value = i;
+
+    signed_tree->Insert(key, value);
+    unsigned_tree->Insert(static_cast<uint64_t>(key), static_cast<uint64_t>(value));
+    reference_tree->Insert(key, value);
+  }
+
+  for (int64_t key = -4097 * 1024; key <= 4097 * 1024; key += 512) {
+    std::vector<int64_t> expected;
+    reference_tree->GetValue(key, expected);
+    std::sort(expected.begin(), expected.end());
+
+    std::vector<int64_t> signed_result;
+    signed_tree->GetValue(key, signed_result);
+    std::sort(signed_result.begin(), signed_result.end());
+    EXPECT_EQ(signed_result, expected);
+
+    std::vector<uint64_t> unsigned_result;
+    unsigned_tree->GetValue(static_cast<uint64_t>(key), unsigned_result);
+    EXPECT_EQ(unsigned_result.size(), expected.size());
+  }
+
+  // Unsigned keys wrap around, so the negative keys come after the others
+  std::vector<uint64_t> unsigned_keys;
+  unsigned_tree->ScanRange(0, UINT64_MAX, [&](const uint64_t &key, const uint64_t &value) {
+    (void)value;
+    unsigned_keys.push_back(key);
+    return true;
+  });
+  EXPECT_EQ(unsigned_keys.size(), unsigned_tree->GetSize());
+  EXPECT_TRUE(std::is_sorted(unsigned_keys.begin(), unsigned_keys.end()));
+
+  EXPECT_EQ(signed_tree->CountRange(-1024 * 1024, 1024 * 1024), reference_tree->CountRange(-1024 * 1024, 1024 * 1024));
+
+  delete signed_tree;
+  delete unsigned_tree;
+  delete reference_tree;
+}
+
+/*
+ * Separator searches on the inner nodes of a tree find the same separators as
+ * searches on the elements
+ */
+TEST(BwtreeKeyTreeTest, MatchesSeparators) {
+  using TreeType = test::BwTreeTestUtil::TreeType;
+  static_assert(!TreeType::LeafNode::KEY_TREE, "leaf nodes have no key tree");
+
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+
+  const int key_num = 64 * 1024;
+  for (int i = 0; i < key_num; i++) {
+    tree->Insert(i * 2, i);
+  }
+
+  const auto *node_p = tree->GetNode(tree->root_id.load());
+  ASSERT_FALSE(node_p->IsOnLeafDeltaChain());
+  const auto *inner_node_p = TreeType::InnerNode::GetNodeHeader(&node_p->GetLowKeyPair());
+
+  const int size = inner_node_p->GetSize();
+  ASSERT_GT(size, 1);
+
+  for (int64_t key = -1; key <= key_num * 2; key += 7) {
+    auto expected = std::upper_bound(
+        inner_node_p->Begin() + 1, inner_node_p->End(), key,
+        [](const int64_t &search_key, const TreeType::KeyNodeIDPair &element) { return search_key < element.first; });
+    EXPECT_EQ(tree->NodeKeyUpperBound(inner_node_p, inner_node_p->Begin() + 1, inner_node_p->End(), key), expected);
+  }
+
+  for (int i = 0; i < key_num; i += 97) {
+    std::vector<int64_t> value_set;
+    tree->GetValue(i * 2, value_set);
+    ASSERT_EQ(value_set.size(), 1);
+    EXPECT_EQ(value_set[0], i);
+  }
+
+  delete tree;
+}
+
+/*
+ * The key tree of inner nodes finds the same separators as a binary search on
+ * the elements for all node sizes
+ */
+TEST(BwtreeKeyTreeTest, MatchesUpperBound) {
+  using TreeType = test::BwTreeTestUtil::TreeType;
+  using InnerElasticNode = TreeType::ElasticNode<TreeType::KeyNodeIDPair>;
+  static_assert(InnerElasticNode::KEY_TREE, "inner nodes of trivially copyable keys have a key tree");
+
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+
+  for (int size = 1; size <= 2 * INNER_NODE_SIZE_UPPER_THRESHOLD; size++) {
+    auto *node_p = InnerElasticNode::Get(size, TreeType::NodeType::InnerType, 0, size, std::make_pair(0, 1),
+                                         std::make_pair(0, INVALID_NODE_ID));
+    for (int i = 0; i < size; i++) {
+      node_p->PushBack(std::make_pair(static_cast<int64_t>(i * 2), static_cast<uint64_t>(i + 1)));
+    }
+
+    for (int64_t key = -1; key <= size * 2; key++) {
+      auto expected = std::upper_bound(
+          node_p->Begin() + 1, node_p->End(), key,
+          [](const int64_t &search_key, const TreeType::KeyNodeIDPair &element) { return search_key < element.first; });
+      EXPECT_EQ(tree->KeyTreeUpperBound(node_p, key), expected);
+
+      // A part of the node as after inner delta nodes
+      const auto *start_p = node_p->Begin() + 1 + (size - 1) / 3;
+      const auto *end_p = node_p->End() - (size - 1) / 3;
+      EXPECT_EQ(tree->NodeKeyUpperBound<TreeType::KeyNodeIDPair>(node_p, start_p, end_p, key),
+                std::min(std::max<const TreeType::KeyNodeIDPair *>(expected, start_p), end_p));
+    }
+
+    node_p->Destroy();
+  }
+
+  delete tree;
+}
+
+/*
+ * ByteKey keys are ordered as std::string, and the tree keeps its own copy of
+ * key bytes so the caller's buffer could be reused after each call
+ */
+TEST(BwtreeByteKeyTest, MatchesStringKeys) {
+  using TreeType = bwtree::BwTree<bwtree::ByteKey, int64_t>;
+  static_assert(TreeType::BYTE_KEY, "ByteKey bytes are stored in the nodes");
+  static_assert(std::is_trivially_copyable<bwtree::ByteKey>::value, "ByteKey is copied without allocation");
+
+  std::default_random_engine generator(0);
+  std::uniform_int_distribution<int> size_dist(0, 24);
+  std::uniform_int_distribution<int> byte_dist(0, 3);
+
+  // Few distinct bytes with zeros and common prefixes of various lengths
+  auto random_string = [&]() {
+    std::string str(size_dist(generator), '\0');
+    for (auto &c : str) {
+      c = static_cast<char>(byte_dist(generator) == 0 ? 0 : 0xF0 + byte_dist(generator));
+    }
+    return str;
+  };
+
+  for (int i = 0; i < 10000; i++) {
+    std::string str_1 = random_string();
+    std::string str_2 = random_string();
+    EXPECT_EQ(bwtree::ByteKey{str_1} < bwtree::ByteKey{str_2}, str_1 < str_2);
+    EXPECT_EQ(bwtree::ByteKey{str_1} == bwtree::ByteKey{str_2}, str_1 == str_2);
+  }
+
+  auto *const tree = new TreeType{};
+  std::map<std::string, int64_t> reference_map;
+
+  std::string buffer;
+  for (int64_t i = 0; i < 32 * 1024; i++) {
+    buffer = "tenant-" + std::to_string(i % 7) + "/" + random_string();
+    bool inserted = tree->Insert(bwtree::ByteKey{buffer}, i, true);
+    EXPECT_EQ(inserted, reference_map.emplace(buffer, i).second);
+
+    // The tree must not refer to the caller's bytes
+    std::fill(buffer.begin(), buffer.end(), 'x');
+  }
+  for (auto it = reference_map.begin(); it != reference_map.end(); it++) {
+    if (it->second % 3 == 0) {
+      buffer = it->first;
+      EXPECT_TRUE(tree->Delete(bwtree::ByteKey{buffer}, it->second));
+      std::fill(buffer.begin(), buffer.end(), 'x');
+    }
+  }
+
+  std::vector<std::pair<std::string, int64_t>> expected;
+  for (const auto &[key, value] : reference_map) {
+    if (value % 3 != 0) {
+      expected.emplace_back(key, value);
+    }
+  }
+
+  std::vector<std::pair<std::string, int64_t>> result;
+  for (auto it = tree->Begin(); !it.IsEnd(); it++) {
+    result.emplace_back(std::string{it->first.ToStringView()}, it->second);
+  }
+  EXPECT_EQ(result, expected);
+
+  for (const auto &[key, value] : expected) {
+    std::vector<int64_t> value_set;
+    tree->GetValue(bwtree::ByteKey{key}, value_set);
+    ASSERT_EQ(value_set.size(), 1);
+    EXPECT_EQ(value_set[0], value);
+  }
+
+  delete tree;
+}
+
+/*
+ * ByteKey bytes are stored in the nodes holding them, such that node memory
+ * does not grow over rounds of inserting and deleting the same keys, and an
+ * iterator keeps its own copy after the tree frees the nodes
+ */
+TEST(BwtreeByteKeyTest, FreesKeysWithNodes) {
+  using TreeType = bwtree::BwTree<bwtree::ByteKey, int64_t>;
+
+  // This thread may free blocks allocated by other threads in earlier tests,
+  // so only blocks allocated and freed after this point are counted
+  const auto start_stats = bwtree::BwTreeBase::GetThreadNodeCacheStats();
+  auto get_live_block_count = [&start_stats] {
+    auto stats = bwtree::BwTreeBase::GetThreadNodeCacheStats();
+    return static_cast<int64_t>(stats.allocate_count - start_stats.allocate_count) -
+           static_cast<int64_t>(stats.free_count - start_stats.free_count);
+  };
+
+  auto *const tree = new TreeType{false};
+  const int key_num = 4096;
+
+  auto get_key = [](int i) { return std::string(48, 'k') + std::to_string(i); };
+
+  std::string buffer;
+  std::vector<int64_t> live_block_count_list;
+  for (int round = 0; round < 8; round++) {
+    for (int i = 0; i < key_num; i++) {
+      buffer = get_key(i);
+      EXPECT_TRUE(tree->Insert(bwtree::ByteKey{buffer}, i));
+      std::fill(buffer.begin(), buffer.end(), 'x');
+    }
+
+    // Key bytes of deltas are reused from the leaf
+    for (int i = 0; i < key_num; i += 2) {
+      buffer = get_key(i);
+      EXPECT_TRUE(tree->Update(bwtree::ByteKey{buffer}, i, -i));
+      EXPECT_TRUE(tree->Delete(bwtree::ByteKey{buffer}, -i));
+      std::fill(buffer.begin(), buffer.end(), 'x');
+    }
+    for (int i = 1; i < key_num; i += 2) {
+      buffer = get_key(i);
+      EXPECT_TRUE(tree->Delete(bwtree::ByteKey{buffer}, i));
+      std::fill(buffer.begin(), buffer.end(), 'x');
+    }
+
+    for (int i = 0; i < 4; i++) {
+      tree->PerformGarbageCollection();
+    }
+    live_block_count_list.push_back(get_live_block_count());
+  }
+
+  // Garbage of this thread is freed during its own operations, so the count
+  // is not exact
+  EXPECT_LE(live_block_count_list.back(), live_block_count_list.front() + live_block_count_list.front() / 4);
+
+  buffer = get_key(1);
+  EXPECT_TRUE(tree->Insert(bwtree::ByteKey{buffer}, 1));
+  auto it = tree->Begin(bwtree::ByteKey{buffer});
+  std::fill(buffer.begin(), buffer.end(), 'x');
+  buffer = get_key(1);
+  EXPECT_TRUE(tree->Delete(bwtree::ByteKey{buffer}, 1));
+  for (int i = 0; i < key_num; i++) {
+    buffer = get_key(i);
+    EXPECT_TRUE(tree->Insert(bwtree::ByteKey{buffer}, i));
+  }
+  for (int i = 0; i < 4; i++) {
+    tree->PerformGarbageCollection();
+  }
+  ASSERT_FALSE(it.IsEnd());
+  EXPECT_EQ(it->first.ToStringView(), get_key(1));
+
+  delete tree;
+}
+
+/*
+ * Stripped keys, whose head is stored apart from the other bytes, compare,
+ * hash and copy the same as keys that are not stripped, whether or not they
+ * share the head
+ */
+TEST(BwtreeByteKeyTest, ComparesStrippedKeys) {
+  std::default_random_engine generator(0);
+  std::uniform_int_distribution<int> size_dist(0, 24);
+  std::uniform_int_distribution<int> byte_dist(0, 3);
+
+  auto random_string = [&](int size) {
+    std::string str(size, '\0');
+    for (auto &c : str) {
+      c = static_cast<char>(byte_dist(generator) == 0 ? 0 : 0xF0 + byte_dist(generator));
+    }
+    return str;
+  };
+
+  // Stores the bytes after the head with the pointer to the head before them,
+  // as a node does
+  auto strip = [](std::vector<char> *buffer_p, const std::string &head, const std::string &str) {
+    const char *head_p = head.data();
+    buffer_p->resize(sizeof(head_p) + str.size() - head.size());
+    std::memcpy(buffer_p->data(), &head_p, sizeof(head_p));
+    std::memcpy(buffer_p->data() + sizeof(head_p), str.data() + head.size(), str.size() - head.size());
+    return bwtree::ByteKey{head_p, static_cast<uint32_t>(head.size()), buffer_p->data() + sizeof(head_p),
+                           static_cast<uint32_t>(str.size())};
+  };
+
+  std::vector<char> buffer_1;
+  std::vector<char> buffer_2;
+  for (int i = 0; i < 10000; i++) {
+    // Short alphabets make heads of the same bytes at other addresses
+    const std::string head_1 = random_string(16 + size_dist(generator) % 3);
+    const std::string head_2 = (i % 2 == 0) ? head_1 : random_string(16 + size_dist(generator) % 3);
+    const std::string str_1 = head_1 + random_string(size_dist(generator));
+    const std::string str_2 = head_2 + random_string(size_dist(generator));
+    const std::string str_3 = random_string(size_dist(generator) + 8);
+
+    const bwtree::ByteKey key_1 = strip(&buffer_1, head_1, str_1);
+    const bwtree::ByteKey key_2 = strip(&buffer_2, head_2, str_2);
+    const bwtree::ByteKey key_3{str_3};
+    EXPECT_EQ(key_1.GetHeadSize(), head_1.size());
+    EXPECT_EQ(key_1.ToString(), str_1);
+
+    EXPECT_EQ(key_1 < key_2, str_1 < str_2);
+    EXPECT_EQ(key_2 < key_1, str_2 < str_1);
+    EXPECT_EQ(key_1 == key_2, str_1 == str_2);
+    EXPECT_EQ(key_1 < key_3, str_1 < str_3);
+    EXPECT_EQ(key_3 < key_1, str_3 < str_1);
+    EXPECT_EQ(key_1 == bwtree::ByteKey{str_1}, true);
+    EXPECT_EQ(std::hash<bwtree::ByteKey>{}(key_1), std::hash<bwtree::ByteKey>{}(bwtree::ByteKey{str_1}));
+
+    const auto common_size =
+        static_cast<uint32_t>(std::mismatch(str_1.begin(), str_1.begin() + std::min(str_1.size(), str_2.size()),
+                                            str_2.begin())
+                                  .first -
+                              str_1.begin());
+    EXPECT_EQ(bwtree::ByteKey::CommonPrefixSize(key_1, key_2), common_size);
+    EXPECT_EQ(bwtree::ByteKey::Compare(key_1, key_2, common_size) < 0, str_1 < str_2);
+  }
+}
+
+/*
+ * A tree that strips key prefixes stores the common prefix of the low key and
+ * the high key once per node, finds the same elements on nodes as searches on
+ * the bytes, and reads and writes the same items as a map
+ */
+TEST(BwtreeByteKeyTest, StripsKeyPrefix) {
+  using TreeType = bwtree::BwTree<bwtree::ByteKey, int64_t, std::less<bwtree::ByteKey>,
+                                  std::equal_to<bwtree::ByteKey>, std::hash<bwtree::ByteKey>, std::equal_to<int64_t>,
+                                  std::hash<int64_t>, false, true>;
+  using LeafElasticNode = TreeType::ElasticNode<TreeType::KeyValuePair>;
+  using InnerElasticNode = TreeType::ElasticNode<TreeType::KeyNodeIDPair>;
+  using PlainTreeType = bwtree::BwTree<bwtree::ByteKey, int64_t>;
+  using PlainLeafElasticNode = PlainTreeType::ElasticNode<PlainTreeType::KeyValuePair>;
+  static_assert(TreeType::STRIP_KEY_PREFIX && !PlainTreeType::STRIP_KEY_PREFIX, "only the first tree strips keys");
+
+  // Tenant, date and sequence number
+  auto get_key = [](int tenant, int seq) {
+    std::string seq_str = std::to_string(seq);
+    return "tenant-" + std::to_string(tenant) + "/2026-10-17/" + std::string(8 - seq_str.size(), '0') + seq_str;
+  };
+
+  const std::string low_key = get_key(1, 0);
+  const std::string high_key = get_key(1, 99999);
+  const auto head_size = static_cast<uint32_t>(low_key.size() - 5);
+  ASSERT_GE(head_size, TreeType::MIN_STRIPPED_PREFIX_SIZE);
+
+  auto *const tree = new TreeType{false};
+  const int size = LEAF_NODE_SIZE_UPPER_THRESHOLD;
+
+  std::vector<std::string> key_list;
+  for (int i = 0; i < size; i++) {
+    key_list.push_back(get_key(1, i * 3));
+  }
+
+  auto *leaf_node_p =
+      LeafElasticNode::Get(size, TreeType::NodeType::LeafType, 0, size, std::make_pair(bwtree::ByteKey{low_key}, 2),
+                           std::make_pair(bwtree::ByteKey{high_key}, 3));
+  auto *plain_leaf_node_p = PlainLeafElasticNode::Get(size, PlainTreeType::NodeType::LeafType, 0, size,
+                                                      std::make_pair(bwtree::ByteKey{low_key}, 2),
+                                                      std::make_pair(bwtree::ByteKey{high_key}, 3));
+  for (int i = 0; i < size; i++) {
+    leaf_node_p->PushBack(std::make_pair(bwtree::ByteKey{key_list[i]}, i));
+    plain_leaf_node_p->PushBack(std::make_pair(bwtree::ByteKey{key_list[i]}, i));
+  }
+  ASSERT_EQ(leaf_node_p->GetKeyHeadSize(), head_size);
+
+  for (int i = 0; i < size; i++) {
+    EXPECT_EQ(leaf_node_p->Begin()[i].first.GetHeadSize(), head_size);
+    EXPECT_EQ(leaf_node_p->Begin()[i].first.ToString(), key_list[i]);
+  }
+
+  // Each key saves the bytes of the head minus the pointer to the head
+  EXPECT_LE(LeafElasticNode::GetAllocationHeader(leaf_node_p)->GetAllocatedSize() + size * 8,
+            PlainLeafElasticNode::GetAllocationHeader(plain_leaf_node_p)->GetAllocatedSize());
+
+  // Keys below, inside and above the head, and prefixes of the head
+  std::vector<std::string> search_key_list = {"", "tenant-0", "tenant-1", low_key.substr(0, head_size), "tenant-2",
+                                              std::string(head_size + 4, '\xFF')};
+  for (int i = -1; i <= size * 3; i++) {
+    search_key_list.push_back(get_key(1, i));
+  }
+
+  for (const auto &search_key : search_key_list) {
+    for (int margin = 0; margin <= 2; margin++) {
+      const auto *start_p = leaf_node_p->Begin() + margin;
+      const auto *end_p = leaf_node_p->End() - margin;
+      auto lower_index = std::lower_bound(key_list.begin() + margin, key_list.end() - margin, search_key) -
+                         key_list.begin();
+      auto upper_index = std::upper_bound(key_list.begin() + margin, key_list.end() - margin, search_key) -
+                         key_list.begin();
+
+      EXPECT_EQ(tree->KeyLowerBound(start_p, end_p, bwtree::ByteKey{search_key}) - leaf_node_p->Begin(), lower_index);
+      EXPECT_EQ(tree->KeyUpperBound(start_p, end_p, bwtree::ByteKey{search_key}) - leaf_node_p->Begin(), upper_index);
+    }
+  }
+
+  // The first separator of an inner node is its low key
+  auto *inner_node_p = InnerElasticNode::Get(size, TreeType::NodeType::InnerType, 0, size,
+                                             std::make_pair(bwtree::ByteKey{key_list[0]}, 2),
+                                             std::make_pair(bwtree::ByteKey{high_key}, 3));
+  for (int i = 0; i < size; i++) {
+    inner_node_p->PushBack(std::make_pair(bwtree::ByteKey{key_list[i]}, static_cast<uint64_t>(i + 2)));
+  }
+  ASSERT_EQ(inner_node_p->GetKeyHeadSize(), head_size);
+
+  for (const auto &search_key : search_key_list) {
+    auto upper_index = std::upper_bound(key_list.begin() + 1, key_list.end(), search_key) - key_list.begin();
+    EXPECT_EQ(tree->KeyTreeUpperBound(inner_node_p, bwtree::ByteKey{search_key}) - inner_node_p->Begin(),
+              upper_index);
+  }
+
+  leaf_node_p->Destroy();
+  plain_leaf_node_p->Destroy();
+  inner_node_p->Destroy();
+
+  std::default_random_engine generator(0);
+  std::uniform_int_distribution<int> tenant_dist(0, 3);
+  std::uniform_int_distribution<int> seq_dist(0, 64 * 1024);
+
+  std::map<std::string, int64_t> reference_map;
+  std::string buffer;
+  for (int64_t i = 0; i < 32 * 1024; i++) {
+    buffer = get_key(tenant_dist(generator), seq_dist(generator));
+    EXPECT_EQ(tree->Insert(bwtree::ByteKey{buffer}, i, true), reference_map.emplace(buffer, i).second);
+    std::fill(buffer.begin(), buffer.end(), 'x');
+  }
+  for (auto it = reference_map.begin(); it != reference_map.end();) {
+    if (it->second % 3 == 0) {
+      buffer = it->first;
+      EXPECT_TRUE(tree->Delete(bwtree::ByteKey{buffer}, it->second));
+      it = reference_map.erase(it);
+    } else {
+      it++;
+    }
+  }
+
+  std::vector<std::pair<std::string, int64_t>> expected(reference_map.begin(), reference_map.end());
+  std::vector<std::pair<std::string, int64_t>> result;
+  size_t stripped_key_num = 0;
+  for (auto it = tree->Begin(); !it.IsEnd(); it++) {
+    result.emplace_back(it->first.ToString(), it->second);
+    stripped_key_num += (it->first.GetHeadSize() > 0) ? 1 : 0;
+  }
+  EXPECT_EQ(result, expected);
+  EXPECT_GT(stripped_key_num, expected.size() / 2);
+
+  result.clear();
+  tree->ScanRange(bwtree::ByteKey{get_key(1, 0)}, bwtree::ByteKey{get_key(2, 0)},
+                  [&result](const bwtree::ByteKey &key, const int64_t &value) {
+                    result.emplace_back(key.ToString(), value);
+                    return true;
+                  });
+  expected.assign(reference_map.lower_bound(get_key(1, 0)), reference_map.upper_bound(get_key(2, 0)));
+  EXPECT_EQ(result, expected);
+
+  for (const auto &[key, value] : reference_map) {
+    std::vector<int64_t> value_set;
+    tree->GetValue(bwtree::ByteKey{key}, value_set);
+    ASSERT_EQ(value_set.size(), 1);
+    EXPECT_EQ(value_set[0], value);
+  }
+
+  delete tree;
+}
+
+/*
+ * Composite keys normalized into an integer or a byte string are found and
+ * scanned in the order of the composite key comparison
+ */
+TEST(BwtreeKeyNormalizerTest, MatchesCompositeOrder) {
+  using CompositeKey = std::tuple<int32_t, int64_t, std::string>;
+
+  struct IntegerNormalizer {
+    // 16 bit tenant and 48 bit time
+    uint64_t operator()(const std::tuple<int32_t, int64_t> &key) const {
+      return (static_cast<uint64_t>(bwtree::NormalizeInteger(static_cast<int16_t>(std::get<0>(key)))) << 48) |
+             static_cast<uint64_t>(std::get<1>(key) + (1L << 47));
+    }
+  };
+
+  struct StringNormalizer {
+    std::string operator()(const CompositeKey &key) const {
+      std::string normalized_key;
+      bwtree::AppendNormalized(&normalized_key, std::get<0>(key));
+      bwtree::AppendNormalized(&normalized_key, std::get<2>(key));
+      bwtree::AppendNormalized(&normalized_key, std::get<1>(key));
+      return normalized_key;
+    }
+  };
+
+  using IntegerTreeType = bwtree::NormalizedBwTree<std::tuple<int32_t, int64_t>, int64_t, IntegerNormalizer>;
+  using StringTreeType = bwtree::NormalizedBwTree<CompositeKey, int64_t, StringNormalizer>;
+  static_assert(IntegerTreeType::TreeType::INTEGER_KEY_SEARCH, "normalized integers use the integer search");
+  static_assert(StringTreeType::TreeType::BYTE_KEY, "normalized strings are ByteKey");
+
+  auto *const integer_tree = new IntegerTreeType{};
+  auto *const string_tree = new StringTreeType{};
+
+  std::default_random_engine generator(0);
+  std::uniform_int_distribution<int32_t> tenant_dist(-3, 3);
+  std::uniform_int_distribution<int64_t> time_dist(-1000, 1000);
+  std::uniform_int_distribution<int> name_dist(0, 5);
+  const std::vector<std::string> name_list = {"", std::string(1, '\0'), "a", std::string("a\0b", 3), "ab", "b"};
+
+  std::map<std::tuple<int32_t, int64_t>, int64_t> integer_map;
+  std::map<std::tuple<int32_t, std::string, int64_t>, int64_t> string_map;
+  for (int64_t i = 0; i < 16 * 1024; i++) {
+    int32_t tenant = tenant_dist(generator);
+    int64_t time = time_dist(generator);
+    const std::string &name = name_list[name_dist(generator)];
+
+    EXPECT_EQ(integer_tree->Insert({tenant, time}, i, true),
+              integer_map.emplace(std::make_tuple(tenant, time), i).second);
+    EXPECT_EQ(string_tree->Insert({tenant, time, name}, i, true),
+              string_map.emplace(std::make_tuple(tenant, name, time), i).second);
+  }
+
+  std::vector<int64_t> expected;
+  for (const auto &item : integer_map) {
+    expected.push_back(item.second);
+  }
+  std::vector<int64_t> result;
+  integer_tree->ScanRange({-3, -1000}, {3, 1000}, [&](const uint64_t &key, const int64_t &value) {
+    (void)key;
+    result.push_back(value);
+    return true;
+  });
+  EXPECT_EQ(result, expected);
+
+  expected.clear();
+  for (const auto &item : string_map) {
+    expected.push_back(item.second);
+  }
+  result.clear();
+  string_tree->ScanRange({-3, -1000, ""}, {3, 1000, "b"}, [&](const bwtree::ByteKey &key, const int64_t &value) {
+    (void)key;
+    result.push_back(value);
+    return true;
+  });
+  EXPECT_EQ(result, expected);
+
+  for (const auto &[key, value] : string_map) {
+    std::vector<int64_t> value_set;
+    string_tree->GetValue({std::get<0>(key), std::get<2>(key), std::get<1>(key)}, value_set);
+    ASSERT_EQ(value_set.size(), 1);
+    EXPECT_EQ(value_set[0], value);
+  }
+
+  delete integer_tree;
+  delete string_tree;
+}
+
+/*
+ * A hot key with many more values than a leaf node holds is read, updated and
+ * deleted correctly, while keys around it still split into their own leaf
+ * nodes
+ */
+TEST(BwtreeHotKeyTest, ManyValuesPerKey) {
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+
+  const int64_t hot_key = 1000;
+  const int64_t hot_value_num = 16 * 1024;
+  for (int64_t i = 0; i < hot_value_num; i++) {
+    EXPECT_TRUE(tree->Insert(hot_key, i));
+    EXPECT_TRUE(tree->Insert(i * 2 + 1, i));
+    EXPECT_FALSE(tree->Insert(hot_key, i / 2));
+  }
+
+  std::vector<int64_t> value_set;
+  tree->GetValue(hot_key, value_set);
+  std::sort(value_set.begin(), value_set.end());
+  ASSERT_EQ(value_set.size(), hot_value_num);
+  for (int64_t i = 0; i < hot_value_num; i++) {
+    EXPECT_EQ(value_set[i], i);
+  }
+
+  // Deletes stay on the delta chain until the next consolidation
+  for (int64_t i = 0; i < hot_value_num; i += 3) {
+    EXPECT_TRUE(tree->Delete(hot_key, i));
+    EXPECT_FALSE(tree->Delete(hot_key, i));
+
+    if (i % 300 == 0) {
+      size_t value_num = 0;
+      tree->VisitValue(hot_key, [&](const int64_t &value) {
+        EXPECT_FALSE((value % 3 == 0) && (value <= i));
+        value_num++;
+        return true;
+      });
+      EXPECT_EQ(value_num, hot_value_num - (i / 3 + 1));
+    }
+  }
+
+  value_set.clear();
+  tree->GetValue(hot_key, value_set);
+  EXPECT_EQ(value_set.size(), hot_value_num - (hot_value_num + 2) / 3);
+
+  for (int64_t i = 0; i < hot_value_num; i += 97) {
+    value_set.clear();
+    tree->GetValue(i * 2 + 1, value_set);
+    ASSERT_EQ(value_set.size(), 1);
+    EXPECT_EQ(value_set[0], i);
+  }
+
+  delete tree;
+}
+
+/*
+ * The mapping table only allocates chunks for NodeIDs handed out, and nodes
+ * stay reachable while threads grow it
+ */
+TEST(BwtreeMappingTableTest, GrowsWithNodeCount) {
+  using TreeType = test::BwTreeTestUtil::TreeType;
+  // Chunks are not rounded up for the cluster free masks
+  for (int i = 0; i < MAPPING_TABLE_CHUNK_COUNT; i++) {
+    EXPECT_EQ(TreeType::GetMappingTableChunkMemorySize(i), (MAPPING_TABLE_FIRST_CHUNK_SIZE << i) * sizeof(void *));
+  }
+
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+
+  EXPECT_LE(tree->GetMappingTableMemorySize(), 2 * MAPPING_TABLE_FIRST_CHUNK_SIZE * sizeof(void *));
+
+  const int num_threads = 4;
+  const int64_t key_num = 256 * 1024;
+  std::vector<std::thread> threads;
+  for (int thread_id = 0; thread_id < num_threads; thread_id++) {
+    threads.emplace_back([&, thread_id] {
+      for (int64_t i = thread_id; i < key_num; i += num_threads) {
+        EXPECT_TRUE(tree->Insert(i, i));
+        // A key inserted earlier by this thread, whose node might have moved since
+        EXPECT_TRUE(tree->Contains(i / 2 / num_threads * num_threads + thread_id));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Chunks double in size, so the table is at most twice as large as needed
+  const size_t node_id_num = tree->next_unused_node_id.load();
+  EXPECT_GT(node_id_num, MAPPING_TABLE_FIRST_CHUNK_SIZE);
+  EXPECT_LE(tree->GetMappingTableMemorySize(), 2 * (node_id_num + MAPPING_TABLE_FIRST_CHUNK_SIZE) * sizeof(void *));
+
+  for (int64_t i = 0; i < key_num; i++) {
+    std::vector<int64_t> value_set;
+    tree->GetValue(i, value_set);
+    ASSERT_EQ(value_set.size(), 1);
+    EXPECT_EQ(value_set[0], i);
+  }
+
+  delete tree;
+}
+
+/*
+ * When the mapping table could not map another NodeID, splits are skipped
+ * instead of failing the operation, and leaves grow beyond their size until
+ * NodeIDs are available
+ */
+TEST(BwtreeMappingTableTest, SkipsSplitsWhenFull) {
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+
+  // Only the NodeIDs left in the first cluster could be handed out
+  tree->next_unused_node_id.store(MAPPING_TABLE_SIZE);
+
+  const int64_t key_num = 16 * 1024;
+  for (int64_t i = 0; i < key_num; i++) {
+    EXPECT_TRUE(tree->Insert(i, i));
+  }
+  for (int64_t i = 0; i < key_num; i += 2) {
+    EXPECT_TRUE(tree->Delete(i, i));
+  }
+
+  EXPECT_LT(tree->GetMappingTableMemorySize(), 2 * MAPPING_TABLE_FIRST_CHUNK_SIZE * sizeof(void *));
+  tree->PerformGarbageCollection();
+
+  int64_t key = 1;
+  for (auto it = tree->Begin(); !it.IsEnd(); it++) {
+    EXPECT_EQ(it->first, key);
+    key += 2;
+  }
+  EXPECT_EQ(key, key_num + 1);
+
+  delete tree;
+}
+
+/*
+ * Split siblings take NodeIDs from the cluster of the split node, so that
+ * neighboring leaves share mapping table pages, and clusters are filled
+ * before new ones are taken
+ */
+TEST(BwtreeNodeIDClusterTest, SiblingsShareClusters) {
+  for (const int64_t step : {1L, 7919L}) {
+    auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+
+    const int64_t key_num = 256 * 1024;
+    for (int64_t i = 0; i < key_num; i++) {
+      EXPECT_TRUE(tree->Insert((i * step) % key_num, i));
+    }
+
+    size_t leaf_num = 0;
+    size_t same_cluster_num = 0;
+    NodeID node_id = FIRST_LEAF_NODE_ID;
+    while (node_id != INVALID_NODE_ID) {
+      const NodeID next_node_id = tree->GetNode(node_id)->GetNextNodeID();
+
+      leaf_num++;
+      if ((next_node_id / NODE_ID_CLUSTER_SIZE) == (node_id / NODE_ID_CLUSTER_SIZE)) {
+        same_cluster_num++;
+      }
+
+      node_id = next_node_id;
+    }
+
+    EXPECT_GT(leaf_num, NODE_ID_CLUSTER_SIZE);
+    // Sequential inserts always split the last leaf, whose sibling is then mapped next to it
+    if (step == 1) {
+      EXPECT_GT(same_cluster_num * 2, leaf_num);
+    }
+
+    // At most the latest clusters of leaf and inner nodes are not full
+    EXPECT_LE(tree->next_unused_node_id.load(), 2 * leaf_num + 2 * NODE_ID_CLUSTER_SIZE);
+
+    delete tree;
+  }
+}
+
+/*
+ * NodeIDs of nodes removed by merges are recycled through thread local
+ * batches and reused by later splits, so repeatedly growing and shrinking the
+ * tree does not take new NodeIDs
+ */
+TEST(BwtreeNodeIDRecycleTest, ReusesRemovedNodeIDs) {
+  auto *const tree = test::BwTreeTestUtil::GetEmptyTree();
+
+  const int num_threads = 4;
+  const int64_t key_num = 64 * 1024;
+  tree->UpdateThreadLocal(num_threads + 1);
+
+  std::vector<size_t> next_node_id_list;
+  for (int round = 0; round < 6; round++) {
+    std::vector<std::thread> threads;
+    for (int thread_id = 0; thread_id < num_threads; thread_id++) {
+      threads.emplace_back([&, thread_id] {
+        tree->AssignGCID(thread_id + 1);
+
+        for (int64_t i = thread_id; i < key_num; i += num_threads) {
+          EXPECT_TRUE(tree->Insert(i, round));
+        }
+        for (int64_t i = thread_id; i < key_num; i += num_threads) {
+          EXPECT_TRUE(tree->Delete(i, round));
+        }
+
+        tree->UnregisterThread(thread_id + 1);
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    // Let the epoch manager recycle NodeIDs of removed nodes
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    next_node_id_list.push_back(tree->next_unused_node_id.load());
+  }
+
+  // Without recycling every round would take as many NodeIDs as the first one
+  EXPECT_LT(next_node_id_list.back(), 2 * next_node_id_list.front());
+
+  tree->UpdateThreadLocal(1);
+  delete tree;
+}
+
+/*
+ * Worker threads that never call AssignGCID() are registered on their first
+ * operation and protected by their own GC slot, threads without a slot in the
+ * tree fall back to shared epochs, and nested operations started in a visitor
+ * keep the epoch of the outer one
+ */
+TEST(BwtreeEpochTest, ThreadLocalAndSharedEpochs) {
+  auto *const tree = new test::BwTreeTestUtil::TreeType{true, test::BwTreeTestUtil::KeyComparator{1},
+                                                        test::BwTreeTestUtil::KeyEqualityChecker{1}};
+  EXPECT_EQ(tree->GetThreadNum(), PREALLOCATE_THREAD_NUM);
+
+  const int num_threads = 4;
+  const int64_t key_num = 32 * 1024;
+
+  auto workload = [&](int thread_id) {
+    for (int64_t i = thread_id; i < key_num; i += num_threads) {
+      EXPECT_TRUE(tree->Insert(i, i));
+    }
+    for (int64_t i = thread_id; i < key_num; i += 2 * num_threads) {
+      EXPECT_TRUE(tree->Delete(i, i));
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int thread_id = 0; thread_id < num_threads; thread_id++) {
+    threads.emplace_back([&, thread_id] {
+      workload(thread_id);
+
+      // The thread has been registered, and is quiescent outside the tree
+      EXPECT_NE(tree->GetRegisteredGCMetaData(), nullptr);
+      EXPECT_EQ(tree->GetCurrentGCMetaData()->last_active_epoch.load(), bwtree::BwTreeBase::QUIESCENT_EPOCH);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(tree->GetSize(), key_num - key_num / 2);
+
+  // Operations started by a visitor do not end the epoch of the outer operation
+  tree->VisitValue(1, [&](const int64_t &value) {
+    EXPECT_EQ(value, 1);
+    EXPECT_NE(tree->GetCurrentGCMetaData()->last_active_epoch.load(), bwtree::BwTreeBase::QUIESCENT_EPOCH);
+    EXPECT_EQ(tree->GetValue(2).size(), 0U);
+    EXPECT_NE(tree->GetCurrentGCMetaData()->last_active_epoch.load(), bwtree::BwTreeBase::QUIESCENT_EPOCH);
+    return true;
+  });
+  EXPECT_EQ(tree->GetCurrentGCMetaData()->last_active_epoch.load(), bwtree::BwTreeBase::QUIESCENT_EPOCH);
+  delete tree;
+
+  // Threads with IDs beyond MAX_GC_ID_COUNT have no slot and use shared epochs, while the others keep their own garbage
+  auto *const small_tree = test::BwTreeTestUtil::GetEmptyTree();
+  auto *const tree_p = small_tree;
+  threads.clear();
+  for (int thread_id = 0; thread_id < num_threads; thread_id++) {
+    threads.emplace_back([&, thread_id] {
+      const bool has_slot = (thread_id % 2 == 0);
+      tree_p->AssignGCID(has_slot ? thread_id : static_cast<int>(MAX_GC_ID_COUNT) + thread_id);
+
+      for (int64_t i = thread_id; i < key_num; i += num_threads) {
+        EXPECT_TRUE(tree_p->Insert(i, i));
+        EXPECT_EQ(tree_p->GetValue(i).size(), 1U);
+      }
+      for (int64_t i = thread_id; i < key_num; i += num_threads) {
+        EXPECT_TRUE(tree_p->Delete(i, i));
+      }
+
+      EXPECT_EQ(tree_p->GetRegisteredGCMetaData() != nullptr, has_slot);
+      if (has_slot) {
+        tree_p->UnregisterThread(thread_id);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(tree_p->GetSize(), 0U);
+  for (int64_t i = 0; i < key_num; i += 97) {
+    EXPECT_EQ(tree_p->GetValue(i).size(), 0U);
+  }
+
+  delete small_tree;
+}
+
+/*
+ * GC IDs of exited threads are reused by new threads, and the slots of a tree
+ * grow while other threads use it when more threads are live than the tree
+ * has slots
+ */
+TEST(BwtreeEpochTest, ReusesAndGrowsGCSlots) {
+  auto *const tree = new test::BwTreeTestUtil::TreeType{true, test::BwTreeTestUtil::KeyComparator{1},
+                                                        test::BwTreeTestUtil::KeyEqualityChecker{1}};
+
+  // Short-lived threads one after another get the same GC ID
+  std::vector<int> gc_id_list;
+  for (int64_t key = 0; key < 16; key++) {
+    std::thread thread([&, key] {
+      EXPECT_TRUE(tree->Insert(key, key));
+      gc_id_list.push_back(bwtree::BwTreeBase::gc_id);
+    });
+    thread.join();
+  }
+  EXPECT_EQ(std::count(gc_id_list.begin(), gc_id_list.end(), gc_id_list.front()), 16);
+  EXPECT_EQ(tree->GetThreadNum(), PREALLOCATE_THREAD_NUM);
+
+  // More live threads than preallocated slots; few keys per thread, since the
+  // slots grow as soon as the threads are live
+  const int num_threads = 2 * PREALLOCATE_THREAD_NUM;
+  const int64_t key_num = 4 * 1024;
+  std::atomic<int> ready_count = 0;
+  std::vector<std::thread> threads;
+  for (int thread_id = 0; thread_id < num_threads; thread_id++) {
+    threads.emplace_back([&, thread_id] {
+      // Keep all threads alive until every thread has its GC ID
+      bwtree::BwTreeBase::RegisterThread();
+      ready_count.fetch_add(1);
+      while (ready_count.load() < num_threads) {
+        std::this_thread::yield();
+      }
+
+      for (int64_t i = 16 + thread_id; i < key_num; i += num_threads) {
+        EXPECT_TRUE(tree->Insert(i, i));
+        EXPECT_EQ(tree->GetValue(i).size(), 1U);
+      }
+      for (int64_t i = 16 + thread_id; i < key_num; i += 2 * num_threads) {
+        EXPECT_TRUE(tree->Delete(i, i));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_GT(tree->GetThreadNum(), PREALLOCATE_THREAD_NUM);
+  for (int64_t i = 0; i < key_num; i++) {
+    const bool deleted = (i >= 16) && ((i - 16) % (2 * num_threads) < num_threads);
+    EXPECT_EQ(tree->GetValue(i).size(), deleted ? 0U : 1U);
+  }
+
+  delete tree;
+}
+
+/*
+ * Garbage and NodeIDs left in the GC slot of an exited thread are moved out
+ * by the epoch manager, so they are freed even if the ID is not claimed again
+ */
+TEST(BwtreeEpochTest, SweepsReleasedGCSlots) {
+  auto *const tree = new test::BwTreeTestUtil::TreeType{false, test::BwTreeTestUtil::KeyComparator{1},
+                                                        test::BwTreeTestUtil::KeyEqualityChecker{1}};
+  const int64_t key_num = 16 * 1024;
+
+  int exited_gc_id = -1;
+  std::thread thread([&] {
+    for (int64_t i = 0; i < key_num; i++) {
+      EXPECT_TRUE(tree->Insert(i, i));
+    }
+    for (int64_t i = 0; i < key_num; i++) {
+      EXPECT_TRUE(tree->Delete(i, i));
+    }
+    exited_gc_id = bwtree::BwTreeBase::gc_id;
+  });
+  thread.join();
+
+  // The global epoch has not advanced, so the thread could not free anything
+  ASSERT_GE(exited_gc_id, 0);
+  EXPECT_GT(tree->GetGCMetaData(exited_gc_id)->node_count, 0U);
+
+  tree->PerformGarbageCollection();
+  EXPECT_EQ(tree->GetGCMetaData(exited_gc_id)->head_p, nullptr);
+  EXPECT_EQ(tree->GetGCMetaData(exited_gc_id)->node_count, 0U);
+  EXPECT_EQ(tree->GetGCMetaData(exited_gc_id)->node_id_batch_p, nullptr);
+
+  for (int i = 0; i < 3; i++) {
+    tree->PerformGarbageCollection();
+  }
+  EXPECT_EQ(tree->epoch_manager.pending_head_p, nullptr);
+
+  // The ID is still handed out to the next thread
+  std::thread([&] {
+    EXPECT_TRUE(tree->Insert(0, 0));
+    EXPECT_EQ(bwtree::BwTreeBase::gc_id, exited_gc_id);
+  }).join();
+  EXPECT_EQ(tree->GetValue(0).size(), 1U);
+
+  delete tree;
+}
+
+/*
+ * The cached minimum epoch is only refreshed when it is not above the target
+ * epoch, and a thread inside the tree keeps the bound at its epoch until it
+ * leaves
+ */
+TEST(BwtreeEpochTest, CachesMinimumEpoch) {
+  auto *const tree = new test::BwTreeTestUtil::TreeType{false, test::BwTreeTestUtil::KeyComparator{1},
+                                                        test::BwTreeTestUtil::KeyEqualityChecker{1}};
+  EXPECT_TRUE(tree->Insert(0, 0));
+
+  std::atomic<bool> entered = false;
+  std::atomic<bool> released = false;
+  std::thread reader([&] {
+    tree->VisitValue(0, [&](const int64_t &) {
+      entered.store(true);
+      while (!released.load()) {
+        std::this_thread::yield();
+      }
+      return true;
+    });
+  });
+  while (!entered.load()) {
+    std::this_thread::yield();
+  }
+
+  // The reader entered in epoch 0
+  for (int i = 0; i < 3; i++) {
+    tree->PerformGarbageCollection();
+  }
+  EXPECT_EQ(tree->GetGlobalEpoch(), 3U);
+  EXPECT_EQ(tree->SummarizeGCEpoch(2), 0U);
+
+  released.store(true);
+  reader.join();
+
+  // All threads are quiescent, so the bound is the global epoch
+  EXPECT_EQ(tree->SummarizeGCEpoch(2), 3U);
+
+  // A thread entering a new epoch does not lower the cached bound
+  tree->PerformGarbageCollection();
+  tree->VisitValue(0, [&](const int64_t &) {
+    EXPECT_EQ(tree->SummarizeGCEpoch(2), 3U);
+    EXPECT_EQ(tree->SummarizeGCEpoch(3), 4U);
+    return true;
+  });
+
+  delete tree;
+}
+
+/*
+ * Garbage nodes and epoch nodes are reused after being freed, so retiring
+ * nodes repeatedly does not keep allocating
+ */
+TEST(BwtreeEpochTest, ReusesGarbageNodes) {
+  auto *const tree = new test::BwTreeTestUtil::TreeType{false, test::BwTreeTestUtil::KeyComparator{1},
+                                                        test::BwTreeTestUtil::KeyEqualityChecker{1}};
+  const int64_t key_num = 4096;
+  size_t slab_count = 0;
+
+  for (int round = 0; round < 8; round++) {
+    for (int64_t i = 0; i < key_num; i++) {
+      EXPECT_TRUE(tree->Insert(i, i));
+    }
+    for (int64_t i = 0; i < key_num; i++) {
+      EXPECT_TRUE(tree->Delete(i, i));
+    }
+
+    // Let the thread local GC free everything retired in this round
+    tree->PerformGarbageCollection();
+    tree->PerformGC(tree->gc_id);
+
+    // The first rounds warm up the free lists
+    if (round < 2) {
+      slab_count = tree->GetGarbageNodeSlabCount();
+      EXPECT_GT(slab_count, 0U);
+    } else {
+      EXPECT_EQ(tree->GetGarbageNodeSlabCount(), slab_count);
+    }
+  }
+
+  delete tree;
+}
+
+/*
+ * Node memory is rounded up to a size class at most a quarter larger, and
+ * memory freed by GC is reused by the freeing thread instead of going through
+ * the general purpose allocator, even when the cache starts out full of
+ * blocks of a size the tree does not use
+ */
+TEST(BwtreeEpochTest, CachesNodeMemory) {
+  using BwTreeBase = bwtree::BwTreeBase;
+
+  for (size_t size = 1; size <= NODE_CACHE_MAX_BLOCK_SIZE; size++) {
+    const size_t size_class = BwTreeBase::GetNodeSizeClass(size);
+    const size_t block_size = BwTreeBase::GetNodeSizeClassSize(size_class);
+    EXPECT_LT(size_class, BwTreeBase::NODE_CACHE_CLASS_COUNT);
+    EXPECT_GE(block_size, size);
+    EXPECT_LE(block_size, std::max(NODE_CACHE_MIN_BLOCK_SIZE, size + size / 4));
+  }
+
+  BwTreeBase::ReleaseNodeCache();
+
+  const size_t unused_block_size = NODE_CACHE_MAX_BLOCK_SIZE - 1;
+  std::vector<void *> block_list;
+  for (size_t i = 0; i < NODE_CACHE_THREAD_CAPACITY / NODE_CACHE_MAX_BLOCK_SIZE; i++) {
+    block_list.push_back(BwTreeBase::AllocateNodeMemory(unused_block_size));
+  }
+  for (void *block_p : block_list) {
+    BwTreeBase::FreeNodeMemory(block_p, unused_block_size);
+  }
+
+  auto *const tree = new test::BwTreeTestUtil::TreeType{false, test::BwTreeTestUtil::KeyComparator{1},
+                                                        test::BwTreeTestUtil::KeyEqualityChecker{1}};
+  const int64_t key_num = 4096;
+  BwTreeBase::NodeCacheStats start_stats;
+
+  for (int round = 0; round < 8; round++) {
+    for (int64_t i = 0; i < key_num; i++) {
+      EXPECT_TRUE(tree->Insert(i, i));
+    }
+    for (int64_t i = 0; i < key_num; i++) {
+      EXPECT_TRUE(tree->Delete(i, i));
+    }
+
+    // Memory freed here goes to the cache of this thread
+    tree->PerformGarbageCollection();
+    tree->PerformGC(tree->gc_id);
+
+    // The first rounds warm up the cache
+    if (round == 1) {
+      start_stats = BwTreeBase::GetThreadNodeCacheStats();
+    }
+  }
+
+  const BwTreeBase::NodeCacheStats stats = BwTreeBase::GetThreadNodeCacheStats();
+  const uint64_t allocate_count = stats.allocate_count - start_stats.allocate_count;
+  const uint64_t malloc_count = stats.malloc_count - start_stats.malloc_count;
+  EXPECT_GT(allocate_count, 0U);
+#ifdef USE_NODE_CACHE
+  EXPECT_LT(malloc_count * 10, allocate_count);
+  EXPECT_LE(stats.cached_size, NODE_CACHE_THREAD_CAPACITY);
+#else
+  EXPECT_EQ(malloc_count, allocate_count);
+#endif
+
+  delete tree;
+
+  BwTreeBase::ReleaseNodeCache();
+  EXPECT_EQ(BwTreeBase::GetThreadNodeCacheStats().cached_size, 0U);
+}
+
+/*
+ * Free blocks kept by one thread and by all threads are bounded, and stats
+ * include the counters and free blocks of live threads
+ */
+TEST(BwtreeEpochTest, BoundsNodeCache) {
+  using BwTreeBase = bwtree::BwTreeBase;
+  const size_t block_size = 4096;
+  const size_t block_num = 2 * NODE_CACHE_THREAD_CAPACITY / block_size;
+  const int num_threads = NODE_CACHE_CAPACITY / NODE_CACHE_THREAD_CAPACITY + 2;
+
+  BwTreeBase::ReleaseNodeCache();
+  const BwTreeBase::NodeCacheStats start_stats = BwTreeBase::GetNodeCacheStats();
+  const size_t start_reserved_size = BwTreeBase::GetNodeCacheReservedSize();
+
+  std::atomic<int> ready_count = 0;
+  std::atomic<bool> exit_flag = false;
+  std::vector<std::thread> threads;
+  for (int thread_id = 0; thread_id < num_threads; thread_id++) {
+    threads.emplace_back([&] {
+      std::vector<void *> block_list;
+      for (size_t i = 0; i < block_num; i++) {
+        block_list.push_back(BwTreeBase::AllocateNodeMemory(block_size));
+      }
+      for (void *block_p : block_list) {
+        BwTreeBase::FreeNodeMemory(block_p, block_size);
+      }
+      EXPECT_LE(BwTreeBase::GetThreadNodeCacheStats().cached_size, NODE_CACHE_THREAD_CAPACITY);
+
+      // Keep the cache until the stats are checked
+      ready_count.fetch_add(1);
+      while (!exit_flag.load()) {
+        std::this_thread::yield();
+      }
+    });
+  }
+  while (ready_count.load() < num_threads) {
+    std::this_thread::yield();
+  }
+
+  const BwTreeBase::NodeCacheStats stats = BwTreeBase::GetNodeCacheStats();
+  EXPECT_EQ(stats.allocate_count - start_stats.allocate_count, num_threads * block_num);
+  EXPECT_EQ(stats.free_count - start_stats.free_count, num_threads * block_num);
+#ifdef USE_NODE_CACHE
+  EXPECT_GT(stats.cached_size, start_stats.cached_size);
+  EXPECT_LE(stats.cached_size, NODE_CACHE_CAPACITY);
+  EXPECT_LT(stats.cached_size - start_stats.cached_size, num_threads * NODE_CACHE_THREAD_CAPACITY);
+  EXPECT_GE(BwTreeBase::GetNodeCacheReservedSize(), stats.cached_size);
+  EXPECT_LE(BwTreeBase::GetNodeCacheReservedSize(), NODE_CACHE_CAPACITY);
+#endif
+
+  exit_flag.store(true);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Caches of exited threads are released
+  EXPECT_EQ(BwTreeBase::GetNodeCacheStats().cached_size, start_stats.cached_size);
+  EXPECT_EQ(BwTreeBase::GetNodeCacheReservedSize(), start_reserved_size);
+}